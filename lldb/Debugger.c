@@ -1,1402 +1,2937 @@
-/******************************************************************************
-* Copyright (C) 2009 Zhang Lei.  All rights reserved.
-* Modification work Copyright (C) 2016 Wen Xichang.
-*
-* Permission is hereby granted, free of charge, to any person obtaining
-* a copy of this software and associated documentation files (the
-* "Software"), to deal in the Software without restriction, including
-* without limitation the rights to use, copy, modify, merge, publish,
-* distribute, sublicense, and/or sell copies of the Software, and to
-* permit persons to whom the Software is furnished to do so, subject to
-* the following conditions:
-*
-* The above copyright notice and this permission notice shall be
-* included in all copies or substantial portions of the Software.
-*
-* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
-* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
-* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
-* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
-* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
-* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
-* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-******************************************************************************/
-
-#include <lua.h>
-#include <lauxlib.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include <string.h>
-#include <assert.h>
-#include <signal.h>
-
-#include "list.h"
-
-#ifdef OS_WIN
-#include <io.h>     //access
-#define strtoull _strtoui64
-#endif
-
-#ifdef OS_LINUX
-#include <unistd.h> //access, getcwd
-#define _MAX_PATH PATH_MAX
-
-static char * _fullpath(char * absPath, const char * relPath, size_t maxLen)
-{
-    char * ret = 0;
-    assert(absPath && relPath && maxLen > 1);
-    if (*relPath == '/') {
-        size_t len = strlen(relPath);
-        if (len <= maxLen - 1) {
-            strcpy(absPath, relPath);
-            ret = absPath;
-        }
-    }
-    else {
-        ret = getcwd(absPath, maxLen);
-        if (ret) {
-            size_t len = strlen(absPath);
-            size_t rlen = strlen(relPath);
-            if (absPath[len - 1] != '/' && len < maxLen && rlen) {
-                absPath[len++] = '/';
-            }
-            if (len + rlen < maxLen) {
-                strcpy(absPath + len, relPath);
-                ret = absPath;
-            }
-        }
-    }
-    return ret;
-}
-
-#endif
-
-#include "Protocol.h"
-
-typedef enum
-{
-    STEP = 1,
-    NEXT,
-    STEP_OUT,
-    FINISH,
-    RUN
-} CMD;
-
-//Multiple states, may use in embeded program
-#define MAX_STATE       1024
-#define MAX_LINENO      65536
-
-static lua_State *s_states[MAX_STATE];
-static int s_nstate;
-
-//Debugger remote socket
-static SOCKET s_dbg_sock = INVALID_SOCKET;
-static int s_signaled = 0;
-
-//Hope this level is enough for lua calls :-)
-#define INIT_LEVEL      100000000
-
-//DebugInfo
-static CMD s_cmd = STEP;
-static int s_level = INIT_LEVEL;
-static int s_blevel = 0;
-
-//For cache value
-static int s_cacheval_ref = LUA_NOREF;
-static lua_State *s_cacheval_L = NULL;
-
-//Breakpoints
-typedef struct BRK
-{
-    struct hlist_node hlist;
-    struct list_head list;
-    char *file;
-    int lineno;
-    int enable;
-} BRK;
-
-//Breakpoints seq, hashed
-static struct hlist_head s_breaks[MAX_LINENO];
-
-//Breakpoints ordered
-static LIST_HEAD(s_break_head);
-
-static BRK *BRKNew(const char *path, int lineno)
-{
-    BRK *b = calloc(1, sizeof(BRK));
-    if (!b)
-        return NULL;
-    
-    b->file = strdup(path);
-    if (!b->file) {
-        free(b);
-        return NULL;
-    }
-    b->lineno = lineno;
-    b->enable = 1;
-    
-    list_add_tail(&b->list, &s_break_head);
-    return b;
-}
-
-static void BRKFree(BRK *b)
-{
-    hlist_del(&b->hlist);
-    list_del(&b->list);
-    
-    free(b->file);
-    free(b);
-}
-
-static void getFileName(char * out, const char * file, size_t outLen)
-{
-    const char * p = strrchr(file, '/');
-    if (p) {
-        ++p;
-    }
-    else {
-        p = strrchr(file, '\\');
-        if (p) {
-            ++p;
-        }
-        else {
-            p = file;
-        }
-    }
-
-    strncpy(out, p, outLen);
-    out[outLen - 1] = 0;
-}
-
-static void hook(lua_State *L, lua_Debug *ar);
-
-static void onGC(void)
-{
-    if (s_dbg_sock != INVALID_SOCKET) {
-        SendQuit(s_dbg_sock);
-        closesocket(s_dbg_sock);
-        s_dbg_sock = INVALID_SOCKET;
-    }
-}
-
-static SOCKET tryConnectToDebugger(void)
-{
-    unsigned short port = 2679;
-    char * p;
-
-    //read config and set up connection with a remote controller
-    p = getenv("LDB_PORT");
-    if (p && atoi(p)) {    //REMOTE_LDB's value is sth. like "192.168.0.1:6688".
-        port = atoi(p);
-    }
-    
-    return Connect("127.0.0.1", port);
-}
-
-static void rldbSignaled(int sig)
-{
-    int i;
-    
-    for (i = 0; i < s_nstate; ++i) {
-        lua_sethook(s_states[i], hook, LUA_MASKLINE | LUA_MASKCALL | LUA_MASKRET, 0);
-    }
-
-    s_signaled = 1;
-}
-
-#ifdef OS_WIN
-static DWORD WINAPI waitSig(LPVOID lpParam)
-{
-    char name[128];
-    HANDLE notify;
-
-    sprintf(name, "Global\\lldb_sigevent_%d", GetCurrentProcessId());
-
-    notify = CreateEventA(NULL, FALSE, FALSE, name);
-    if (!notify)
-        return -1;
-
-    while (1) {
-        if (WaitForSingleObject(notify, INFINITE) == WAIT_OBJECT_0) {
-            rldbSignaled(0);
-        }
-    }
-}
-#endif
-
-#ifdef OS_WIN
-__declspec(dllexport)
-#endif
-int luaopen_lldb(lua_State * L)
-{
-    static int sig_installed;
-    int i;
-    
-    if (!sig_installed) {
-#ifdef OS_WIN
-        CreateThread(NULL, 0, waitSig, NULL, 0, NULL);
-#else
-        const char *sig = getenv("LDB_SIG");
-        if (sig && atoi(sig)) {
-            signal(atoi(sig), rldbSignaled);
-        } else {
-            signal(SIGUSR2, rldbSignaled);
-        }
-#endif
-        if (getenv("LDB_STARTUP") && *getenv("LDB_STARTUP") == '1') {
-            s_dbg_sock = tryConnectToDebugger();
-        }
-        
-        atexit(onGC);
-        sig_installed = 1;
-    }
-    
-    for (i = 0; i < s_nstate; ++i) {
-        if (s_states[i] == L)
-            goto end_ret;
-    }
-    
-    if (s_nstate >= MAX_STATE) {
-        fprintf(stderr, "Max lua state reached: %d\n", s_nstate);
-        goto end_ret;
-    }
-    s_states[s_nstate++] = L;
-
-    //Debugger present, break immediately
-    if (s_dbg_sock != INVALID_SOCKET)
-        lua_sethook(L, hook, LUA_MASKLINE | LUA_MASKCALL | LUA_MASKRET, 0);
-
-end_ret:
-    lua_pushboolean(L, 1);
-    return 1;
-}
-
-static int prompt(lua_State *L, lua_Debug * ar);
-static int checkBreakPoint(lua_State *L, lua_Debug * ar);
-
-static void clearhooks(void)
-{
-    int i;
-    for (i = 0; i < s_nstate; ++i)
-        lua_sethook(s_states[i], hook, 0, 0);
-    
-    //Clear cache value
-    if (s_cacheval_L) {
-        luaL_unref(s_cacheval_L, LUA_REGISTRYINDEX, s_cacheval_ref);
-        s_cacheval_L = NULL;
-        s_cacheval_ref = LUA_NOREF;
-    }
-    
-    //Clear breakpoints
-    for (i = 0; i < MAX_LINENO; ++i) {
-        struct hlist_node *pos, *next;
-        
-        hlist_for_each_safe(pos, next, &s_breaks[i]) {
-            BRK *b = hlist_entry(pos, BRK, hlist);
-            BRKFree(b);
-        }
-    }
-}
-
-void hook(lua_State * L, lua_Debug * ar)
-{
-    int event = ar->event;
-    int top = lua_gettop(L);
-    
-    lua_getinfo(L, "nSl", ar);
-    
-    if (ar->currentline < 0)
-        return;
-    
-    //Connect to debugger when signaled
-    if (s_signaled) {
-        s_signaled = 0;
-        if (s_dbg_sock == INVALID_SOCKET) {
-            s_dbg_sock = tryConnectToDebugger();
-            if (s_dbg_sock == INVALID_SOCKET) {
-                clearhooks();
-                return;
-            }
-        }
-        //Connect success, break in current line and wait debugger's cmd
-        s_cmd = STEP;
-    }
-
-    if (event == LUA_HOOKLINE) {
-        int rc = 0;
-
-        if (s_cmd == STEP) {
-            rc = prompt(L, ar);
-        }
-        else if (s_cmd == NEXT) {
-            if (s_blevel && s_level <= s_blevel)
-                rc = prompt(L, ar);
-            else
-                rc = checkBreakPoint(L, ar);
-        }
-        else if (s_cmd == STEP_OUT) {
-            if (s_blevel && s_level < s_blevel)
-                rc = prompt(L, ar);
-            else
-                rc = checkBreakPoint(L, ar);
-        }
-        else if (s_cmd == FINISH) {
-            //prompt(L, ar);
-        }
-        else if (s_cmd == RUN) {
-            rc = checkBreakPoint(L, ar);
-        }
-
-        //If a socket IO error or a protocol error happened, stop debugging
-        //without informing the remote Controller.
-        if (rc < 0) {
-            clearhooks();
-            closesocket(s_dbg_sock);
-            s_dbg_sock = INVALID_SOCKET;
-        }
-    }
-    else {
-        assert(event != LUA_HOOKCOUNT);
-
-        if (event == LUA_HOOKCALL) {
-            s_level++;
-        }
-        else if (event == LUA_HOOKRET || event == LUA_HOOKTAILRET) {
-            s_level--;
-        }
-    }
-    assert(top == lua_gettop(L));
-}
-
-/*
-** Check if the current line contains a breakpoint. If yes, break and prompt
-** for user, and reset statck level to 0 preparing for the next "OVER" command.
-*/
-int checkBreakPoint(lua_State * L, lua_Debug * ar)
-{
-    int breakpoint = 0;
-    char path[_MAX_PATH + 1];
-    struct hlist_node *pos;
-    
-    lua_getinfo(L, "Sl", ar);
-    
-    if (ar->currentline >= MAX_LINENO)
-        return 0;
-
-    getFileName(path, ar->short_src, _MAX_PATH);
-    
-#ifdef OS_WIN
-    _strlwr(path);
-#endif
-
-    hlist_for_each(pos, &s_breaks[ar->currentline]) {
-        BRK *b = hlist_entry(pos, BRK, hlist);
-        if (b->enable && !strcmp(path, b->file)) {
-            breakpoint = 1;
-            break;
-        }
-    }
-    
-    if (breakpoint) {
-        return prompt(L, ar);
-    }
-    return 0;
-}
-
-static int getCmd(SOCKET s, char * buf, int bufLen, char ** argv);
-static int listLocals(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
-static int listUpVars(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
-static int listGlobals(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
-static int printStack(lua_State * L, SOCKET s);
-static int watch(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
-static int exec(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
-static int setBreakPoint(lua_State * L, const char * src, char * argv[], int argc, SOCKET s);
-static int oprBreakPoint(lua_State * L, const char * opr, char * argv[], int argc, SOCKET s);
-static int listBreakPoints(lua_State * L, SOCKET s);
-static int watchMemory(char * argv[], int argc, SOCKET s);
-
-/*
-** Return -1 when a socket io error happens, or 0 when succeed.
-*/
-int prompt(lua_State * L, lua_Debug * ar)
-{
-    SOCKET s = s_dbg_sock;
-    int top = lua_gettop(L);
-    char path[_MAX_PATH + 1];
-    char name[_MAX_PATH];
-    
-    lua_getinfo(L, "nSl", ar);
-    if (!_fullpath(path, ar->short_src, _MAX_PATH)) {
-        strncpy(path, ar->short_src, _MAX_PATH);
-        path[_MAX_PATH] = 0;
-    }
-
-    getFileName(name, ar->short_src, _MAX_PATH);
-    
-    if (SendBreak(s, name, ar->currentline, path) < 0) {
-        fprintf(stderr, "Socket error!\n");
-        return -1;
-    }
-
-    //Each prompt, we set s_level to INIT_LEVEL, and reset s_blevel;
-    s_level = INIT_LEVEL;
-    s_blevel = 0;
-    
-    while (1) {
-        char buf[PROT_MAX_CMD_LEN];
-        char * argv[PROT_MAX_ARGS];
-        int argc;
-        char * pCmd;
-        char ** pArgv;
-        int rc;
-
-        argc = getCmd(s, buf, PROT_MAX_CMD_LEN, argv);
-        if (argc == -1) {
-            fprintf(stderr, "Socket or protocol error!\n");
-            return -1;
-        }
-        if (argc == 0) {
-            if (SendErr(s, "Invalid command!") < 0) {
-                fprintf(stderr, "Socket error!\n");
-                return -1;
-            }
-            continue;
-        }
-        pCmd = argv[0];
-        argc--;
-        pArgv = argv + 1;
-
-        if (!strcmp(pCmd, "s")) {
-            s_cmd = STEP;           //Step command don't need s_blevel, breaks all the time
-            break;
-        }
-        else if (!strcmp(pCmd, "n")) {
-            s_cmd = NEXT;
-            s_blevel = s_level;     //Next breaks when s_level <= s_blevel
-            break;
-        }
-        else if (!strcmp(pCmd, "o")) {
-            s_cmd = STEP_OUT;
-            s_blevel = s_level;     //Step out breaks when s_level < s_blevel
-            break;
-        }
-        else if (!strcmp(pCmd, "f")) {
-            s_cmd = FINISH;
-            break;
-        }
-        else if (!strcmp(pCmd, "r")) {
-            s_cmd = RUN;
-            break;
-        }
-        else if (!strcmp(pCmd, "ll")) {
-            rc = listLocals(L, ar, pArgv, argc, s);
-        }
-        else if (!strcmp(pCmd, "lu")) {
-            rc = listUpVars(L, ar, pArgv, argc, s);
-        }
-        else if (!strcmp(pCmd, "lg")) {
-            rc = listGlobals(L, ar, pArgv, argc, s);
-        }
-        else if (!strcmp(pCmd, "w")) {
-            rc = watch(L, ar, pArgv, argc, s);
-        }
-        else if (!strcmp(pCmd, "ps")) {
-            rc = printStack(L, s);
-        }
-        else if (!strcmp(pCmd, "sb")) {
-            rc = setBreakPoint(L, ar->short_src, pArgv, argc, s);
-        }
-        else if (!strcmp(pCmd, "db") || !strcmp(pCmd, "en") || !strcmp(pCmd, "dis")) {
-            rc = oprBreakPoint(L, pCmd, pArgv, argc, s);
-        }
-        else if (!strcmp(pCmd, "lb")) {
-            rc = listBreakPoints(L, s);
-        }
-        else if (!strcmp(pCmd, "e")) {
-            rc = exec(L, ar, pArgv, argc, s);
-        }
-        else if (!strcmp(pCmd, "m")) {
-            rc = watchMemory(pArgv, argc, s);
-        }
-        else {
-            rc = SendErr(s, "Invalid command!");
-        }
-
-        if (rc < 0) {
-            fprintf(stderr, "Socket or protocol error!\n");
-            return -1;
-        }
-    }
-
-    assert(top == lua_gettop(L));
-    return 0;
-}
-
-/*
-** Get command from via socket s and put it in buf; then extract arguments in
-** buf, which are separated by one single space. The result argument array is
-** stored in argv, which can hold PROT_MAX_ARGS arguments at most. The actual number
-** of arguments is returned. If a socket IO error happens, -1 is returned.
-*/
-int getCmd(SOCKET s, char * buf, int bufLen, char ** argv)
-{
-    int argc = 0;
-    char * end;
-    char * p = buf;
-    int received = RecvCmd(s, buf, bufLen);
-    if (received < 0) {
-        return -1;
-    }
-    end = buf + received;
-    *end = 0;
-
-    while (p < end && argc < PROT_MAX_ARGS) {
-        while (*p == ' ' && p < end)
-            ++p;
-
-        if (*p != '"') {
-            argv[argc++] = p;
-            while (*p != ' ' && p < end)
-                ++p;
-            if (p == end)
-                break;
-        }
-        else {
-            argv[argc++] = ++p;
-            p = strchr(p, '"');
-            if (!p)
-                return -2;  //The end '"' is not found!
-        }
-        *p++ = 0;
-    }
-    return argc;
-}
-
-/*
-** Print one line text containing a variable name and its value into sb.
-** Variable value is on top of L. L stays unchanged after call.
-*/
-static void printVar(SocketBuf * sb, const char * name, lua_State * L)
-{
-    int type = lua_type(L, -1);
-
-    if (name)
-        SB_Print(sb, "%s\n", name);
-
-    switch(type) {
-        case LUA_TSTRING: {
-            size_t len;
-            const char * str = lua_tolstring(L, -1, &len);
-            int truncLen = len > PROT_MAX_STR_LEN ? PROT_MAX_STR_LEN : len;
-            SB_Print(sb, "s%p:%d:%d:%Q\n", str, len, truncLen,
-                str, truncLen); //%Q requires two arguments: buf and length
-            break;
-        }
-        case LUA_TNUMBER: {
-            /*
-            ** LUA_NUMBER may be double or integer, So a runtime check may be required.
-            ** Otherwise SB_Print may be crashed.
-            */
-            SB_Print(sb, "n%N\n", lua_tonumber(L, -1));
-            break;
-        }
-        case LUA_TTABLE: {
-            SB_Print(sb, "t%p\n", lua_topointer(L, -1));
-            break;
-        }
-        case LUA_TFUNCTION: {
-            SB_Print(sb, "f%p\n", lua_topointer(L, -1));
-            break;
-        }
-        case LUA_TUSERDATA: {
-            SB_Print(sb, "u%p\n", lua_touserdata(L, -1));
-            break;
-        }
-        case LUA_TLIGHTUSERDATA: {
-            SB_Print(sb, "U%p\n", lua_touserdata(L, -1));
-            break;
-        }
-        case LUA_TBOOLEAN: {
-            SB_Print(sb, "b%d\n", lua_toboolean(L, -1) ? 1 : 0);
-            break;
-        }
-        case LUA_TTHREAD: {
-            SB_Print(sb, "d%p\n", lua_topointer(L, -1));
-            break;
-        }
-        case LUA_TNIL: {
-            SB_Print(sb, "l\n");
-            break;
-        }
-    }
-}
-
-typedef struct
-{
-    lua_State * L;
-    lua_Debug * ar;
-} Args_ll;
-
-static int ll(Args_ll * args, SocketBuf * sb);
-
-/*
-** Input format:
-** ll [stack level]
-**
-** Output format:
-** OK
-** Name Value
-** Name Value
-** ...
-**
-** L stays unchanged.
-*/
-int listLocals(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
-{
-    struct lua_Debug AR;
-    int level;
-    Args_ll args;
-
-    if (argc > 0) {
-        level = strtol(argv[0], NULL, 10);
-    }
-    else {
-        level = 1;
-    }
-
-    if (--level != 0) {
-        if (!lua_getstack(L, level, &AR)) {
-            return SendErr(s, "No local variable info available at stack level %d.",
-                level + 1);
-        }
-        ar = &AR;
-    }
-    args.L = L;
-    args.ar = ar;
-    return SendOK(s, (Writer)ll, &args);
-}
-
-int ll(Args_ll * args, SocketBuf * sb)
-{
-    int i = 1;
-    const char * name;
-
-    while ((name = lua_getlocal(args->L, args->ar, i++))) {
-        if (name[0] != '(')   //(*temporary)
-            printVar(sb, name, args->L);
-        lua_pop(args->L, 1);
-    }
-    return 0;
-}
-
-static int lu(lua_State * L, SocketBuf * sb);
-
-/*
-** Input format:
-** lu [stack level]
-**
-** Output format:
-** OK
-** Name Value
-** Name Value
-** ...
-**
-** L stays unchanged.
-*/
-int listUpVars(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
-{
-    struct lua_Debug AR;
-    int level;
-    int rc;
-
-    if (argc > 0) {
-        level = strtol(argv[0], NULL, 10);
-    }
-    else {
-        level = 1;
-    }
-
-    if (--level != 0) {
-        if (!lua_getstack(L, level, &AR)) {
-            return SendErr(s, "No up variable info available at stack level %d.",
-                level + 1);
-        }
-        ar = &AR;
-    }
-
-    lua_getinfo(L, "f", ar);
-    rc = SendOK(s, (Writer)lu, L);
-    lua_pop(L, 1);
-    return rc;
-}
-
-int lu(lua_State * L, SocketBuf * sb)
-{
-    int i = 1;
-    const char * name;
-
-    while ((name = lua_getupvalue(L, -1, i++))) {
-        printVar(sb, name, L);
-        lua_pop(L, 1);
-    }
-    return 0;
-}
-
-static int lg(lua_State * L, SocketBuf * sb);
-
-/*
-** Input format:
-** lg [stack level]
-**
-** Output format:
-** OK
-** Name Value
-** Name Value
-** ...
-**
-** L stays unchanged.
-*/
-int listGlobals(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
-{
-    struct lua_Debug AR;
-    int level;
-    int rc;
-
-    if (argc > 0) {
-        level = strtol(argv[0], NULL, 10);
-    }
-    else {
-        level = 1;
-    }
-
-    if (--level != 0) {
-        if (!lua_getstack(L, level, &AR)) {
-            return SendErr(s, "No global variable info available at stack level %d.",
-                level + 1);
-        }
-        ar = &AR;
-    }
-
-    lua_getinfo(L, "f", ar);
-    lua_getfenv(L, -1);
-    assert(lua_istable(L, -1));
-    rc = SendOK(s, (Writer)lg, L);
-    lua_pop(L, 2);
-    return rc;
-}
-
-static int isID(const char * name)
-{
-    if (!(isalpha(*name) || *name == '_'))
-        return 0;
-    ++name;
-    while (isalnum(*name) || *name == '_')
-        ++name;
-    return !*name ? 1 : 0;
-}
-
-int lg(lua_State * L, SocketBuf * sb)
-{
-    lua_pushnil(L);
-    while (lua_next(L, -2)) {
-        if (lua_isstring(L, -2)) {
-            size_t len;
-            const char * name = lua_tolstring(L, -2, &len);
-            if (strlen(name) == len && isID(name))
-                printVar(sb, name, L);
-        }
-        lua_pop(L, 1);
-    }
-    return 0;
-}
-
-static int lookupVar(lua_State * L, lua_Debug * ar, int level, char scope,
-    const char * name, int nameLen);
-static int lookupField(lua_State * L, const char * field);
-static int w(lua_State * L, SocketBuf * sb);
-
-/*
-** Input format:
-** w <level> <l|u|g> <name>[fields] [r]
-** or:
-** w [fields] [r]
-**
-** in which, fields have the form like |n123.4|b0|s"hello"|s008b917a|f006c4560|...
-** Output format:
-** OK
-** Detail
-**
-** L stays unchanged.
-*/
-int watch(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
-{
-    int remember = 0;
-    char * fields = NULL;
-    int rc;
-    int top = lua_gettop(L);
-
-    if (argc >= 3) {
-        int level = strtol(argv[0], NULL, 10);
-        char scope = argv[1][0];
-        char * name = argv[2];
-        char * nameEnd = strchr(name, '|');
-        int nameLen = nameEnd ? nameEnd - name : strlen(name);
-
-        if (level < 1 || argv[1][1] != 0 || !(scope == 'l' || scope == 'u' || scope == 'g'))
-            return SendErr(s, "Invalid argument!");
-        if (!lookupVar(L, ar, level, scope, name, nameLen)) {
-            assert(lua_gettop(L) == top);
-            return SendErr(s, "Variable is not found!");
-        }
-        if (argc > 3 && !strcmp(argv[3], "r"))
-            remember = 1;
-        fields = nameEnd;
-    }
-    else {
-        if (s_cacheval_L != L || s_cacheval_ref == LUA_NOREF) {
-            assert(lua_gettop(L) == top);
-            return SendErr(s, "Variable is not found!");
-        }
-        
-        lua_rawgeti(L, LUA_REGISTRYINDEX, s_cacheval_ref);
-        if (lua_isnil(L, -1)) {
-            lua_pop(L, 1);
-            assert(lua_gettop(L) == top);
-            return SendErr(s, "Variable is not found!");
-        }
-        if (argc > 0)
-            fields = argv[0];
-        if (argc > 1 && !strcmp(argv[1], "r"))
-            remember = 1;
-    }
-
-    if (fields && !lookupField(L, fields)) {
-        lua_pop(L, 1);
-        assert(lua_gettop(L) == top);
-        return SendErr(s, "Field is not found!");
-    }
-
-    rc = SendOK(s, (Writer)w, L);
-    if (remember) {
-        if (s_cacheval_L) {
-            luaL_unref(s_cacheval_L, LUA_REGISTRYINDEX, s_cacheval_ref);
-        }
-        
-        s_cacheval_ref = luaL_ref(L, LUA_REGISTRYINDEX);
-        s_cacheval_L = L;
-        
-        if (fields)
-            lua_pop(L, 1);
-    }
-    else {
-        lua_pop(L, fields ? 2 : 1);
-    }
-
-    assert(lua_gettop(L) == top);
-    return rc;
-}
-
-/*
-** Look up a lua variable with specified stack level, scope and name.
-** Return 1 when found and push it on top of L; otherwise 0 is returned and
-** L stays unchanged.
-*/
-int lookupVar(lua_State * L, lua_Debug * ar, int level, char scope, const char * name, int nameLen)
-{
-    lua_Debug AR;
-    int found = 0;
-
-    if (level != 1) {
-        if (!lua_getstack(L, level - 1, &AR))
-            return 0;
-        ar = &AR;
-    }
-
-    if (scope == 'l') {
-        int i = 1;
-        const char * p;
-
-        lua_pushnil(L); //place holder
-        while ((p = lua_getlocal(L, ar, i++))) {
-            if (nameLen == strlen(p) && !strncmp(p, name, nameLen)) {
-                found = 1;
-                lua_replace(L, -2); //The same name may have multi values(though it's odd!), use the last!
-            }
-            else {
-                lua_pop(L, 1);
-            }
-        }
-        if (!found)
-            lua_pop(L, 1);
-    }
-    else if (scope == 'u') {
-        int i = 1;
-        const char * p;
-
-        lua_getinfo(L, "f", ar);
-        while ((p = lua_getupvalue(L, -1, i++))) {
-            if (nameLen == strlen(p) && !strncmp(p, name, nameLen)) {
-                found = 1;
-                break;
-            }
-            else {
-                lua_pop(L, 1);
-            }
-        }
-        lua_remove(L, found ? -2 : -1);
-    }
-    else {
-        lua_getinfo(L, "f", ar);
-        lua_getfenv(L, -1);
-        assert(lua_istable(L, -1));
-        lua_pushlstring(L, name, nameLen);
-        lua_gettable(L, -2);
-        if (lua_isnil(L, -1)) {
-            lua_pop(L, 3);
-        }
-        else {
-            found = 1;
-            lua_replace(L, -3);
-            lua_pop(L, 1);
-        }
-    }
-
-    return found;
-}
-
-static int nextField(const char * fields, const char ** begin, const char ** end)
-{
-    assert(fields);
-    if (*fields++ != '|' || !*fields)
-        return 0;
-
-    *begin = fields;
-    if (fields[0] == 's' && fields[1] == '\'') {
-        while (1) {
-            const char * p = strchr(fields + 2, '\'');
-            if (!p)
-                return 0;
-            ++p;
-            if (*p != '|' && *p != 0)
-                return 0;
-            *end = p;
-            break;
-        }
-    }
-    else {
-        const char * p = strchr(fields + 1, '|');
-        *end = p ? p : fields + strlen(fields);
-    }
-    return 1;
-}
-
-/*
-** Get a table field by comparing its value's pointer and type with the specified
-** one.
-** Return 1 and push the value on top of L when success; otherwise return 0 and
-** push nothing.
-*/
-static int getFieldValueByPtr(lua_State * L, void * ptr, int type)
-{
-    lua_pushnil(L);
-    while (lua_next(L, -2)) {
-        int t = lua_type(L, -1);
-
-        if (t == LUA_TTABLE || t == LUA_TFUNCTION || t == LUA_TTHREAD) {
-            if (lua_topointer(L, -1) == ptr) {
-                lua_remove(L, -2);
-                return 1;
-            }
-        }
-        else if (t == LUA_TUSERDATA || t == LUA_TLIGHTUSERDATA) {
-            if (lua_touserdata(L, -1) == ptr) {
-                lua_remove(L, -2);
-                return 1;
-            }
-        }
-        else if (t == LUA_TSTRING) {
-            if (lua_tostring(L, -1) == ptr) {
-                lua_remove(L, -2);
-                return 1;
-            }
-        }
-
-        lua_pop(L, 1);
-    }
-    return 0;
-}
-
-/*
-** Get a table field. Return 1 and push the field value on top of L; otherwise
-** return 0 and push nothing.
-** The table is on top of L. The field is sth. like "n123.456", "f008bae20", etc.
-*/
-static int getFieldValue(lua_State * L, const char * fieldBegin, const char * fieldEnd)
-{
-    char * end;
-
-    if (*fieldBegin == 'n') {
-        double num = strtod(fieldBegin + 1, &end);
-        if (end != fieldEnd)
-            return 0;
-        lua_pushnumber(L, num);
-        lua_gettable(L, -2);
-    }
-    else if (*fieldBegin == 's' && fieldBegin[1] == '\'') {
-        const char * str = fieldBegin + 2;
-        assert(*(fieldEnd - 1) == '\'');
-        lua_pushlstring(L, str, fieldEnd - str - 1);
-        lua_gettable(L, -2);
-    }
-    else if (*fieldBegin == 'b') {
-        int n = strtol(fieldBegin + 1, &end, 0);
-        if (end != fieldEnd)
-            return 0;
-        lua_pushboolean(L, n);
-        lua_gettable(L, -2);
-    }
-    else if (*fieldBegin == 'U') {
-        void *ptr = (void *)strtoull(fieldBegin + 1, &end, 0);
-        if (end != fieldEnd)
-            return 0;
-        lua_pushlightuserdata(L, ptr);
-        lua_gettable(L, -2);
-    }
-    else {
-        void *ptr;
-        int t;
-
-        switch (*fieldBegin) {
-            case 't':
-                t = LUA_TTABLE;
-                break;
-            case 'u':
-                t = LUA_TTABLE;
-                break;
-            case 'f':
-                t = LUA_TTABLE;
-                break;
-            case 'd':
-                t = LUA_TTABLE;
-                break;
-            default:
-                return 0;
-        }
-
-        ptr = (void *)strtoull(fieldBegin + 1, &end, 0);
-        if (end != fieldEnd)
-            return 0;
-        return getFieldValueByPtr(L, (void *)ptr, t);
-    }
-    return 1;
-}
-
-/*
-** Look up a field in a lua value on top of L. If the field is found, it's pushed
-** on top of L and 1 is returned; otherwise nothing is pushed and 0 is returned.
-** field is a descriptive string like '|n123|s"something"|f0088abe8|...'.
-** Specially, "|" is a field representing the value itself. And particularly,
-** "|m" is a legal field denoting the metatable. So surprisingly, any Lua value
-** , not limited to table, can have subfields, because according to offical Lua
-** document, "Every value in Lua may have a metatable". For example, consider
-** "a = 123", then for variable a, 'a|m|s"__add"' is legal.
-*/
-int lookupField(lua_State * L, const char * field)
-{
-    const char * subfieldBegin;
-    const char * subfieldEnd;
-
-    assert(field && *field);
-
-    lua_pushvalue(L, -1);
-    while (*field && nextField(field, &subfieldBegin, &subfieldEnd)) {
-        if (*subfieldBegin == 'm') {
-            if (!lua_getmetatable(L, -1))
-                break;
-        }
-        else {
-            if (!lua_istable(L, -1))
-                break;
-            if (!getFieldValue(L, subfieldBegin, subfieldEnd))
-                break;
-        }
-        lua_replace(L, -2);
-        field = subfieldEnd;
-    }
-
-    if (field[0] && !(field[0] == '|' && field[1] == 0)) {
-        lua_pop(L, 1);
-        return 0;
-    }
-    return 1;
-}
-
-int w(lua_State * L, SocketBuf * sb)
-{
-    int t = lua_type(L, -1);
-    int meta;
-    if (t != LUA_TNIL && (meta = lua_getmetatable(L, -1)))
-        lua_pop(L, 1);
-    printVar(sb, NULL, L);
-
-    switch (t) {
-        case LUA_TTABLE: {
-            SB_Print(sb, "%d\n", meta ? 1 : 0);
-            lua_pushnil(L);
-            while (lua_next(L, -2)) {
-                lua_pushvalue(L, -2);
-                printVar(sb, NULL, L);
-                lua_pop(L, 1);
-                printVar(sb, NULL, L);
-                lua_pop(L, 1);
-            }
-            break;
-        }
-        case LUA_TUSERDATA: {
-            int size = lua_objlen(L, -1);
-            SB_Print(sb, "%d\n%d\n", meta ? 1 : 0, size);
-            break;
-        }
-        case LUA_TFUNCTION: {
-            lua_Debug ar;
-            lua_pushvalue(L, -1);
-            lua_getinfo(L, ">S", &ar);
-            SB_Print(sb, "%d\n%s\n%s\n%d\n%d\n", meta ? 1 : 0, ar.what,
-                ar.short_src, ar.linedefined, ar.lastlinedefined);
-            break;
-        }
-        case LUA_TNUMBER: {
-            SB_Print(sb, "%d\n", meta ? 1 : 0);
-            break;
-        }
-        case LUA_TSTRING: {
-            SB_Print(sb, "%d\n", meta ? 1 : 0);
-            break;
-        }
-        case LUA_TBOOLEAN: {
-            SB_Print(sb, "%d\n", meta ? 1 : 0);
-            break;
-        }
-        case LUA_TLIGHTUSERDATA: {
-            SB_Print(sb, "%d\n", meta ? 1 : 0);
-            break;
-        }
-        case LUA_TTHREAD: {
-            int status = lua_status(lua_tothread(L, -1));
-            SB_Print(sb, "%d\n%d\n", meta ? 1 : 0, status);
-            break;
-        }
-    }
-    return 0;
-}
-
-static int ps(lua_State * L, SocketBuf * sb);
-
-/*
-** Input format:
-** ps
-**
-** Output format:
-** OK
-** File
-** Line Number
-** Function Name
-** Name What
-** File
-** Line Number
-** Function Name
-** Name What
-** ...
-**
-** L stays unchanged.
-*/
-int printStack(lua_State * L, SOCKET s)
-{
-    return SendOK(s, (Writer)ps, L);
-}
-
-int ps(lua_State * L, SocketBuf * sb)
-{
-    struct lua_Debug ar;
-    int i = 0;
-
-    while (lua_getstack(L, i, &ar)) {
-        lua_getinfo(L, "nSl", &ar);
-        SB_Print(sb, "%s\n%d\n%s\n%s\n", ar.short_src, ar.currentline,
-            ar.name ? ar.name : "[N/A]", *ar.what ? ar.what : "[N/A]");
-        i++;
-    }
-    return 0;
-}
-
-/*
-** Input format:
-** sb <File> <Line>
-**
-** Output format:
-** OK
-**
-*/
-int setBreakPoint(lua_State * L, const char * src, char * argv[], int argc, SOCKET s)
-{
-    int line;
-    const char * file;
-    char path[_MAX_PATH + 1];
-    struct hlist_node *pos, *next;
-    int found = 0;
-    
-    if (argc < 2 || (line = strtol(argv[1], NULL, 10)) <= 0) {
-        return SendErr(s, "Invalid argument!");
-    }
-
-    if (line >= MAX_LINENO) {
-        return SendErr(s, "Invalid line number!");
-    }
-    
-    if (!strcmp(argv[0], "."))
-        file = src;
-    else
-        file = argv[0];
-
-    getFileName(path, file, _MAX_PATH);
-
-#ifdef OS_WIN
-    _strlwr(path);
-#endif
-
-    hlist_for_each_safe(pos, next, &s_breaks[line]) {
-        BRK *b = hlist_entry(pos, BRK, hlist);
-        if (!strcmp(path, b->file)) {
-            found = 1;
-            break;
-        }
-    }
-    
-    if (!found) {
-        BRK *b = BRKNew(path, line);
-        if (!b)
-            return SendErr(s, "Out of memory!");
-        
-        hlist_add_head(&b->hlist, &s_breaks[line]);
-    }
-    
-    return SendOK(s, NULL, NULL);
-}
-
-/*
-** Input format:
-** db <index>
-** en <index>
-** dis <index>
-**
-** Output format:
-** OK
-**
-*/
-int oprBreakPoint(lua_State * L, const char * opr, char * argv[], int argc, SOCKET s)
-{
-    int idx;
-    BRK *targetB = NULL;
-    int i = 1;
-    struct list_head *pos;
-    
-    if (argc < 1 || (idx = strtol(argv[0], NULL, 10)) <= 0) {
-        return SendErr(s, "Invalid argument!");
-    }
-    
-    list_for_each(pos, &s_break_head) {
-        BRK *b = list_entry(pos, BRK, list);
-        if (i == idx) {
-            targetB = b;
-            break;
-        }
-        ++i;
-    }
-    
-    if (!targetB)
-        return SendErr(s, "Breakpoint not found!");
-    
-    if (!strcmp(opr, "db")) {
-        BRKFree(targetB);
-    } else if (!strcmp(opr, "en")) {
-        targetB->enable = 1;
-    } else if (!strcmp(opr, "dis")) {
-        targetB->enable = 0;
-    } else {
-        assert(0);
-    }
-    
-     return SendOK(s, NULL, NULL);
-}
-
-static int lb(lua_State * L, SocketBuf * sb);
-
-/*
-** Input format:
-** lb
-**
-** Output format:
-** OK
-** File
-** Line Number
-** File
-** Line Number
-** ...
-**
-*/
-int listBreakPoints(lua_State * L, SOCKET s)
-{
-    return SendOK(s, (Writer)lb, L);
-}
-
-int lb(lua_State * L, SocketBuf * sb)
-{
-    int i = 1;
-    struct list_head *pos;
-    list_for_each(pos, &s_break_head) {
-        BRK *b = list_entry(pos, BRK, list);
-        SB_Print(sb, "%d\n%s\n%d\n%d\n", i, b->file, b->lineno, b->enable);
-        ++i;
-    }
-    
-    return 0;
-}
-
-/*
-** L stays unchanged.
-*/
-int exec(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
-{
-    return -2;
-}
-
-/*
-** Input format:
-** m <addr> <len>
-**
-** Output format:
-** OK
-** content
-**
-** Warning:
-** This function may read an unreadable address and cause a hard/OS exception!
-*/
-int watchMemory(char * argv[], int argc, SOCKET s)
-{
-    void * addr;
-    unsigned int len;
-    SocketBuf sb;
-
-    if (argc < 2 || (addr = (void *)strtoull(argv[0], NULL, 0)) == 0
-        || (len = strtoull(argv[1], NULL, 0)) <= 0
-        || (unsigned long)((unsigned long)addr + len) < (unsigned long)addr) //overflow!
-    {
-        return SendErr(s, "Invalid argument!");
-    }
-
-    SB_Init(&sb, s);
-    SB_Print(&sb, "OK\n%08x\n", len);
-    SB_Add(&sb, addr, len);
-    return SB_Send(&sb);
-}
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+* Modification work Copyright (C) 2016 Wen Xichang.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <string.h>
+#include <assert.h>
+#include <signal.h>
+#include <time.h>
+
+#include "list.h"
+
+#ifdef OS_WIN
+#include <io.h>     //access
+#define strtoull _strtoui64
+#endif
+
+#ifdef OS_LINUX
+#include <unistd.h> //access, getcwd
+#include <fcntl.h>
+#include <stddef.h> //offsetof
+#include <sys/un.h>
+#ifdef LDB_PRELOAD
+#include <dlfcn.h>  //dlsym
+#endif
+#define _MAX_PATH PATH_MAX
+
+static char * _fullpath(char * absPath, const char * relPath, size_t maxLen)
+{
+    char * ret = 0;
+    assert(absPath && relPath && maxLen > 1);
+    if (*relPath == '/') {
+        size_t len = strlen(relPath);
+        if (len <= maxLen - 1) {
+            strcpy(absPath, relPath);
+            ret = absPath;
+        }
+    }
+    else {
+        ret = getcwd(absPath, maxLen);
+        if (ret) {
+            size_t len = strlen(absPath);
+            size_t rlen = strlen(relPath);
+            if (absPath[len - 1] != '/' && len < maxLen && rlen) {
+                absPath[len++] = '/';
+            }
+            if (len + rlen < maxLen) {
+                strcpy(absPath + len, relPath);
+                ret = absPath;
+            }
+        }
+    }
+    return ret;
+}
+
+#endif
+
+#include "Protocol.h"
+#include "Thread.h"
+#include "lldb.h"
+
+typedef enum
+{
+    STEP = 1,
+    NEXT,
+    STEP_OUT,
+    FINISH,
+    RUN
+} CMD;
+
+//Multiple states, may use in embeded program
+#define MAX_STATE       1024
+#define MAX_LINENO      65536
+
+//Hope this level is enough for lua calls :-)
+#define INIT_LEVEL      100000000
+
+//Debug info of a registered lua_State, shared with its coroutines
+typedef struct DbgState
+{
+    lua_State *L;
+    const void *G;              //Registry of L, the same for all its coroutines
+    CMD cmd;
+    int level;
+    int blevel;
+    int paused;                 //Waiting in prompt for the controller
+    char file[LUA_IDSIZE];      //Where it's paused
+    int line;
+} DbgState;
+
+static DbgState s_states[MAX_STATE];
+static int s_nstate;
+
+//The state last seen by hook on this thread
+static THREAD_LOCAL DbgState *s_cur;
+
+//Debugger remote socket
+static SOCKET s_dbg_sock = INVALID_SOCKET;
+static int s_signaled = 0;
+
+//Non-stop mode: only the state hitting a break pauses, the others keep running
+static int s_nonstop;
+
+//Forked from a debugged process, connect to the debugger on the next break
+static int s_follow;
+
+//Control socket created by lldb_control_fd
+static int s_ctl_fd = -1;
+
+//Cached getpid(), refreshed in a forked child
+static int s_pid;
+
+#ifndef OS_WIN
+//Unix socket of the controller, LDB_SOCK or "@lldb_<pid>"(kept by forked children)
+static char s_sock_path[108];
+static int s_sock_only;
+#endif
+
+/*
+** Names of a chunk resolved at break, cached by the source string(interned by
+** lua). A freed source may be reused by another chunk, so short_src must match
+** too. Guarded by s_lock.
+*/
+typedef struct SRCINFO
+{
+    const char *source;
+    char short_src[LUA_IDSIZE];
+    char name[LUA_IDSIZE];
+    char path[_MAX_PATH + 1];
+} SRCINFO;
+
+#define MAX_SRCINFO 16
+static SRCINFO s_srcinfos[MAX_SRCINFO];
+
+/*
+** s_lock guards the session(socket, owner and paused states) and breakpoints.
+** Only the owner talks to the controller, other paused states wait on s_cond
+** for their turn.
+*/
+static MUTEX s_lock;
+static COND s_cond;
+static DbgState *s_owner;
+
+//For cache value
+static int s_cacheval_ref = LUA_NOREF;
+static lua_State *s_cacheval_L = NULL;
+
+//Where the last page of a table watched stops, the next page goes on from
+//its last key. Only good while paused, see resetCursor.
+static lua_State *s_cursor_L = NULL;
+static int s_cursor_t = LUA_NOREF;
+static int s_cursor_k = LUA_NOREF;
+static int s_cursor_off;
+
+//Values shown while paused get handles, w #n goes to the nth directly. The
+//table maps handles to values and values back to their handles. Only good while
+//paused, see resetHandles.
+static lua_State *s_handles_L = NULL;
+static int s_handles = LUA_NOREF;
+static int s_nhandle;
+
+//Fingerprints of the variables ll or lu sent last in delta mode, by position,
+//so a next stop in the same frame sends just the ones changed. See printDelta.
+typedef struct FPRINT
+{
+    lua_State * L;
+    const void * func;      //The frame: its function and the levels below it
+    int depth;
+    int n;
+    int cap;
+    unsigned long long * fp;
+} FPRINT;
+
+static FPRINT s_fp_ll;
+static FPRINT s_fp_lu;
+
+//At most limit pauses every period seconds
+typedef struct RATE
+{
+    int limit;
+    int period;
+    time_t start;
+    int count;
+} RATE;
+
+//Breakpoints
+typedef struct BRK
+{
+    struct hlist_node hlist;
+    struct list_head list;
+    char *file;
+    int lineno;
+    int enable;
+    RATE rate;                  //limit N/T
+    unsigned int sample;        //sample K, pauses once in K hits
+    unsigned long hits;
+    unsigned long skips;        //Hits dropped by rate, sample or s_budget
+} BRK;
+
+//Pauses allowed for all breakpoints(pb N/T)
+static RATE s_budget;
+
+//xorshift32 state for sampled breakpoints
+static unsigned int s_rand = 2463534242u;
+
+//Breakpoints seq, hashed
+static struct hlist_head s_breaks[MAX_LINENO];
+
+//Number of breakpoints of each line, read without the lock by checkBreakPoint
+static int s_nbreaks[MAX_LINENO];
+
+//Breakpoints ordered
+static LIST_HEAD(s_break_head);
+
+static BRK *BRKNew(const char *path, int lineno)
+{
+    BRK *b = calloc(1, sizeof(BRK));
+    if (!b)
+        return NULL;
+    
+    b->file = strdup(path);
+    if (!b->file) {
+        free(b);
+        return NULL;
+    }
+    b->lineno = lineno;
+    b->enable = 1;
+    
+    list_add_tail(&b->list, &s_break_head);
+    return b;
+}
+
+static void BRKFree(BRK *b)
+{
+    ATOMIC_STORE(&s_nbreaks[b->lineno], s_nbreaks[b->lineno] - 1);
+    hlist_del(&b->hlist);
+    list_del(&b->list);
+    
+    free(b->file);
+    free(b);
+}
+
+static void getFileName(char * out, const char * file, size_t outLen)
+{
+    const char * p = strrchr(file, '/');
+    if (p) {
+        ++p;
+    }
+    else {
+        p = strrchr(file, '\\');
+        if (p) {
+            ++p;
+        }
+        else {
+            p = file;
+        }
+    }
+
+    strncpy(out, p, outLen);
+    out[outLen - 1] = 0;
+}
+
+static void hook(lua_State *L, lua_Debug *ar);
+
+static void onGC(void)
+{
+    if (s_dbg_sock != INVALID_SOCKET) {
+        SendQuit(s_dbg_sock);
+        closesocket(s_dbg_sock);
+        s_dbg_sock = INVALID_SOCKET;
+    }
+}
+
+static SOCKET tryConnectToDebugger(void)
+{
+    unsigned short port = 2679;
+    char * p;
+
+#ifndef OS_WIN
+    //Same host, LDB_SOCK or lldbg --unix
+    SOCKET s = ConnectUnix(s_sock_path);
+    if (s != INVALID_SOCKET || s_sock_only)
+        return s;
+#endif
+
+    //read config and set up connection with a remote controller
+    p = getenv("LDB_PORT");
+    if (p && atoi(p)) {    //REMOTE_LDB's value is sth. like "192.168.0.1:6688".
+        port = atoi(p);
+    }
+    
+    return Connect("127.0.0.1", port);
+}
+
+static void rldbSignaled(int sig)
+{
+    int i;
+    
+    for (i = 0; i < s_nstate; ++i) {
+        if (s_states[i].L)
+            lua_sethook(s_states[i].L, hook, LUA_MASKLINE | LUA_MASKCALL | LUA_MASKRET, 0);
+    }
+
+    s_signaled = 1;
+}
+
+#ifdef OS_LINUX
+/*
+** The child inherits the parent's socket, states and breakpoints. Drop the
+** socket silently(the parent still owns the session), and let every state run
+** until a breakpoint, which opens a session of the child's own.
+*/
+static void onForkChild(void)
+{
+    int i;
+
+    MUTEX_INIT(&s_lock);
+    COND_INIT(&s_cond);
+    s_owner = NULL;
+    s_cur = NULL;
+    s_pid = getpid();
+
+    if (s_dbg_sock != INVALID_SOCKET) {
+        closesocket(s_dbg_sock);
+        s_dbg_sock = INVALID_SOCKET;
+        s_follow = 1;
+    }
+    SB_DetachRing();
+    SB_UseLZ(INVALID_SOCKET, 0);
+
+    for (i = 0; i < s_nstate; ++i) {
+        s_states[i].paused = 0;
+        s_states[i].cmd = RUN;
+        s_states[i].blevel = 0;
+    }
+}
+#endif
+
+#ifdef OS_WIN
+static DWORD WINAPI waitSig(LPVOID lpParam)
+{
+    char name[128];
+    HANDLE notify;
+
+    sprintf(name, "Global\\lldb_sigevent_%d", GetCurrentProcessId());
+
+    notify = CreateEventA(NULL, FALSE, FALSE, name);
+    if (!notify)
+        return -1;
+
+    while (1) {
+        if (WaitForSingleObject(notify, INFINITE) == WAIT_OBJECT_0) {
+            rldbSignaled(0);
+        }
+    }
+}
+#endif
+
+/*
+** Find the debug info of L, which may be a coroutine of a registered state.
+** The state last found on this thread is checked without the lock, its G is
+** published last by registerState and cleared by unregisterState before L.
+** Return NULL if L is not registered.
+*/
+static DbgState *findState(lua_State * L)
+{
+    DbgState *st = s_cur;
+    const void *G = lua_topointer(L, LUA_REGISTRYINDEX);
+    int i;
+
+    if (st && ATOMIC_LOAD_PTR(&st->G) == G)
+        return st;
+
+    st = NULL;
+    MUTEX_LOCK(&s_lock);
+    for (i = 0; i < s_nstate; ++i) {
+        if (s_states[i].G == G) {
+            st = &s_states[i];
+            break;
+        }
+    }
+    MUTEX_UNLOCK(&s_lock);
+
+    s_cur = st;
+    return st;
+}
+
+/*
+** Add L to the registered states. Must be called with s_lock held.
+*/
+static void registerState(lua_State * L)
+{
+    DbgState *st = NULL;
+    int nactive = 0;
+    int i;
+
+    for (i = 0; i < s_nstate; ++i) {
+        if (s_states[i].L == L)
+            return;
+        if (s_states[i].L)
+            nactive++;
+        else if (!st)
+            st = &s_states[i];
+    }
+
+    //Reuse a slot of a closed state first
+    if (!st) {
+        if (s_nstate >= MAX_STATE) {
+            fprintf(stderr, "Max lua state reached: %d\n", s_nstate);
+            return;
+        }
+        st = &s_states[s_nstate++];
+    }
+
+    //A slot reused may still be checked by findState, G goes last
+    st->L = L;
+    st->level = INIT_LEVEL;
+    st->blevel = 0;
+    st->paused = 0;
+    st->file[0] = 0;
+    st->line = 0;
+    //In non-stop mode, only the first state breaks at startup
+    st->cmd = (s_nonstop && nactive > 0) ? RUN : STEP;
+    ATOMIC_STORE_PTR(&st->G, lua_topointer(L, LUA_REGISTRYINDEX));
+
+    //Debugger present, break immediately
+    if (s_dbg_sock != INVALID_SOCKET)
+        lua_sethook(L, hook, LUA_MASKLINE | LUA_MASKCALL | LUA_MASKRET, 0);
+}
+
+/*
+** Set up the debugger for the process, once. States may be created on several
+** threads at a time(LD_PRELOAD).
+*/
+static void setupDebugger(void)
+{
+    const char *nonstop = getenv("LDB_NONSTOP");
+
+    MUTEX_INIT(&s_lock);
+    COND_INIT(&s_cond);
+    s_nonstop = nonstop && *nonstop == '1';
+    s_rand ^= (unsigned int)time(NULL);
+#ifdef OS_WIN
+    s_pid = GetCurrentProcessId();
+    CreateThread(NULL, 0, waitSig, NULL, 0, NULL);
+#else
+    s_pid = getpid();
+    const char *sock = getenv("LDB_SOCK");
+    if (sock && *sock && strcmp(sock, "@")) {
+        strncpy(s_sock_path, sock, sizeof(s_sock_path) - 1);
+        s_sock_only = 1;
+    }
+    else {
+        sprintf(s_sock_path, "@lldb_%d", s_pid);
+    }
+    const char *sig = getenv("LDB_SIG");
+    if (sig && atoi(sig)) {
+        signal(atoi(sig), rldbSignaled);
+    } else {
+        signal(SIGUSR2, rldbSignaled);
+    }
+    pthread_atfork(NULL, NULL, onForkChild);
+#endif
+    if (getenv("LDB_STARTUP") && *getenv("LDB_STARTUP") == '1') {
+        s_dbg_sock = tryConnectToDebugger();
+    }
+    
+    atexit(onGC);
+}
+
+static void initDebugger(void)
+{
+    static ONCE once = ONCE_INIT;
+    
+    CALL_ONCE(&once, setupDebugger);
+}
+
+#ifdef OS_WIN
+__declspec(dllexport)
+#endif
+int luaopen_lldb(lua_State * L)
+{
+    lldb_register_state(L);
+    lua_pushboolean(L, 1);
+    return 1;
+}
+
+#ifdef OS_WIN
+__declspec(dllexport)
+#endif
+int lldb_register_state(lua_State * L)
+{
+    initDebugger();
+    
+    MUTEX_LOCK(&s_lock);
+    registerState(L);
+    MUTEX_UNLOCK(&s_lock);
+    return 0;
+}
+    
+#ifdef OS_WIN
+__declspec(dllexport)
+int lldb_control_fd(void)
+{
+    return -1;
+}
+
+__declspec(dllexport)
+int lldb_poll(void)
+{
+    return 0;
+}
+
+#else
+/*
+** Abstract unix socket "\0lldb_ctl_<pid>", lldbg connects to it to ask for an
+** attach. Nothing is done until the host calls lldb_poll.
+*/
+int lldb_control_fd(void)
+{
+    struct sockaddr_un addr;
+    socklen_t len;
+    const char *sig = getenv("LDB_SIG");
+    int fd;
+
+    if (s_ctl_fd >= 0)
+        return s_ctl_fd;
+
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd < 0)
+        return -1;
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    len = offsetof(struct sockaddr_un, sun_path) + 1
+        + sprintf(addr.sun_path + 1, "lldb_ctl_%d", (int)getpid());
+
+    if (bind(fd, (struct sockaddr *)&addr, len) < 0 || listen(fd, 8) < 0) {
+        close(fd);
+        return -1;
+    }
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+    fcntl(fd, F_SETFD, FD_CLOEXEC);
+
+    //Attach by lldb_poll only, hooks are never set in a signal handler
+    signal(sig && atoi(sig) ? atoi(sig) : SIGUSR2, SIG_IGN);
+    s_ctl_fd = fd;
+    return fd;
+}
+
+int lldb_poll(void)
+{
+    int req = 0;
+    int fd;
+
+    if (s_ctl_fd < 0)
+        return 0;
+
+    while ((fd = accept(s_ctl_fd, NULL, NULL)) >= 0) {
+        close(fd);
+        req = 1;
+    }
+
+    //Same as the signal: attach, or break into a session going on(ctrl+c)
+    if (req) {
+        MUTEX_LOCK(&s_lock);
+        rldbSignaled(0);
+        MUTEX_UNLOCK(&s_lock);
+    }
+    return req;
+}
+#endif
+
+#if defined(LDB_PRELOAD) && defined(OS_LINUX)
+/*
+** Preload build(make preload): lldb_preload.so is loaded with LD_PRELOAD in
+** front of a shared lua library, states are registered while created and
+** freed while closed, no require "lldb" needed.
+*/
+
+/*
+** L is being closed, free its slot. Call with s_lock held.
+*/
+static void unregisterState(lua_State * L)
+{
+    int i;
+
+    for (i = 0; i < s_nstate; ++i) {
+        DbgState *st = &s_states[i];
+        if (st->L != L)
+            continue;
+
+        if (s_cur == st)
+            s_cur = NULL;
+        if (s_cacheval_L && lua_topointer(s_cacheval_L, LUA_REGISTRYINDEX) == st->G) {
+            s_cacheval_L = NULL;
+            s_cacheval_ref = LUA_NOREF;
+        }
+        ATOMIC_STORE_PTR(&st->G, NULL);
+        st->L = NULL;
+        st->paused = 0;
+        return;
+    }
+}
+
+static void *realFunc(const char * name)
+{
+    void *f = dlsym(RTLD_NEXT, name);
+    if (!f)
+        fprintf(stderr, "lldb: %s not found\n", name);
+    return f;
+}
+
+lua_State *lua_newstate(lua_Alloc f, void * ud)
+{
+    static lua_State *(*real)(lua_Alloc, void *);
+    lua_State *L;
+
+    if (!real && !(real = (lua_State *(*)(lua_Alloc, void *))realFunc("lua_newstate")))
+        return NULL;
+
+    L = real(f, ud);
+    if (L) {
+        initDebugger();
+        MUTEX_LOCK(&s_lock);
+        registerState(L);
+        MUTEX_UNLOCK(&s_lock);
+    }
+    return L;
+}
+
+/*
+** luaL_newstate may not reach lua_newstate through the PLT(and never does in
+** luajit), register here too, registerState ignores a known state.
+*/
+lua_State *luaL_newstate(void)
+{
+    static lua_State *(*real)(void);
+    lua_State *L;
+
+    if (!real && !(real = (lua_State *(*)(void))realFunc("luaL_newstate")))
+        return NULL;
+
+    L = real();
+    if (L) {
+        initDebugger();
+        MUTEX_LOCK(&s_lock);
+        registerState(L);
+        MUTEX_UNLOCK(&s_lock);
+    }
+    return L;
+}
+
+void lua_close(lua_State * L)
+{
+    static void (*real)(lua_State *);
+
+    if (!real && !(real = (void (*)(lua_State *))realFunc("lua_close")))
+        return;
+
+    MUTEX_LOCK(&s_lock);
+    unregisterState(L);
+    MUTEX_UNLOCK(&s_lock);
+    real(L);
+}
+#endif
+
+static int prompt(DbgState * st, lua_State *L, lua_Debug * ar);
+static int checkBreakPoint(DbgState * st, lua_State *L, lua_Debug * ar);
+
+static void clearhooks(void)
+{
+    int i;
+    for (i = 0; i < s_nstate; ++i) {
+        if (s_states[i].L)
+            lua_sethook(s_states[i].L, hook, 0, 0);
+    }
+    
+    //Clear cache value
+    if (s_cacheval_L) {
+        luaL_unref(s_cacheval_L, LUA_REGISTRYINDEX, s_cacheval_ref);
+        s_cacheval_L = NULL;
+        s_cacheval_ref = LUA_NOREF;
+    }
+    
+    //Clear breakpoints
+    for (i = 0; i < MAX_LINENO; ++i) {
+        struct hlist_node *pos, *next;
+        
+        hlist_for_each_safe(pos, next, &s_breaks[i]) {
+            BRK *b = hlist_entry(pos, BRK, hlist);
+            BRKFree(b);
+        }
+    }
+}
+
+/*
+** Stop debugging without informing the remote Controller, and wake up the
+** states waiting for their turn. Must be called with s_lock held.
+*/
+static void closeSession(void)
+{
+    clearhooks();
+    if (s_dbg_sock != INVALID_SOCKET) {
+        closesocket(s_dbg_sock);
+        s_dbg_sock = INVALID_SOCKET;
+    }
+#ifdef OS_LINUX
+    SB_DetachRing();
+#endif
+    SB_UseLZ(INVALID_SOCKET, 0);
+    s_owner = NULL;
+    COND_BROADCAST(&s_cond);
+}
+
+/*
+** Set the resume command of st. In all-stop mode the other states follow: they
+** step too when st steps, or run until a breakpoint otherwise.
+*/
+static void setCmd(DbgState * st, CMD cmd)
+{
+    int i;
+
+    st->cmd = cmd;
+    if (s_nonstop)
+        return;
+
+    for (i = 0; i < s_nstate; ++i) {
+        DbgState *o = &s_states[i];
+        if (o != st && o->L) {
+            o->cmd = cmd == STEP ? STEP : RUN;
+            o->blevel = 0;
+        }
+    }
+}
+
+void hook(lua_State * L, lua_Debug * ar)
+{
+    int event = ar->event;
+    int top = lua_gettop(L);
+    DbgState *st = findState(L);
+
+    if (!st)
+        return;
+    
+    lua_getinfo(L, "nSl", ar);
+    
+    if (ar->currentline < 0)
+        return;
+    
+    //Connect to debugger when signaled
+    if (s_signaled) {
+        MUTEX_LOCK(&s_lock);
+        if (s_signaled) {
+            s_signaled = 0;
+            if (s_dbg_sock == INVALID_SOCKET) {
+                s_dbg_sock = tryConnectToDebugger();
+                if (s_dbg_sock == INVALID_SOCKET) {
+                    clearhooks();
+                    MUTEX_UNLOCK(&s_lock);
+                    return;
+                }
+            }
+            //Connect success, break in current line and wait debugger's cmd
+            setCmd(st, STEP);
+        }
+        MUTEX_UNLOCK(&s_lock);
+    }
+
+    if (event == LUA_HOOKLINE) {
+        int rc = 0;
+
+        if (st->cmd == STEP) {
+            rc = prompt(st, L, ar);
+        }
+        else if (st->cmd == NEXT) {
+            if (st->blevel && st->level <= st->blevel)
+                rc = prompt(st, L, ar);
+            else
+                rc = checkBreakPoint(st, L, ar);
+        }
+        else if (st->cmd == STEP_OUT) {
+            if (st->blevel && st->level < st->blevel)
+                rc = prompt(st, L, ar);
+            else
+                rc = checkBreakPoint(st, L, ar);
+        }
+        else if (st->cmd == FINISH) {
+            //prompt(L, ar);
+        }
+        else if (st->cmd == RUN) {
+            rc = checkBreakPoint(st, L, ar);
+        }
+
+        //If a socket IO error or a protocol error happened, stop debugging
+        //without informing the remote Controller.
+        if (rc < 0) {
+            MUTEX_LOCK(&s_lock);
+            closeSession();
+            MUTEX_UNLOCK(&s_lock);
+        }
+    }
+    else {
+        assert(event != LUA_HOOKCOUNT);
+
+        if (event == LUA_HOOKCALL) {
+            st->level++;
+        }
+        else if (event == LUA_HOOKRET || event == LUA_HOOKTAILRET) {
+            st->level--;
+        }
+    }
+    assert(top == lua_gettop(L));
+}
+
+/*
+** Start a new window when the current one is over, tell if it's used up.
+*/
+static int rateFull(RATE * r, time_t now)
+{
+    if (now - r->start >= r->period) {
+        r->start = now;
+        r->count = 0;
+    }
+    return r->count >= r->limit;
+}
+
+/*
+** Count a hit of b and decide if it pauses, so a breakpoint on a hot line
+** never floods the controller. Call with s_lock held.
+*/
+static int takeHit(BRK * b)
+{
+    time_t now = 0;
+
+    b->hits++;
+    if (b->sample > 1) {
+        s_rand ^= s_rand << 13;
+        s_rand ^= s_rand >> 17;
+        s_rand ^= s_rand << 5;
+        if (s_rand % b->sample)
+            goto skip;
+    }
+
+    if (b->rate.limit || s_budget.limit)
+        now = time(NULL);
+    if (b->rate.limit && rateFull(&b->rate, now))
+        goto skip;
+    if (s_budget.limit && rateFull(&s_budget, now))
+        goto skip;
+
+    b->rate.count++;
+    s_budget.count++;
+    return 1;
+
+skip:
+    b->skips++;
+    return 0;
+}
+
+/*
+** Check if the current line contains a breakpoint. If yes, break and prompt
+** for user, and reset statck level to 0 preparing for the next "OVER" command.
+*/
+int checkBreakPoint(DbgState * st, lua_State * L, lua_Debug * ar)
+{
+    int breakpoint = 0;
+    char path[_MAX_PATH + 1];
+    struct hlist_node *pos;
+    
+    lua_getinfo(L, "Sl", ar);
+    
+    if (ar->currentline >= MAX_LINENO)
+        return 0;
+
+    //Most lines have no breakpoint, don't bother taking the lock for them
+    if (!ATOMIC_LOAD(&s_nbreaks[ar->currentline]))
+        return 0;
+
+    getFileName(path, ar->short_src, _MAX_PATH);
+    
+#ifdef OS_WIN
+    _strlwr(path);
+#endif
+
+    MUTEX_LOCK(&s_lock);
+    hlist_for_each(pos, &s_breaks[ar->currentline]) {
+        BRK *b = hlist_entry(pos, BRK, hlist);
+        if (b->enable && !strcmp(path, b->file)) {
+            breakpoint = takeHit(b);
+            break;
+        }
+    }
+    MUTEX_UNLOCK(&s_lock);
+    
+    if (breakpoint) {
+        return prompt(st, L, ar);
+    }
+    return 0;
+}
+
+static int getCmd(char ** cmds, char ** argv);
+static int listLocals(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
+static int listUpVars(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
+static int listGlobals(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
+static int printStack(lua_State * L, SOCKET s);
+static int watch(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
+static void resetCursor(void);
+static void resetHandles(void);
+static int exec(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
+static int reload(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s);
+static int setBreakPoint(lua_State * L, const char * src, char * argv[], int argc, SOCKET s);
+static int batchBreakPoints(const char * src, char * body, SOCKET s);
+static int oprBreakPoint(lua_State * L, const char * opr, char * argv[], int argc, SOCKET s);
+static int listBreakPoints(lua_State * L, SOCKET s);
+static int pauseBudget(char * argv[], int argc, SOCKET s);
+static int watchMemory(char * argv[], int argc, SOCKET s);
+static int states(DbgState * st, char * argv[], int argc, SOCKET s);
+static int useLZ(char * argv[], int argc, SOCKET s);
+#ifdef OS_LINUX
+static int useRing(char * argv[], int argc, SOCKET s);
+#endif
+
+//Replies of a batch are being held back
+static int s_corked;
+
+static void uncork(void)
+{
+    if (s_corked) {
+        SB_Cork(s_dbg_sock, 0);
+        s_corked = 0;
+    }
+}
+
+/*
+** Serve the controller's commands until a resume command comes. Called by the
+** session owner with s_lock held, which is released while waiting for commands.
+** A frame can hold a batch of commands, one a line, which are served in order
+** and replied one after another; the ones after a resume command are dropped.
+** Return 0 when resumed, 1 when another paused state takes the session, or -1
+** when a socket io error happens.
+*/
+static int serve(DbgState * st, lua_State * L, lua_Debug * ar)
+{
+    //Big enough for batches, only the session owner reads commands
+    static char buf[PROT_MAX_BATCH_LEN];
+    SOCKET s = s_dbg_sock;
+    char * next = NULL;     //Commands left in the frame, one a line
+    
+    while (1) {
+        char * argv[PROT_MAX_ARGS];
+        int argc;
+        char * pCmd;
+        char ** pArgv;
+        int rc;
+
+        if (!next) {
+            uncork();
+            MUTEX_UNLOCK(&s_lock);
+            rc = RecvCmd(s, buf, PROT_MAX_BATCH_LEN);
+            MUTEX_LOCK(&s_lock);
+
+            if (rc == -2) {
+                if (SendErr(s, "Command is too long!") < 0) {
+                    fprintf(stderr, "Socket error!\n");
+                    return -1;
+                }
+                continue;
+            }
+            if (rc < 0) {
+                fprintf(stderr, "Socket or protocol error!\n");
+                return -1;
+            }
+            next = buf;
+
+            //A batch, let the replies go out together
+            if (strchr(buf, '\n') && strncmp(buf, "bb\n", 3)) {
+                SB_Cork(s, 1);
+                s_corked = 1;
+            }
+        }
+
+        argc = getCmd(&next, argv);
+        if (argc <= 0) {
+            if (SendErr(s, "Invalid command!") < 0) {
+                fprintf(stderr, "Socket error!\n");
+                return -1;
+            }
+            continue;
+        }
+        pCmd = argv[0];
+        argc--;
+        pArgv = argv + 1;
+
+        if (!strcmp(pCmd, "s")) {
+            setCmd(st, STEP);       //Step command don't need blevel, breaks all the time
+            return 0;
+        }
+        else if (!strcmp(pCmd, "n")) {
+            setCmd(st, NEXT);
+            st->blevel = st->level; //Next breaks when level <= blevel
+            return 0;
+        }
+        else if (!strcmp(pCmd, "o")) {
+            setCmd(st, STEP_OUT);
+            st->blevel = st->level; //Step out breaks when level < blevel
+            return 0;
+        }
+        else if (!strcmp(pCmd, "f")) {
+            setCmd(st, FINISH);
+            return 0;
+        }
+        else if (!strcmp(pCmd, "r")) {
+            setCmd(st, RUN);
+            return 0;
+        }
+        else if (!strcmp(pCmd, "ll")) {
+            rc = listLocals(L, ar, pArgv, argc, s);
+        }
+        else if (!strcmp(pCmd, "lu")) {
+            rc = listUpVars(L, ar, pArgv, argc, s);
+        }
+        else if (!strcmp(pCmd, "lg")) {
+            rc = listGlobals(L, ar, pArgv, argc, s);
+        }
+        else if (!strcmp(pCmd, "w")) {
+            rc = watch(L, ar, pArgv, argc, s);
+        }
+        else if (!strcmp(pCmd, "ps")) {
+            rc = printStack(L, s);
+        }
+        else if (!strcmp(pCmd, "sb")) {
+            rc = setBreakPoint(L, ar->short_src, pArgv, argc, s);
+        }
+        else if (!strcmp(pCmd, "bb")) {
+            rc = batchBreakPoints(ar->short_src, next, s);
+            next = NULL;
+        }
+        else if (!strcmp(pCmd, "db") || !strcmp(pCmd, "en") || !strcmp(pCmd, "dis")) {
+            rc = oprBreakPoint(L, pCmd, pArgv, argc, s);
+        }
+        else if (!strcmp(pCmd, "lb")) {
+            rc = listBreakPoints(L, s);
+        }
+        else if (!strcmp(pCmd, "pb")) {
+            rc = pauseBudget(pArgv, argc, s);
+        }
+        else if (!strcmp(pCmd, "e")) {
+            rc = exec(L, ar, pArgv, argc, s);
+            resetCursor();
+            resetHandles();
+        }
+        else if (!strcmp(pCmd, "reload")) {
+            rc = reload(L, ar, pArgv, argc, s);
+            resetCursor();
+            resetHandles();
+        }
+        else if (!strcmp(pCmd, "m")) {
+            rc = watchMemory(pArgv, argc, s);
+        }
+        else if (!strcmp(pCmd, "st")) {
+            rc = states(st, pArgv, argc, s);
+            if (rc == 1)
+                return 1;
+        }
+        else if (!strcmp(pCmd, "lz")) {
+            rc = useLZ(pArgv, argc, s);
+        }
+#ifdef OS_LINUX
+        else if (!strcmp(pCmd, "ring")) {
+            rc = useRing(pArgv, argc, s);
+        }
+#endif
+        else {
+            rc = SendErr(s, "Invalid command!");
+        }
+
+        if (rc < 0) {
+            fprintf(stderr, "Socket or protocol error!\n");
+            return -1;
+        }
+    }
+}
+
+/*
+** Return the first paused state other than st, or NULL.
+*/
+static DbgState *nextPaused(DbgState * st)
+{
+    int i;
+    for (i = 0; i < s_nstate; ++i) {
+        if (&s_states[i] != st && s_states[i].L && s_states[i].paused)
+            return &s_states[i];
+    }
+    return NULL;
+}
+
+/*
+** Return the cached names of the chunk ar runs. Call with s_lock held.
+*/
+static SRCINFO *getSrcInfo(lua_Debug * ar)
+{
+    SRCINFO *si = &s_srcinfos[((size_t)ar->source >> 4) % MAX_SRCINFO];
+
+    if (si->source == ar->source && !strcmp(si->short_src, ar->short_src))
+        return si;
+
+    if (!_fullpath(si->path, ar->short_src, _MAX_PATH)) {
+        strncpy(si->path, ar->short_src, _MAX_PATH);
+        si->path[_MAX_PATH] = 0;
+    }
+    getFileName(si->name, ar->short_src, sizeof(si->name));
+    strcpy(si->short_src, ar->short_src);
+    si->source = ar->source;
+    return si;
+}
+
+/*
+** Pause st and wait for its turn to talk to the controller, then serve it.
+** Return -1 when a socket io error happens, or 0 when succeed.
+*/
+int prompt(DbgState * st, lua_State * L, lua_Debug * ar)
+{
+    int top = lua_gettop(L);
+    SRCINFO *si;
+    int rc = 0;
+
+    lua_getinfo(L, "nSl", ar);
+
+    MUTEX_LOCK(&s_lock);
+    si = getSrcInfo(ar);
+    st->paused = 1;
+    strcpy(st->file, si->name);
+    st->line = ar->currentline;
+
+    while (1) {
+        while (s_owner && s_owner != st)
+            COND_WAIT(&s_cond, &s_lock);
+
+        //A forked child breaks for the first time, open its own session
+        if (s_dbg_sock == INVALID_SOCKET && s_follow) {
+            s_follow = 0;
+            s_dbg_sock = tryConnectToDebugger();
+            if (s_dbg_sock == INVALID_SOCKET)
+                clearhooks();
+        }
+
+        //The session is over while waiting, just keep running
+        if (s_dbg_sock == INVALID_SOCKET)
+            break;
+
+        s_owner = st;
+        if (SendBreak(s_dbg_sock, si->name, ar->currentline, s_pid, si->path) < 0) {
+            fprintf(stderr, "Socket error!\n");
+            rc = -1;
+            break;
+        }
+
+        //Each prompt, we set level to INIT_LEVEL, and reset blevel;
+        st->level = INIT_LEVEL;
+        st->blevel = 0;
+
+        rc = serve(st, L, ar);
+        uncork();
+        resetCursor();
+        resetHandles();
+        if (rc != 1)
+            break;
+        rc = 0;     //Switched away, wait until we get the session back
+    }
+
+    st->paused = 0;
+    if (rc == 0 && s_owner == st) {
+        //Resumed, hand the session over to the next paused state
+        s_owner = nextPaused(st);
+        COND_BROADCAST(&s_cond);
+    }
+    MUTEX_UNLOCK(&s_lock);
+
+    assert(top == lua_gettop(L));
+    return rc;
+}
+
+/*
+** Take the next command from the ones left in a frame, *cmds, one a line, and
+** advance *cmds to the line after it, or NULL when it's the last. Arguments
+** are separated by one single space, and the result argument array is stored
+** in argv, which can hold PROT_MAX_ARGS arguments at most. The actual number of
+** arguments is returned, or -2 when the end '"' is not found.
+*/
+int getCmd(char ** cmds, char ** argv)
+{
+    int argc = 0;
+    char * p = *cmds;
+    char * end = strchr(p, '\n');
+
+    if (end) {
+        *end = 0;
+        *cmds = end[1] ? end + 1 : NULL;
+    }
+    else {
+        end = p + strlen(p);
+        *cmds = NULL;
+    }
+
+    while (p < end && argc < PROT_MAX_ARGS) {
+        while (*p == ' ' && p < end)
+            ++p;
+
+        if (*p != '"') {
+            argv[argc++] = p;
+            while (*p != ' ' && p < end)
+                ++p;
+            if (p == end)
+                break;
+        }
+        else {
+            argv[argc++] = ++p;
+            p = strchr(p, '"');
+            if (!p)
+                return -2;  //The end '"' is not found!
+        }
+        *p++ = 0;
+    }
+    return argc;
+}
+
+/*
+** Return the handle of the value on top of L, a new one if it has none yet.
+** L stays unchanged.
+*/
+static int getHandle(lua_State * L)
+{
+    int n;
+
+    if (s_handles_L != L) {
+        resetHandles();
+        lua_newtable(L);
+        s_handles = luaL_ref(L, LUA_REGISTRYINDEX);
+        s_handles_L = L;
+        s_nhandle = 0;
+    }
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, s_handles);
+    lua_pushvalue(L, -2);
+    lua_rawget(L, -2);
+    n = (int)lua_tointeger(L, -1);
+    lua_pop(L, 1);
+    if (!n) {
+        n = ++s_nhandle;
+        lua_pushvalue(L, -2);
+        lua_rawseti(L, -2, n);
+        lua_pushvalue(L, -2);
+        lua_pushinteger(L, n);
+        lua_rawset(L, -3);
+    }
+    lua_pop(L, 1);
+    return n;
+}
+
+/*
+** Push the value of handle n. Return 0 and push nothing when there's no such
+** handle.
+*/
+static int pushHandle(lua_State * L, int n)
+{
+    if (s_handles_L != L || n < 1 || n > s_nhandle)
+        return 0;
+
+    lua_rawgeti(L, LUA_REGISTRYINDEX, s_handles);
+    lua_rawgeti(L, -1, n);
+    lua_remove(L, -2);
+    return 1;
+}
+
+void resetHandles(void)
+{
+    if (s_handles_L) {
+        luaL_unref(s_handles_L, LUA_REGISTRYINDEX, s_handles);
+        s_handles_L = NULL;
+        s_handles = LUA_NOREF;
+    }
+}
+
+/*
+** Print one line text containing a variable name and its value into sb.
+** Variable value is on top of L. L stays unchanged after call.
+** Tables, functions, userdata and threads come with their handles, strings with
+** their first strMax bytes on the next line.
+*/
+static void printVar(SocketBuf * sb, const char * name, lua_State * L, int strMax)
+{
+    int type = lua_type(L, -1);
+
+    //Emitters rather than SB_Print, for lg and w print lots of them
+    if (name) {
+        SB_EmitStr(sb, name);
+        SB_EmitLit(sb, "\n");
+    }
+
+    switch(type) {
+        case LUA_TSTRING: {
+            size_t len;
+            const char * str = lua_tolstring(L, -1, &len);
+            int truncLen = len > (size_t)strMax ? strMax : (int)len;
+
+            //The raw bytes go after the line, for they may hold anything
+            SB_EmitLit(sb, "s");
+            SB_EmitPtr(sb, str);
+            SB_EmitLit(sb, ":");
+            SB_EmitInt(sb, (int)len);
+            SB_EmitLit(sb, ":");
+            SB_EmitInt(sb, truncLen);
+            SB_EmitLit(sb, ":\n");
+            SB_AddRef(sb, str, truncLen);
+            SB_EmitLit(sb, "\n");
+            break;
+        }
+        case LUA_TNUMBER: {
+            SB_EmitLit(sb, "n");
+            SB_EmitNum(sb, lua_tonumber(L, -1));
+            SB_EmitLit(sb, "\n");
+            break;
+        }
+        case LUA_TTABLE: {
+            SB_EmitLit(sb, "t");
+            SB_EmitPtr(sb, lua_topointer(L, -1));
+            SB_EmitLit(sb, "#");
+            SB_EmitInt(sb, getHandle(L));
+            SB_EmitLit(sb, "\n");
+            break;
+        }
+        case LUA_TFUNCTION: {
+            SB_EmitLit(sb, "f");
+            SB_EmitPtr(sb, lua_topointer(L, -1));
+            SB_EmitLit(sb, "#");
+            SB_EmitInt(sb, getHandle(L));
+            SB_EmitLit(sb, "\n");
+            break;
+        }
+        case LUA_TUSERDATA: {
+            SB_EmitLit(sb, "u");
+            SB_EmitPtr(sb, lua_touserdata(L, -1));
+            SB_EmitLit(sb, "#");
+            SB_EmitInt(sb, getHandle(L));
+            SB_EmitLit(sb, "\n");
+            break;
+        }
+        case LUA_TLIGHTUSERDATA: {
+            SB_EmitLit(sb, "U");
+            SB_EmitPtr(sb, lua_touserdata(L, -1));
+            SB_EmitLit(sb, "\n");
+            break;
+        }
+        case LUA_TBOOLEAN: {
+            if (lua_toboolean(L, -1))
+                SB_EmitLit(sb, "b1\n");
+            else
+                SB_EmitLit(sb, "b0\n");
+            break;
+        }
+        case LUA_TTHREAD: {
+            SB_EmitLit(sb, "d");
+            SB_EmitPtr(sb, lua_topointer(L, -1));
+            SB_EmitLit(sb, "#");
+            SB_EmitInt(sb, getHandle(L));
+            SB_EmitLit(sb, "\n");
+            break;
+        }
+        case LUA_TNIL: {
+            SB_EmitLit(sb, "l\n");
+            break;
+        }
+    }
+}
+
+/*
+** FNV-1a of the name and what printVar shows of the value on top of L, the
+** shown part of a string by content as an address may be reused.
+*/
+static unsigned long long fingerprint(const char * name, lua_State * L, int strMax)
+{
+    unsigned long long h = 14695981039346656037ULL;
+    const unsigned char * p;
+    const unsigned char * end;
+    int type = lua_type(L, -1);
+    lua_Number d;
+    const void * ptr;
+    size_t len;
+
+#define FNV(b) (h = (h ^ (b)) * 1099511628211ULL)
+    for (p = (const unsigned char *)name; *p; ++p)
+        FNV(*p);
+    FNV(type);
+
+    switch (type) {
+        case LUA_TSTRING:
+            p = (const unsigned char *)lua_tolstring(L, -1, &len);
+            FNV(len & 0xff);
+            FNV(len >> 8);
+            end = p + (len > (size_t)strMax ? (size_t)strMax : len);
+            break;
+        case LUA_TNUMBER:
+            d = lua_tonumber(L, -1);
+            p = (const unsigned char *)&d;
+            end = p + sizeof(d);
+            break;
+        case LUA_TBOOLEAN:
+            FNV(lua_toboolean(L, -1));
+            return h;
+        case LUA_TNIL:
+            return h;
+        default:
+            ptr = lua_topointer(L, -1);
+            p = (const unsigned char *)&ptr;
+            end = p + sizeof(ptr);
+    }
+    for (; p < end; ++p)
+        FNV(*p);
+#undef FNV
+    return h;
+}
+
+/*
+** Start a delta reply for the frame of ar: when delta is not set, or it's not
+** the frame fp has, all variables are sent.
+*/
+static int beginDelta(FPRINT * fp, lua_State * L, lua_Debug * ar, int level, int delta)
+{
+    struct lua_Debug AR;
+    const void * func;
+    int depth = 0;
+
+    lua_getinfo(L, "f", ar);
+    func = lua_topointer(L, -1);
+    lua_pop(L, 1);
+    while (lua_getstack(L, level + depth + 1, &AR))
+        depth++;
+
+    if (!delta || fp->L != L || fp->func != func || fp->depth != depth)
+        fp->n = 0;
+    fp->L = L;
+    fp->func = func;
+    fp->depth = depth;
+    return fp->n;
+}
+
+/*
+** Print the variable on top of L as the nth(0 based) of a delta reply: nothing
+** when it's the same as the nth fp has, and only the new handle of a table,
+** function, userdata or thread. L stays unchanged.
+*/
+static void printDelta(SocketBuf * sb, FPRINT * fp, int base, int n, const char * name,
+    lua_State * L)
+{
+    unsigned long long h = fingerprint(name, L, PROT_MAX_STR_LEN);
+    int type;
+
+    if (n < base && fp->fp[n] == h) {
+        type = lua_type(L, -1);
+        if (type == LUA_TTABLE || type == LUA_TFUNCTION || type == LUA_TUSERDATA
+            || type == LUA_TTHREAD) {
+            SB_EmitInt(sb, n + 1);
+            SB_EmitLit(sb, "#");
+            SB_EmitInt(sb, getHandle(L));
+            SB_EmitLit(sb, "\n");
+        }
+        return;
+    }
+
+    SB_EmitInt(sb, n + 1);
+    SB_EmitLit(sb, "\n");
+    printVar(sb, name, L, PROT_MAX_STR_LEN);
+
+    if (n >= fp->cap) {
+        int cap = fp->cap ? fp->cap * 2 : 32;
+        unsigned long long * p = realloc(fp->fp, cap * sizeof(*p));
+        if (!p) {
+            //Sent, but can't be a base
+            fp->L = NULL;
+            return;
+        }
+        fp->fp = p;
+        fp->cap = cap;
+    }
+    fp->fp[n] = h;
+}
+
+static void endDelta(SocketBuf * sb, FPRINT * fp, int n)
+{
+    SB_EmitLit(sb, "=");
+    SB_EmitInt(sb, n);
+    SB_EmitLit(sb, "\n");
+    fp->n = fp->L ? n : 0;
+}
+
+typedef struct
+{
+    lua_State * L;
+    lua_Debug * ar;
+    int base;       //Variables the last delta reply has, -1 for a plain reply
+} Args_ll;
+
+static int ll(Args_ll * args, SocketBuf * sb);
+
+/*
+** Input format:
+** ll [stack level [d|f]]
+**
+** Output format:
+** OK
+** Name Value
+** Name Value
+** ...
+**
+** or with d or f, a delta reply:
+** OK
+** Index
+** Name Value
+** Index#Handle
+** ...
+** =Count
+**
+** in which Index is a 1 based position, Count is how many variables there are
+** now. A variable follows its index when it's new or changed since the last
+** delta reply(d) in this frame, a table, function, userdata or thread not
+** changed gets its handle only, and the others unchanged are not sent. f
+** sends all of them, as d does for another frame.
+**
+** L stays unchanged.
+*/
+int listLocals(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
+{
+    struct lua_Debug AR;
+    int level;
+    Args_ll args;
+
+    if (argc > 0) {
+        level = strtol(argv[0], NULL, 10);
+    }
+    else {
+        level = 1;
+    }
+
+    if (--level != 0) {
+        if (!lua_getstack(L, level, &AR)) {
+            return SendErr(s, "No local variable info available at stack level %d.",
+                level + 1);
+        }
+        ar = &AR;
+    }
+    args.L = L;
+    args.ar = ar;
+    args.base = argc > 1 ? beginDelta(&s_fp_ll, L, ar, level, argv[1][0] == 'd') : -1;
+    return SendOK(s, (Writer)ll, &args);
+}
+
+int ll(Args_ll * args, SocketBuf * sb)
+{
+    int i = 1;
+    int n = 0;
+    const char * name;
+
+    while ((name = lua_getlocal(args->L, args->ar, i++))) {
+        if (name[0] != '(') {   //(*temporary)
+            if (args->base >= 0)
+                printDelta(sb, &s_fp_ll, args->base, n++, name, args->L);
+            else
+                printVar(sb, name, args->L, PROT_MAX_STR_LEN);
+        }
+        lua_pop(args->L, 1);
+    }
+    if (args->base >= 0)
+        endDelta(sb, &s_fp_ll, n);
+    return 0;
+}
+
+static int lu(Args_ll * args, SocketBuf * sb);
+
+/*
+** Input format:
+** lu [stack level [d|f]]
+**
+** Output format:
+** OK
+** Name Value
+** Name Value
+** ...
+**
+** or a delta reply as ll's.
+**
+** L stays unchanged.
+*/
+int listUpVars(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
+{
+    struct lua_Debug AR;
+    int level;
+    Args_ll args;
+    int rc;
+
+    if (argc > 0) {
+        level = strtol(argv[0], NULL, 10);
+    }
+    else {
+        level = 1;
+    }
+
+    if (--level != 0) {
+        if (!lua_getstack(L, level, &AR)) {
+            return SendErr(s, "No up variable info available at stack level %d.",
+                level + 1);
+        }
+        ar = &AR;
+    }
+
+    args.L = L;
+    args.ar = ar;
+    args.base = argc > 1 ? beginDelta(&s_fp_lu, L, ar, level, argv[1][0] == 'd') : -1;
+    lua_getinfo(L, "f", ar);
+    rc = SendOK(s, (Writer)lu, &args);
+    lua_pop(L, 1);
+    return rc;
+}
+
+int lu(Args_ll * args, SocketBuf * sb)
+{
+    int i = 1;
+    int n = 0;
+    const char * name;
+
+    while ((name = lua_getupvalue(args->L, -1, i++))) {
+        if (args->base >= 0)
+            printDelta(sb, &s_fp_lu, args->base, n++, name, args->L);
+        else
+            printVar(sb, name, args->L, PROT_MAX_STR_LEN);
+        lua_pop(args->L, 1);
+    }
+    if (args->base >= 0)
+        endDelta(sb, &s_fp_lu, n);
+    return 0;
+}
+
+static int lg(lua_State * L, SocketBuf * sb);
+
+/*
+** Input format:
+** lg [stack level]
+**
+** Output format:
+** OK
+** Name Value
+** Name Value
+** ...
+**
+** L stays unchanged.
+*/
+int listGlobals(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
+{
+    struct lua_Debug AR;
+    int level;
+    int rc;
+
+    if (argc > 0) {
+        level = strtol(argv[0], NULL, 10);
+    }
+    else {
+        level = 1;
+    }
+
+    if (--level != 0) {
+        if (!lua_getstack(L, level, &AR)) {
+            return SendErr(s, "No global variable info available at stack level %d.",
+                level + 1);
+        }
+        ar = &AR;
+    }
+
+    lua_getinfo(L, "f", ar);
+    lua_getfenv(L, -1);
+    assert(lua_istable(L, -1));
+    rc = SendOK(s, (Writer)lg, L);
+    lua_pop(L, 2);
+    return rc;
+}
+
+static int isID(const char * name)
+{
+    if (!(isalpha(*name) || *name == '_'))
+        return 0;
+    ++name;
+    while (isalnum(*name) || *name == '_')
+        ++name;
+    return !*name ? 1 : 0;
+}
+
+int lg(lua_State * L, SocketBuf * sb)
+{
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        if (lua_isstring(L, -2)) {
+            size_t len;
+            const char * name = lua_tolstring(L, -2, &len);
+            if (strlen(name) == len && isID(name))
+                printVar(sb, name, L, PROT_MAX_STR_LEN);
+        }
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+static int lookupVar(lua_State * L, lua_Debug * ar, int level, char scope,
+    const char * name, int nameLen);
+static int lookupField(lua_State * L, const char * field);
+typedef struct
+{
+    lua_State * L;
+    int offset;
+    int limit;      //Negative for all
+} Args_w;
+
+static int w(Args_w * args, SocketBuf * sb);
+
+/*
+** Input format:
+** w <level> <l|u|g> <name>[fields] [r] [offset [limit]]
+** or:
+** w [fields] [r] [offset [limit]]
+** or:
+** w #<handle>[fields] [r] [offset [limit]]
+**
+** in which, fields have the form like |n123.4|b0|s"hello"|s008b917a|f006c4560|...
+** and handle is the number after a value shown by ll, lu, lg or w while paused.
+** A table is listed from pair offset(0 by default) on, limit pairs at most(all
+** by default).
+** Output format:
+** OK
+** Detail
+**
+** L stays unchanged.
+*/
+int watch(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
+{
+    int remember = 0;
+    char * fields = NULL;
+    int rc;
+    int top = lua_gettop(L);
+    int i;
+    Args_w args;
+
+    if (argc >= 3 && argv[1][0] && strchr("lug", argv[1][0])) {
+        int level = strtol(argv[0], NULL, 10);
+        char scope = argv[1][0];
+        char * name = argv[2];
+        char * nameEnd = strchr(name, '|');
+        int nameLen = nameEnd ? nameEnd - name : strlen(name);
+
+        if (level < 1 || argv[1][1] != 0 || !(scope == 'l' || scope == 'u' || scope == 'g'))
+            return SendErr(s, "Invalid argument!");
+        if (!lookupVar(L, ar, level, scope, name, nameLen)) {
+            assert(lua_gettop(L) == top);
+            return SendErr(s, "Variable is not found!");
+        }
+        i = 3;
+        fields = nameEnd;
+    }
+    else if (argc >= 1 && argv[0][0] == '#') {
+        char * end;
+        int n = strtol(argv[0] + 1, &end, 10);
+
+        if (*end && *end != '|')
+            return SendErr(s, "Invalid argument!");
+        if (!pushHandle(L, n)) {
+            assert(lua_gettop(L) == top);
+            return SendErr(s, "Variable is not found!");
+        }
+        i = 1;
+        fields = *end ? end : NULL;
+    }
+    else {
+        if (s_cacheval_L != L || s_cacheval_ref == LUA_NOREF) {
+            assert(lua_gettop(L) == top);
+            return SendErr(s, "Variable is not found!");
+        }
+        
+        lua_rawgeti(L, LUA_REGISTRYINDEX, s_cacheval_ref);
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 1);
+            assert(lua_gettop(L) == top);
+            return SendErr(s, "Variable is not found!");
+        }
+        i = 0;
+        if (i < argc && argv[i][0] == '|')
+            fields = argv[i++];
+    }
+
+    if (i < argc && !strcmp(argv[i], "r")) {
+        remember = 1;
+        ++i;
+    }
+
+    args.L = L;
+    args.offset = i < argc ? atoi(argv[i++]) : 0;
+    args.limit = i < argc ? atoi(argv[i++]) : -1;
+    if (args.offset < 0 || i < argc) {
+        lua_pop(L, 1);
+        assert(lua_gettop(L) == top);
+        return SendErr(s, "Invalid argument!");
+    }
+
+    if (fields && !lookupField(L, fields)) {
+        lua_pop(L, 1);
+        assert(lua_gettop(L) == top);
+        return SendErr(s, "Field is not found!");
+    }
+
+    rc = SendOK(s, (Writer)w, &args);
+    if (remember) {
+        if (s_cacheval_L) {
+            luaL_unref(s_cacheval_L, LUA_REGISTRYINDEX, s_cacheval_ref);
+        }
+        
+        s_cacheval_ref = luaL_ref(L, LUA_REGISTRYINDEX);
+        s_cacheval_L = L;
+        
+        if (fields)
+            lua_pop(L, 1);
+    }
+    else {
+        lua_pop(L, fields ? 2 : 1);
+    }
+
+    assert(lua_gettop(L) == top);
+    return rc;
+}
+
+/*
+** Look up a lua variable with specified stack level, scope and name.
+** Return 1 when found and push it on top of L; otherwise 0 is returned and
+** L stays unchanged.
+*/
+int lookupVar(lua_State * L, lua_Debug * ar, int level, char scope, const char * name, int nameLen)
+{
+    lua_Debug AR;
+    int found = 0;
+
+    if (level != 1) {
+        if (!lua_getstack(L, level - 1, &AR))
+            return 0;
+        ar = &AR;
+    }
+
+    if (scope == 'l') {
+        int i = 1;
+        const char * p;
+
+        lua_pushnil(L); //place holder
+        while ((p = lua_getlocal(L, ar, i++))) {
+            if (nameLen == strlen(p) && !strncmp(p, name, nameLen)) {
+                found = 1;
+                lua_replace(L, -2); //The same name may have multi values(though it's odd!), use the last!
+            }
+            else {
+                lua_pop(L, 1);
+            }
+        }
+        if (!found)
+            lua_pop(L, 1);
+    }
+    else if (scope == 'u') {
+        int i = 1;
+        const char * p;
+
+        lua_getinfo(L, "f", ar);
+        while ((p = lua_getupvalue(L, -1, i++))) {
+            if (nameLen == strlen(p) && !strncmp(p, name, nameLen)) {
+                found = 1;
+                break;
+            }
+            else {
+                lua_pop(L, 1);
+            }
+        }
+        lua_remove(L, found ? -2 : -1);
+    }
+    else {
+        lua_getinfo(L, "f", ar);
+        lua_getfenv(L, -1);
+        assert(lua_istable(L, -1));
+        lua_pushlstring(L, name, nameLen);
+        lua_gettable(L, -2);
+        if (lua_isnil(L, -1)) {
+            lua_pop(L, 3);
+        }
+        else {
+            found = 1;
+            lua_replace(L, -3);
+            lua_pop(L, 1);
+        }
+    }
+
+    return found;
+}
+
+static int nextField(const char * fields, const char ** begin, const char ** end)
+{
+    assert(fields);
+    if (*fields++ != '|' || !*fields)
+        return 0;
+
+    *begin = fields;
+    if (fields[0] == 's' && fields[1] == '\'') {
+        while (1) {
+            const char * p = strchr(fields + 2, '\'');
+            if (!p)
+                return 0;
+            ++p;
+            if (*p != '|' && *p != 0)
+                return 0;
+            *end = p;
+            break;
+        }
+    }
+    else {
+        const char * p = strchr(fields + 1, '|');
+        *end = p ? p : fields + strlen(fields);
+    }
+    return 1;
+}
+
+/*
+** Get a table field by comparing its value's pointer and type with the specified
+** one.
+** Return 1 and push the value on top of L when success; otherwise return 0 and
+** push nothing.
+*/
+static int getFieldValueByPtr(lua_State * L, void * ptr, int type)
+{
+    lua_pushnil(L);
+    while (lua_next(L, -2)) {
+        int t = lua_type(L, -1);
+
+        if (t == type && (t == LUA_TSTRING ? (const void *)lua_tostring(L, -1)
+            : lua_topointer(L, -1)) == ptr) {
+            lua_remove(L, -2);
+            return 1;
+        }
+
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+/*
+** Get a table field. Return 1 and push the field value on top of L; otherwise
+** return 0 and push nothing.
+** The table is on top of L. The field is sth. like "n123.456", "f008bae20", etc.
+*/
+static int getFieldValue(lua_State * L, const char * fieldBegin, const char * fieldEnd)
+{
+    char * end;
+
+    if (*fieldBegin == 'n') {
+        double num = strtod(fieldBegin + 1, &end);
+        if (end != fieldEnd)
+            return 0;
+        lua_pushnumber(L, num);
+        lua_gettable(L, -2);
+    }
+    else if (*fieldBegin == 's' && fieldBegin[1] == '\'') {
+        const char * str = fieldBegin + 2;
+        assert(*(fieldEnd - 1) == '\'');
+        lua_pushlstring(L, str, fieldEnd - str - 1);
+        lua_gettable(L, -2);
+    }
+    else if (*fieldBegin == 'b') {
+        int n = strtol(fieldBegin + 1, &end, 0);
+        if (end != fieldEnd)
+            return 0;
+        lua_pushboolean(L, n);
+        lua_gettable(L, -2);
+    }
+    else if (*fieldBegin == 'U') {
+        void *ptr = (void *)strtoull(fieldBegin + 1, &end, 0);
+        if (end != fieldEnd)
+            return 0;
+        lua_pushlightuserdata(L, ptr);
+        lua_gettable(L, -2);
+    }
+    else {
+        void *ptr;
+        int t;
+
+        switch (*fieldBegin) {
+            case 't':
+                t = LUA_TTABLE;
+                break;
+            case 'u':
+                t = LUA_TUSERDATA;
+                break;
+            case 'f':
+                t = LUA_TFUNCTION;
+                break;
+            case 'd':
+                t = LUA_TTHREAD;
+                break;
+            case 's':
+                t = LUA_TSTRING;
+                break;
+            default:
+                return 0;
+        }
+
+        ptr = (void *)strtoull(fieldBegin + 1, &end, 0);
+        if (end != fieldEnd)
+            return 0;
+        return getFieldValueByPtr(L, (void *)ptr, t);
+    }
+    return 1;
+}
+
+/*
+** Look up a field in a lua value on top of L. If the field is found, it's pushed
+** on top of L and 1 is returned; otherwise nothing is pushed and 0 is returned.
+** field is a descriptive string like '|n123|s"something"|f0088abe8|...'.
+** Specially, "|" is a field representing the value itself. And particularly,
+** "|m" is a legal field denoting the metatable. So surprisingly, any Lua value
+** , not limited to table, can have subfields, because according to offical Lua
+** document, "Every value in Lua may have a metatable". For example, consider
+** "a = 123", then for variable a, 'a|m|s"__add"' is legal.
+*/
+int lookupField(lua_State * L, const char * field)
+{
+    const char * subfieldBegin;
+    const char * subfieldEnd;
+
+    assert(field && *field);
+
+    lua_pushvalue(L, -1);
+    while (*field && nextField(field, &subfieldBegin, &subfieldEnd)) {
+        if (*subfieldBegin == 'm') {
+            if (!lua_getmetatable(L, -1))
+                break;
+        }
+        else {
+            if (!lua_istable(L, -1))
+                break;
+            if (!getFieldValue(L, subfieldBegin, subfieldEnd))
+                break;
+        }
+        lua_replace(L, -2);
+        field = subfieldEnd;
+    }
+
+    if (field[0] && !(field[0] == '|' && field[1] == 0)) {
+        lua_pop(L, 1);
+        return 0;
+    }
+    return 1;
+}
+
+void resetCursor(void)
+{
+    if (s_cursor_L) {
+        luaL_unref(s_cursor_L, LUA_REGISTRYINDEX, s_cursor_t);
+        luaL_unref(s_cursor_L, LUA_REGISTRYINDEX, s_cursor_k);
+        s_cursor_L = NULL;
+        s_cursor_t = LUA_NOREF;
+        s_cursor_k = LUA_NOREF;
+    }
+}
+
+/*
+** Remember where the page of table at -2 stops: pair offset is the one after
+** the key on top, which is popped.
+*/
+static void setCursor(lua_State * L, int offset)
+{
+    resetCursor();
+    s_cursor_k = luaL_ref(L, LUA_REGISTRYINDEX);
+    lua_pushvalue(L, -1);
+    s_cursor_t = luaL_ref(L, LUA_REGISTRYINDEX);
+    s_cursor_L = L;
+    s_cursor_off = offset;
+}
+
+/*
+** Push the key to go on from for pair offset of table on top, and return the
+** index of the pair it leads to.
+*/
+static int seekCursor(lua_State * L, int offset)
+{
+    if (s_cursor_L == L && s_cursor_off <= offset) {
+        int same;
+
+        lua_rawgeti(L, LUA_REGISTRYINDEX, s_cursor_t);
+        same = lua_rawequal(L, -1, -2);
+        lua_pop(L, 1);
+        if (same) {
+            lua_rawgeti(L, LUA_REGISTRYINDEX, s_cursor_k);
+            return s_cursor_off;
+        }
+    }
+    lua_pushnil(L);
+    return 0;
+}
+
+//Pairs counted for the size of the hash part at most
+#define W_MAX_COUNT (1 << 20)
+
+/*
+** Count the pairs of table on top which are not in its array part, that is
+** 1..n. lua_next goes over the array part first, so start from the border n
+** and it's skipped, only approximately when the array part has holes.
+*/
+static int countHash(lua_State * L, int n)
+{
+    int count = 0;
+
+    if (n > 0)
+        lua_pushinteger(L, n);
+    else
+        lua_pushnil(L);
+    while (count < W_MAX_COUNT && lua_next(L, -2)) {
+        lua_pop(L, 1);
+        ++count;
+    }
+    if (count == W_MAX_COUNT)
+        lua_pop(L, 1);
+    return count;
+}
+
+int w(Args_w * args, SocketBuf * sb)
+{
+    lua_State * L = args->L;
+    int t = lua_type(L, -1);
+    int meta;
+    if (t != LUA_TNIL && (meta = lua_getmetatable(L, -1)))
+        lua_pop(L, 1);
+    printVar(sb, NULL, L, PROT_MAX_WATCH_STR_LEN);
+
+    switch (t) {
+        case LUA_TTABLE: {
+            int n = (int)lua_objlen(L, -1);
+            int count = countHash(L, n);
+            int i;
+
+            SB_Print(sb, "%d\n%d\n%d%s\n", meta ? 1 : 0, n, count,
+                count == W_MAX_COUNT ? "+" : "");
+
+            i = seekCursor(L, args->offset);
+            while (1) {
+                if (args->limit >= 0 && i == args->offset + args->limit) {
+                    //The page is full, is there any more?
+                    lua_pushvalue(L, -1);
+                    if (lua_next(L, -3)) {
+                        lua_pop(L, 2);
+                        setCursor(L, i);
+                        SB_Print(sb, "+%d\n", i);
+                    }
+                    else {
+                        lua_pop(L, 1);
+                    }
+                    break;
+                }
+                if (!lua_next(L, -2))
+                    break;
+
+                if (i >= args->offset) {
+                    lua_pushvalue(L, -2);
+                    printVar(sb, NULL, L, PROT_MAX_STR_LEN);
+                    lua_pop(L, 1);
+                    printVar(sb, NULL, L, PROT_MAX_STR_LEN);
+                }
+                lua_pop(L, 1);
+                ++i;
+            }
+            break;
+        }
+        case LUA_TUSERDATA: {
+            int size = lua_objlen(L, -1);
+            SB_Print(sb, "%d\n%d\n", meta ? 1 : 0, size);
+            break;
+        }
+        case LUA_TFUNCTION: {
+            lua_Debug ar;
+            lua_pushvalue(L, -1);
+            lua_getinfo(L, ">S", &ar);
+            SB_Print(sb, "%d\n%s\n%s\n%d\n%d\n", meta ? 1 : 0, ar.what,
+                ar.short_src, ar.linedefined, ar.lastlinedefined);
+            break;
+        }
+        case LUA_TNUMBER: {
+            SB_Print(sb, "%d\n", meta ? 1 : 0);
+            break;
+        }
+        case LUA_TSTRING: {
+            SB_Print(sb, "%d\n", meta ? 1 : 0);
+            break;
+        }
+        case LUA_TBOOLEAN: {
+            SB_Print(sb, "%d\n", meta ? 1 : 0);
+            break;
+        }
+        case LUA_TLIGHTUSERDATA: {
+            SB_Print(sb, "%d\n", meta ? 1 : 0);
+            break;
+        }
+        case LUA_TTHREAD: {
+            int status = lua_status(lua_tothread(L, -1));
+            SB_Print(sb, "%d\n%d\n", meta ? 1 : 0, status);
+            break;
+        }
+    }
+    return 0;
+}
+
+static int ps(lua_State * L, SocketBuf * sb);
+
+/*
+** Input format:
+** ps
+**
+** Output format:
+** OK
+** File
+** Line Number
+** Function Name
+** Name What
+** File
+** Line Number
+** Function Name
+** Name What
+** ...
+**
+** L stays unchanged.
+*/
+int printStack(lua_State * L, SOCKET s)
+{
+    return SendOK(s, (Writer)ps, L);
+}
+
+int ps(lua_State * L, SocketBuf * sb)
+{
+    struct lua_Debug ar;
+    int i = 0;
+
+    while (lua_getstack(L, i, &ar)) {
+        lua_getinfo(L, "nSl", &ar);
+        SB_Print(sb, "%s\n%d\n%s\n%s\n", ar.short_src, ar.currentline,
+            ar.name ? ar.name : "[N/A]", *ar.what ? ar.what : "[N/A]");
+        i++;
+    }
+    return 0;
+}
+
+/*
+** Parse "N/T" into r.
+** Return 0 when success, or -1 when invalid.
+*/
+static int parseRate(const char * str, RATE * r)
+{
+    char *end;
+
+    memset(r, 0, sizeof(RATE));
+    r->limit = strtol(str, &end, 10);
+    if (r->limit < 0 || (*end && *end != '/'))
+        return -1;
+
+    r->period = 1;
+    if (*end == '/') {
+        r->period = strtol(end + 1, &end, 10);
+        if (r->period <= 0 || *end)
+            return -1;
+    }
+    return 0;
+}
+
+/*
+** Set breakpoint "<file> <line> [limit N/T] [sample K]" in argv.
+** Return NULL when success, or the error message.
+*/
+static const char *addBreakPoint(const char * src, char * argv[], int argc)
+{
+    int line;
+    const char * file;
+    char path[_MAX_PATH + 1];
+    struct hlist_node *pos, *next;
+    BRK *found = NULL;
+    RATE rate;
+    unsigned int sample = 0;
+    int i;
+    
+    if (argc < 2 || (line = strtol(argv[1], NULL, 10)) <= 0) {
+        return "Invalid argument!";
+    }
+
+    //Options: limit N/T, sample K
+    memset(&rate, 0, sizeof(RATE));
+    for (i = 2; i < argc; i += 2) {
+        if (i + 1 >= argc)
+            return "Invalid argument!";
+
+        if (!strcmp(argv[i], "limit")) {
+            if (parseRate(argv[i + 1], &rate) < 0 || !rate.limit)
+                return "Invalid limit, use N/T!";
+        }
+        else if (!strcmp(argv[i], "sample")) {
+            sample = strtoul(argv[i + 1], NULL, 10);
+            if (!sample)
+                return "Invalid sample, use K!";
+        }
+        else {
+            return "Invalid argument!";
+        }
+    }
+
+    if (line >= MAX_LINENO) {
+        return "Invalid line number!";
+    }
+    
+    if (!strcmp(argv[0], "."))
+        file = src;
+    else
+        file = argv[0];
+
+    getFileName(path, file, _MAX_PATH);
+
+#ifdef OS_WIN
+    _strlwr(path);
+#endif
+
+    hlist_for_each_safe(pos, next, &s_breaks[line]) {
+        BRK *b = hlist_entry(pos, BRK, hlist);
+        if (!strcmp(path, b->file)) {
+            found = b;
+            break;
+        }
+    }
+    
+    if (!found) {
+        found = BRKNew(path, line);
+        if (!found)
+            return "Out of memory!";
+        
+        hlist_add_head(&found->hlist, &s_breaks[line]);
+        ATOMIC_STORE(&s_nbreaks[line], s_nbreaks[line] + 1);
+    }
+
+    //Setting an existing breakpoint again replaces its options
+    found->rate = rate;
+    found->sample = sample;
+    
+    return NULL;
+}
+
+/*
+** Input format:
+** sb <File> <Line> [limit <N>/<T>] [sample <K>]
+**
+** in which, the breakpoint pauses at most N times every T seconds(1 when /T is
+** left out), or once in K hits picked at random.
+**
+** Output format:
+** OK
+**
+*/
+int setBreakPoint(lua_State * L, const char * src, char * argv[], int argc, SOCKET s)
+{
+    const char *err = addBreakPoint(src, argv, argc);
+    if (err)
+        return SendErr(s, "%s", err);
+    return SendOK(s, NULL, NULL);
+}
+
+typedef struct
+{
+    const char *src;
+    char *body;
+} BATCH;
+
+static int lbb(BATCH * batch, SocketBuf * sb);
+
+/*
+** Input format:
+** bb
+** <file> <line> [limit N/T] [sample K]
+** ...
+**
+** Output format:
+** OK
+** OK(for a breakpoint set), or its error message
+** ...
+*/
+int batchBreakPoints(const char * src, char * body, SOCKET s)
+{
+    BATCH batch;
+
+    batch.src = src;
+    batch.body = body;
+    return SendOK(s, (Writer)lbb, &batch);
+}
+
+int lbb(BATCH * batch, SocketBuf * sb)
+{
+    char *p = batch->body;
+
+    while (p && *p) {
+        char *argv[PROT_MAX_ARGS];
+        int argc = 0;
+        const char *err;
+        char *next = strchr(p, '\n');
+
+        if (next)
+            *next++ = 0;
+
+        while (*p && argc < PROT_MAX_ARGS) {
+            while (*p == ' ')
+                *p++ = 0;
+            if (!*p)
+                break;
+            argv[argc++] = p;
+            while (*p && *p != ' ')
+                ++p;
+        }
+
+        err = addBreakPoint(batch->src, argv, argc);
+        SB_Print(sb, "%s\n", err ? err : "OK");
+        p = next;
+    }
+    return 0;
+}
+
+/*
+** Input format:
+** db <index>
+** en <index>
+** dis <index>
+**
+** Output format:
+** OK
+**
+*/
+int oprBreakPoint(lua_State * L, const char * opr, char * argv[], int argc, SOCKET s)
+{
+    int idx;
+    BRK *targetB = NULL;
+    int i = 1;
+    struct list_head *pos;
+    
+    if (argc < 1 || (idx = strtol(argv[0], NULL, 10)) <= 0) {
+        return SendErr(s, "Invalid argument!");
+    }
+    
+    list_for_each(pos, &s_break_head) {
+        BRK *b = list_entry(pos, BRK, list);
+        if (i == idx) {
+            targetB = b;
+            break;
+        }
+        ++i;
+    }
+    
+    if (!targetB)
+        return SendErr(s, "Breakpoint not found!");
+    
+    if (!strcmp(opr, "db")) {
+        BRKFree(targetB);
+    } else if (!strcmp(opr, "en")) {
+        targetB->enable = 1;
+    } else if (!strcmp(opr, "dis")) {
+        targetB->enable = 0;
+    } else {
+        assert(0);
+    }
+    
+     return SendOK(s, NULL, NULL);
+}
+
+static int lb(lua_State * L, SocketBuf * sb);
+
+/*
+** Input format:
+** lb
+**
+** Output format:
+** OK
+** File
+** Line Number
+** File
+** Line Number
+** ...
+**
+*/
+int listBreakPoints(lua_State * L, SOCKET s)
+{
+    return SendOK(s, (Writer)lb, L);
+}
+
+static int lpb(RATE * r, SocketBuf * sb);
+
+/*
+** Input format:
+** pb [N/T]
+** N/T: at most N pauses every T seconds for all breakpoints, 0 turns it off.
+*/
+int pauseBudget(char * argv[], int argc, SOCKET s)
+{
+    RATE r;
+
+    if (argc == 0)
+        return SendOK(s, (Writer)lpb, &s_budget);
+
+    if (parseRate(argv[0], &r) < 0)
+        return SendErr(s, "Invalid budget, use N/T!");
+
+    s_budget = r;
+    return SendOK(s, NULL, NULL);
+}
+
+int lpb(RATE * r, SocketBuf * sb)
+{
+    SB_Print(sb, "%d\n%d\n%d\n", r->limit, r->period, r->count);
+    return 0;
+}
+
+int lb(lua_State * L, SocketBuf * sb)
+{
+    int i = 1;
+    struct list_head *pos;
+    list_for_each(pos, &s_break_head) {
+        BRK *b = list_entry(pos, BRK, list);
+        SB_Print(sb, "%d\n%s\n%d\n%d\n%d\n%d\n%d\n%d\n%d\n", i, b->file, b->lineno, b->enable,
+            (int)b->hits, (int)b->skips, b->rate.limit, b->rate.period, (int)b->sample);
+        ++i;
+    }
+    
+    return 0;
+}
+
+static int lst(DbgState * cur, SocketBuf * sb);
+
+/*
+** Input format:
+** st [index]
+**
+** Output format:
+** OK
+** Index
+** State
+** Status(c for current, p for paused, r for running)
+** File
+** Line Number
+** ...
+**
+** When index presents, the paused state of the index takes the session after
+** OK is sent, and a break message of it follows.
+** Return 1 when switched.
+*/
+int states(DbgState * st, char * argv[], int argc, SOCKET s)
+{
+    int idx;
+    DbgState *target;
+    int rc;
+
+    if (argc < 1)
+        return SendOK(s, (Writer)lst, st);
+
+    idx = strtol(argv[0], NULL, 10);
+    if (idx <= 0 || idx > s_nstate || !s_states[idx - 1].L)
+        return SendErr(s, "State not found!");
+
+    target = &s_states[idx - 1];
+    if (!target->paused)
+        return SendErr(s, "State is not paused!");
+
+    if ((rc = SendOK(s, NULL, NULL)) < 0)
+        return rc;
+
+    s_owner = target;
+    COND_BROADCAST(&s_cond);
+    return 1;
+}
+
+int lst(DbgState * cur, SocketBuf * sb)
+{
+    int i;
+    for (i = 0; i < s_nstate; ++i) {
+        DbgState *st = &s_states[i];
+        if (!st->L)
+            continue;
+
+        if (st->paused)
+            SB_Print(sb, "%d\n%p\n%s\n%s\n%d\n", i + 1, st->L, st == cur ? "c" : "p",
+                st->file, st->line);
+        else
+            SB_Print(sb, "%d\n%p\nr\n-\n0\n", i + 1, st->L);
+    }
+    return 0;
+}
+
+/*
+** L stays unchanged.
+*/
+int exec(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
+{
+    return -2;
+}
+
+/*
+** The new function at -1 replaces the old one at -2: it takes over the
+** environment of the old one, and the old upvalues of the same names(so the
+** state built up survives). Upvalues holding functions keep the reloaded code,
+** which adopts the old one in turn. They are recorded in map at mapIdx to fix
+** the closures still using the old ones.
+*/
+static void adoptFunction(lua_State * L, int mapIdx)
+{
+    int i, j;
+    const char *nname, *oname;
+
+    lua_getfenv(L, -2);
+    lua_setfenv(L, -2);
+
+    for (i = 1; (nname = lua_getupvalue(L, -1, i)) != NULL; ++i) {
+        //... old new nval
+        for (j = 1; (oname = lua_getupvalue(L, -3, j)) != NULL; ++j) {
+            //... old new nval oval
+            if (!strcmp(nname, oname))
+                break;
+            lua_pop(L, 1);
+        }
+
+        if (!oname) {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        if (lua_isfunction(L, -2) && !lua_iscfunction(L, -2)
+            && lua_isfunction(L, -1) && !lua_iscfunction(L, -1)) {
+            lua_pushvalue(L, -1);
+            lua_rawget(L, mapIdx);
+            //... old new nval oval mapped
+            if (!lua_isnil(L, -1)) {
+                //Adopted already, share that one
+                lua_setupvalue(L, -4, i);
+            } else if (!lua_rawequal(L, -2, -3) && lua_checkstack(L, 8)) {
+                lua_pop(L, 1);
+                lua_pushvalue(L, -1);
+                lua_pushvalue(L, -3);
+                lua_rawset(L, mapIdx);
+                lua_insert(L, -2);
+                adoptFunction(L, mapIdx);
+            } else {
+                lua_pop(L, 1);
+            }
+            lua_pop(L, 2);
+            continue;
+        }
+
+        lua_pop(L, 2);
+#ifdef LDB_HAVE_UPVALUEJOIN
+        lua_upvaluejoin(L, -1, i, -2, j);
+#else
+        //No lua_upvaluejoin in lua 5.1, share the value
+        lua_getupvalue(L, -2, j);
+        lua_setupvalue(L, -2, i);
+#endif
+    }
+}
+
+/*
+** Replace the functions of src(at srcIdx) in dst(at dstIdx), name filters
+** by key. Replaced names are appended to names at -1 with prefix.
+*/
+static void rebindFunctions(lua_State * L, int srcIdx, int dstIdx, int mapIdx,
+    const char * prefix, const char * name)
+{
+    lua_pushnil(L);
+    while (lua_next(L, srcIdx)) {
+        //... names key new
+        if (lua_type(L, -2) == LUA_TSTRING && lua_isfunction(L, -1)
+            && (!name || !strcmp(name, lua_tostring(L, -2)))) {
+            lua_pushvalue(L, -2);
+            lua_rawget(L, dstIdx);
+            //... names key new old
+            if (lua_isfunction(L, -1) && !lua_iscfunction(L, -1)) {
+                lua_pushvalue(L, -2);
+                adoptFunction(L, mapIdx);
+                lua_pop(L, 1);
+
+                //map[old] = new, dst[key] = new
+                lua_pushvalue(L, -2);
+                lua_rawset(L, mapIdx);
+                lua_pushvalue(L, -2);
+                lua_pushvalue(L, -2);
+                lua_rawset(L, dstIdx);
+
+                lua_pushfstring(L, "%s%s", prefix, lua_tostring(L, -2));
+                lua_rawseti(L, -4, lua_objlen(L, -4) + 1);
+            }
+            else {
+                lua_pop(L, 1);
+            }
+        }
+        lua_pop(L, 1);
+    }
+}
+
+/*
+** Point the upvalues of the functions in t(at idx) still holding a replaced
+** function to the new one.
+*/
+static void fixUpvalues(lua_State * L, int idx, int mapIdx)
+{
+    lua_pushnil(L);
+    while (lua_next(L, idx)) {
+        if (lua_isfunction(L, -1) && !lua_iscfunction(L, -1)) {
+            int i;
+            for (i = 1; lua_getupvalue(L, -1, i) != NULL; ++i) {
+                lua_rawget(L, mapIdx);
+                if (lua_isnil(L, -1))
+                    lua_pop(L, 1);
+                else
+                    lua_setupvalue(L, -2, i);
+            }
+        }
+        lua_pop(L, 1);
+    }
+}
+
+static int lrl(lua_State * L, SocketBuf * sb);
+
+/*
+** Input format:
+** reload <file> [function]
+** file: "." for the current chunk.
+**
+** Output format:
+** OK
+** name1
+** name2
+** ...
+**
+** The chunk runs in a sandbox falling back to the globals for reading. Its
+** global functions replace those of the same names in the globals, and the
+** functions of the table it returns replace those in package.loaded[<base
+** name of file>]. Closures still using the old functions as upvalues are
+** fixed up.
+*/
+int reload(lua_State * L, lua_Debug * ar, char * argv[], int argc, SOCKET s)
+{
+    int top = lua_gettop(L);
+    const char *file;
+    const char *name = argc > 1 ? argv[1] : NULL;
+    char mod[LUA_IDSIZE];
+    char *dot;
+    int rc;
+
+    if (argc < 1)
+        return SendErr(s, "Invalid argument!");
+
+    file = strcmp(argv[0], ".") ? argv[0] : getSrcInfo(ar)->path;
+    getFileName(mod, file, sizeof(mod));
+    dot = strrchr(mod, '.');
+    if (dot)
+        *dot = 0;
+
+    if (luaL_loadfile(L, file)) {
+        rc = SendErr(s, "%s", lua_tostring(L, -1));
+        lua_settop(L, top);
+        return rc;
+    }
+
+    //Globals of the current function, top + 1
+    lua_getinfo(L, "f", ar);
+    lua_getfenv(L, -1);
+    lua_remove(L, -2);
+    lua_insert(L, -2);
+
+    //Sandbox, top + 2
+    lua_newtable(L);
+    lua_newtable(L);
+    lua_pushvalue(L, top + 1);
+    lua_setfield(L, -2, "__index");
+    lua_setmetatable(L, -2);
+    lua_pushvalue(L, -1);
+    lua_setfenv(L, -3);
+    lua_insert(L, -2);
+
+    //Returned module, top + 3
+    if (lua_pcall(L, 0, 1, 0)) {
+        rc = SendErr(s, "%s", lua_tostring(L, -1));
+        lua_settop(L, top);
+        return rc;
+    }
+
+    //Loaded module, top + 4
+    lua_getfield(L, LUA_REGISTRYINDEX, "_LOADED");
+    if (lua_istable(L, -1))
+        lua_getfield(L, -1, mod);
+    else
+        lua_pushnil(L);
+    lua_remove(L, -2);
+
+    //Map from old functions to new ones top + 5, names top + 6
+    lua_newtable(L);
+    lua_newtable(L);
+
+    rebindFunctions(L, top + 2, top + 1, top + 5, "", name);
+    if (lua_istable(L, top + 3) && lua_istable(L, top + 4)) {
+        char prefix[LUA_IDSIZE + 1];
+        sprintf(prefix, "%s.", mod);
+        rebindFunctions(L, top + 3, top + 4, top + 5, prefix, name);
+    }
+
+    fixUpvalues(L, top + 1, top + 5);
+    if (lua_istable(L, top + 4))
+        fixUpvalues(L, top + 4, top + 5);
+
+    if (lua_objlen(L, -1) == 0)
+        rc = SendErr(s, "No function to reload in %s!", file);
+    else
+        rc = SendOK(s, (Writer)lrl, L);
+
+    lua_settop(L, top);
+    return rc;
+}
+
+int lrl(lua_State * L, SocketBuf * sb)
+{
+    int i;
+    int n = (int)lua_objlen(L, -1);
+
+    for (i = 1; i <= n; ++i) {
+        lua_rawgeti(L, -1, i);
+        SB_Print(sb, "%s\n", lua_tostring(L, -1));
+        lua_pop(L, 1);
+    }
+    return 0;
+}
+
+/*
+** Input format:
+** m <addr> <len>
+**
+** Output format:
+** OK
+** content
+**
+** Warning:
+** This function may read an unreadable address and cause a hard/OS exception!
+*/
+int watchMemory(char * argv[], int argc, SOCKET s)
+{
+    void * addr;
+    unsigned int len;
+    SocketBuf sb;
+
+    if (argc < 2 || (addr = (void *)strtoull(argv[0], NULL, 0)) == 0
+        || (len = strtoull(argv[1], NULL, 0)) <= 0
+        || (unsigned long)((unsigned long)addr + len) < (unsigned long)addr) //overflow!
+    {
+        return SendErr(s, "Invalid argument!");
+    }
+
+    SB_Init(&sb, s, PROT_OK);
+    SB_AddRef(&sb, addr, len);
+    return SB_Send(&sb);
+}
+
+/*
+** Input format:
+** lz <threshold>
+**
+** Output format:
+** OK(uncompressed, the following frames of threshold bytes or longer may be
+** compressed)
+*/
+int useLZ(char * argv[], int argc, SOCKET s)
+{
+    int threshold;
+    int rc;
+
+    if (argc < 1 || (threshold = atoi(argv[0])) < 64)
+        return SendErr(s, "Invalid argument!");
+
+    rc = SendOK(s, NULL, NULL);
+    if (rc == 0)
+        SB_UseLZ(s, threshold);
+    return rc;
+}
+
+#ifdef OS_LINUX
+/*
+** Input format:
+** ring <path>
+**
+** Output format:
+** OK(still by the socket, the following replies go through the ring)
+*/
+int useRing(char * argv[], int argc, SOCKET s)
+{
+    int rc;
+
+    if (argc < 1 || SB_MapRing(argv[0]) < 0)
+        return SendErr(s, "Can't map the ring!");
+
+    rc = SendOK(s, NULL, NULL);
+    if (rc == 0)
+        SB_UseRing(s);
+    return rc;
+}
+#endif
@@ -0,0 +1,381 @@
+/******************************************************************************
+* Copyright (C) 2016 Wen Xichang.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include <string.h>
+#include "Number.h"
+
+/*
+** Doubles are formatted with Grisu2(Florian Loitsch, "Printing Floating-Point
+** Numbers Quickly and Accurately with Integers"): the digits always read back
+** as the same double, and are the shortest ones in nearly all cases.
+*/
+
+typedef unsigned long long u64;
+
+typedef struct {
+    u64 f;
+    int e;
+} DiyFp;
+
+#define DP_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFULL
+#define DP_HIDDEN_BIT 0x0010000000000000ULL
+#define DP_EXPONENT_BIAS (0x3FF + 52)
+
+/*
+** Normalized 10^-348, 10^-340, ..., 10^340: s_powF * 2^s_powE.
+*/
+static const unsigned long long s_powF[] = {
+    0xfa8fd5a0081c0288ULL, 0xbaaee17fa23ebf76ULL, 0x8b16fb203055ac76ULL, 0xcf42894a5dce35eaULL,
+    0x9a6bb0aa55653b2dULL, 0xe61acf033d1a45dfULL, 0xab70fe17c79ac6caULL, 0xff77b1fcbebcdc4fULL,
+    0xbe5691ef416bd60cULL, 0x8dd01fad907ffc3cULL, 0xd3515c2831559a83ULL, 0x9d71ac8fada6c9b5ULL,
+    0xea9c227723ee8bcbULL, 0xaecc49914078536dULL, 0x823c12795db6ce57ULL, 0xc21094364dfb5637ULL,
+    0x9096ea6f3848984fULL, 0xd77485cb25823ac7ULL, 0xa086cfcd97bf97f4ULL, 0xef340a98172aace5ULL,
+    0xb23867fb2a35b28eULL, 0x84c8d4dfd2c63f3bULL, 0xc5dd44271ad3cdbaULL, 0x936b9fcebb25c996ULL,
+    0xdbac6c247d62a584ULL, 0xa3ab66580d5fdaf6ULL, 0xf3e2f893dec3f126ULL, 0xb5b5ada8aaff80b8ULL,
+    0x87625f056c7c4a8bULL, 0xc9bcff6034c13053ULL, 0x964e858c91ba2655ULL, 0xdff9772470297ebdULL,
+    0xa6dfbd9fb8e5b88fULL, 0xf8a95fcf88747d94ULL, 0xb94470938fa89bcfULL, 0x8a08f0f8bf0f156bULL,
+    0xcdb02555653131b6ULL, 0x993fe2c6d07b7facULL, 0xe45c10c42a2b3b06ULL, 0xaa242499697392d3ULL,
+    0xfd87b5f28300ca0eULL, 0xbce5086492111aebULL, 0x8cbccc096f5088ccULL, 0xd1b71758e219652cULL,
+    0x9c40000000000000ULL, 0xe8d4a51000000000ULL, 0xad78ebc5ac620000ULL, 0x813f3978f8940984ULL,
+    0xc097ce7bc90715b3ULL, 0x8f7e32ce7bea5c70ULL, 0xd5d238a4abe98068ULL, 0x9f4f2726179a2245ULL,
+    0xed63a231d4c4fb27ULL, 0xb0de65388cc8ada8ULL, 0x83c7088e1aab65dbULL, 0xc45d1df942711d9aULL,
+    0x924d692ca61be758ULL, 0xda01ee641a708deaULL, 0xa26da3999aef774aULL, 0xf209787bb47d6b85ULL,
+    0xb454e4a179dd1877ULL, 0x865b86925b9bc5c2ULL, 0xc83553c5c8965d3dULL, 0x952ab45cfa97a0b3ULL,
+    0xde469fbd99a05fe3ULL, 0xa59bc234db398c25ULL, 0xf6c69a72a3989f5cULL, 0xb7dcbf5354e9beceULL,
+    0x88fcf317f22241e2ULL, 0xcc20ce9bd35c78a5ULL, 0x98165af37b2153dfULL, 0xe2a0b5dc971f303aULL,
+    0xa8d9d1535ce3b396ULL, 0xfb9b7cd9a4a7443cULL, 0xbb764c4ca7a44410ULL, 0x8bab8eefb6409c1aULL,
+    0xd01fef10a657842cULL, 0x9b10a4e5e9913129ULL, 0xe7109bfba19c0c9dULL, 0xac2820d9623bf429ULL,
+    0x80444b5e7aa7cf85ULL, 0xbf21e44003acdd2dULL, 0x8e679c2f5e44ff8fULL, 0xd433179d9c8cb841ULL,
+    0x9e19db92b4e31ba9ULL, 0xeb96bf6ebadf77d9ULL, 0xaf87023b9bf0ee6bULL
+};
+
+static const short s_powE[] = {
+    -1220, -1193, -1166, -1140, -1113, -1087, -1060, -1034, -1007, -980,
+    -954, -927, -901, -874, -847, -821, -794, -768, -741, -715,
+    -688, -661, -635, -608, -582, -555, -529, -502, -475, -449,
+    -422, -396, -369, -343, -316, -289, -263, -236, -210, -183,
+    -157, -130, -103, -77, -50, -24, 3, 30, 56, 83,
+    109, 136, 162, 189, 216, 242, 269, 295, 322, 348,
+    375, 402, 428, 455, 481, 508, 534, 561, 588, 614,
+    641, 667, 694, 720, 747, 774, 800, 827, 853, 880,
+    907, 933, 960, 986, 1013, 1039, 1066
+};
+
+static const u64 s_pow10[] = {
+    1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL,
+    100000000ULL, 1000000000ULL, 10000000000ULL, 100000000000ULL,
+    1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+    1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL,
+    1000000000000000000ULL, 10000000000000000000ULL
+};
+
+static const char s_digits[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+char * FormatInt(char * end, long long n)
+{
+    u64 u = n < 0 ? 0 - (u64)n : (u64)n;
+
+    while (u >= 100) {
+        int i = (int)(u % 100) * 2;
+        u /= 100;
+        *--end = s_digits[i + 1];
+        *--end = s_digits[i];
+    }
+    if (u >= 10) {
+        *--end = s_digits[u * 2 + 1];
+        *--end = s_digits[u * 2];
+    }
+    else {
+        *--end = (char)('0' + u);
+    }
+    if (n < 0)
+        *--end = '-';
+    return end;
+}
+
+static DiyFp multiply(DiyFp x, DiyFp y)
+{
+    const u64 M32 = 0xFFFFFFFFULL;
+    u64 a = x.f >> 32, b = x.f & M32;
+    u64 c = y.f >> 32, d = y.f & M32;
+    u64 ac = a * c, bc = b * c, ad = a * d, bd = b * d;
+    u64 tmp = (bd >> 32) + (ad & M32) + (bc & M32);
+    DiyFp r;
+
+    tmp += 1ULL << 31;  //Round
+    r.f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+static DiyFp normalize(DiyFp x)
+{
+    while (!(x.f & 0x8000000000000000ULL)) {
+        x.f <<= 1;
+        --x.e;
+    }
+    return x;
+}
+
+/*
+** The boundaries of v, half way to its neighbours, with the same exponent.
+*/
+static void boundaries(DiyFp v, DiyFp * minus, DiyFp * plus)
+{
+    DiyFp pl, mi;
+
+    pl.f = (v.f << 1) + 1;
+    pl.e = v.e - 1;
+    while (!(pl.f & (DP_HIDDEN_BIT << 1))) {
+        pl.f <<= 1;
+        --pl.e;
+    }
+    pl.f <<= 64 - 52 - 2;
+    pl.e -= 64 - 52 - 2;
+
+    //The lower neighbour is closer at a power of 2
+    if (v.f == DP_HIDDEN_BIT) {
+        mi.f = (v.f << 2) - 1;
+        mi.e = v.e - 2;
+    }
+    else {
+        mi.f = (v.f << 1) - 1;
+        mi.e = v.e - 1;
+    }
+    mi.f <<= mi.e - pl.e;
+    mi.e = pl.e;
+
+    *minus = mi;
+    *plus = pl;
+}
+
+/*
+** The cached power c of 10 that brings e into [-60, -32] after multiplying,
+** with c = 10^-K.
+*/
+static DiyFp cachedPower(int e, int * K)
+{
+    double dk = (-61 - e) * 0.30102999566398114 + 347;
+    int k = (int)dk;
+    int index;
+    DiyFp c;
+
+    if (dk - k > 0.0)
+        ++k;
+    index = (k >> 3) + 1;
+    *K = -(-348 + index * 8);
+    c.f = s_powF[index];
+    c.e = s_powE[index];
+    return c;
+}
+
+static void roundDigit(char * buf, int len, u64 delta, u64 rest, u64 tenKappa, u64 wpw)
+{
+    while (rest < wpw && delta - rest >= tenKappa
+        && (rest + tenKappa < wpw || wpw - rest > rest + tenKappa - wpw)) {
+        buf[len - 1]--;
+        rest += tenKappa;
+    }
+}
+
+static int countDigits(unsigned int n)
+{
+    int i;
+    for (i = 1; i < 10; ++i) {
+        if (n < s_pow10[i])
+            return i;
+    }
+    return 10;
+}
+
+/*
+** Generate the digits of w as few as possible within delta below mp.
+** Return the number of digits, the value is buf * 10^K.
+*/
+static int digitGen(DiyFp w, DiyFp mp, u64 delta, char * buf, int * K)
+{
+    DiyFp one;
+    u64 wpw = mp.f - w.f;
+    unsigned int p1;
+    u64 p2;
+    int kappa;
+    int len = 0;
+
+    one.f = 1ULL << -mp.e;
+    one.e = mp.e;
+    p1 = (unsigned int)(mp.f >> -one.e);
+    p2 = mp.f & (one.f - 1);
+    kappa = countDigits(p1);
+
+    while (kappa > 0) {
+        unsigned int d = p1 / (unsigned int)s_pow10[kappa - 1];
+        u64 rest;
+
+        p1 %= (unsigned int)s_pow10[kappa - 1];
+        if (d || len)
+            buf[len++] = (char)('0' + d);
+        --kappa;
+        rest = ((u64)p1 << -one.e) + p2;
+        if (rest <= delta) {
+            *K += kappa;
+            roundDigit(buf, len, delta, rest, s_pow10[kappa] << -one.e, wpw);
+            return len;
+        }
+    }
+
+    while (1) {
+        char d;
+
+        p2 *= 10;
+        delta *= 10;
+        d = (char)(p2 >> -one.e);
+        if (d || len)
+            buf[len++] = (char)('0' + d);
+        p2 &= one.f - 1;
+        --kappa;
+        if (p2 < delta) {
+            *K += kappa;
+            roundDigit(buf, len, delta, p2, one.f, -kappa < 20 ? wpw * s_pow10[-kappa] : 0);
+            return len;
+        }
+    }
+}
+
+/*
+** The digits of positive d, return how many, the value is buf * 10^K.
+*/
+static int grisu2(double d, char * buf, int * K)
+{
+    u64 bits;
+    int be;
+    DiyFp v, w, wm, wp, c;
+
+    memcpy(&bits, &d, sizeof(d));
+    be = (int)(bits >> 52) & 0x7FF;
+    v.f = bits & DP_SIGNIFICAND_MASK;
+    if (be) {
+        v.f += DP_HIDDEN_BIT;
+        v.e = be - DP_EXPONENT_BIAS;
+    }
+    else {
+        v.e = 1 - DP_EXPONENT_BIAS;
+    }
+
+    boundaries(v, &wm, &wp);
+    c = cachedPower(wp.e, K);
+    w = multiply(normalize(v), c);
+    wp = multiply(wp, c);
+    wm = multiply(wm, c);
+    ++wm.f;
+    --wp.f;
+    return digitGen(w, wp, wp.f - wm.f, buf, K);
+}
+
+int FormatNumber(char * buf, double d)
+{
+    char digits[20];
+    char * p = buf;
+    int len, K, point;
+
+    //Integers, most numbers of a script
+    if (d > -1e15 && d < 1e15 && d == (double)(long long)d && (d != 0 || 1 / d > 0)) {
+        char * end = buf + 32;
+        char * begin = FormatInt(end, (long long)d);
+        len = (int)(end - begin);
+        memmove(buf, begin, len);
+        return len;
+    }
+
+    if (d != d) {
+        memcpy(buf, "nan", 3);
+        return 3;
+    }
+    if (d < 0 || (d == 0 && 1 / d < 0)) {
+        *p++ = '-';
+        d = -d;
+    }
+    if (d == 0) {
+        *p++ = '0';
+        return (int)(p - buf);
+    }
+    if (d > 1.7976931348623157e308) {
+        memcpy(p, "inf", 3);
+        return (int)(p - buf) + 3;
+    }
+
+    len = grisu2(d, digits, &K);
+    point = len + K;    //Digits before the decimal point
+    if (point > 0 && point <= 17) {
+        if (len <= point) {
+            memcpy(p, digits, len);
+            memset(p + len, '0', point - len);
+            p += point;
+        }
+        else {
+            memcpy(p, digits, point);
+            p[point] = '.';
+            memcpy(p + point + 1, digits + point, len - point);
+            p += len + 1;
+        }
+    }
+    else if (point <= 0 && point > -4) {
+        *p++ = '0';
+        *p++ = '.';
+        memset(p, '0', -point);
+        p += -point;
+        memcpy(p, digits, len);
+        p += len;
+    }
+    else {
+        int e = point - 1;
+        char tmp[8];
+        char * begin;
+
+        *p++ = digits[0];
+        if (len > 1) {
+            *p++ = '.';
+            memcpy(p, digits + 1, len - 1);
+            p += len - 1;
+        }
+        *p++ = 'e';
+        *p++ = e < 0 ? '-' : '+';
+        if (e < 0)
+            e = -e;
+        if (e < 10)
+            *p++ = '0';
+        begin = FormatInt(tmp + sizeof(tmp), e);
+        memcpy(p, begin, tmp + sizeof(tmp) - begin);
+        p += tmp + sizeof(tmp) - begin;
+    }
+    return (int)(p - buf);
+}
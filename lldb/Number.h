@@ -0,0 +1,44 @@
+/******************************************************************************
+* Copyright (C) 2016 Wen Xichang.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#ifndef __NUMBER_H__
+#define __NUMBER_H__
+
+/*
+** Text of numbers sent to lldbg, without the printf family.
+*/
+
+/*
+** Write n in decimal backwards, ending at end(20 bytes at most are written).
+** Return where it begins.
+*/
+char * FormatInt(char * end, long long n);
+
+/*
+** Write a text of d that reads back as d into buf(32 bytes at least), the
+** shortest one in nearly all cases, return its length. Same as %.17g except
+** for the digits.
+*/
+int FormatNumber(char * buf, double d);
+
+#endif
@@ -1,124 +1,170 @@
-/******************************************************************************
-* Copyright (C) 2009 Zhang Lei.  All rights reserved.
-*
-* Permission is hereby granted, free of charge, to any person obtaining
-* a copy of this software and associated documentation files (the
-* "Software"), to deal in the Software without restriction, including
-* without limitation the rights to use, copy, modify, merge, publish,
-* distribute, sublicense, and/or sell copies of the Software, and to
-* permit persons to whom the Software is furnished to do so, subject to
-* the following conditions:
-*
-* The above copyright notice and this permission notice shall be
-* included in all copies or substantial portions of the Software.
-*
-* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
-* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
-* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
-* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
-* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
-* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
-* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-******************************************************************************/
-
-#include <assert.h>
-#include "Protocol.h"
-
-//For GetCurrentProcessId and getpid
-#ifdef OS_WIN
-#include <Windows.h>
-#else
-#include <unistd.h>
-#endif
-
-SOCKET Connect(const char * addrStr, unsigned short port)
-{
-    SOCKET s;
-    struct sockaddr_in addr;
-    assert(addrStr);
-
-    s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (s == INVALID_SOCKET) {
-        return INVALID_SOCKET;
-    }
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = inet_addr(addrStr);
-    addr.sin_port = htons(port);
-
-    if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR) {
-        closesocket(s);
-        return INVALID_SOCKET;
-    }
-    return s;
-}
-
-int SendBreak(SOCKET s, const char * file, int line, const char * fullpath)
-{
-    SocketBuf sb;
-#ifdef OS_WIN
-    int pid = GetCurrentProcessId();
-#else
-    int pid = getpid();
-#endif
-
-    SB_Init(&sb, s);
-    SB_Print(&sb, "BR\n%s\n%d\n%d\n%s\n\n", file, line, pid, fullpath);
-    SB_Add(&sb, "", 1); //Add the End-of-flow(EOF)
-    return SB_Send(&sb);
-}
-
-int SendQuit(SOCKET s)
-{
-    return SendData(s, "QT\n\n", sizeof("QT\n\n")); //Including the EOF
-}
-
-int SendErr(SOCKET s, const char * fmt, ...)
-{
-    SocketBuf sb;
-    va_list ap;
-
-    SB_Init(&sb, s);
-    SB_Add(&sb, "ER\n", sizeof("ER\n") - 1);
-    va_start(ap, fmt);
-    SB_VPrint(&sb, fmt, ap);
-    va_end(ap);
-    SB_Add(&sb, "\n", sizeof("\n")); //Include the End-of-flow(EOF)
-    return SB_Send(&sb);
-}
-
-int SendOK(SOCKET s, Writer writer, void * writerData)
-{
-    SocketBuf sb;
-    int rc = 0;
-
-    SB_Init(&sb, s);
-    SB_Add(&sb, "OK\n", sizeof("OK\n") - 1);
-    if (writer)
-        while ((rc = writer(writerData, &sb)) == 1);
-    SB_Add(&sb, "\n", sizeof("\n")); //Include the End-of-flow(EOF)
-    SB_Send(&sb);
-    return (rc == 0 && !sb.ioerr) ? 0 : (rc < 0 ? rc : -1);
-}
-
-int RecvCmd(SOCKET s, char * buf, int len)
-{
-    char * p = buf;
-    int avail = len;
-    int received = 0;
-
-    while (avail > 0) {
-        int l = recv(s, p, avail, 0);
-        if (l == SOCKET_ERROR)
-            return -1;
-
-        received += l;
-        if (p[l - 1] == 0)
-            return received - 1; //Return payload length, excluding the EOF character.
-
-        p += l;
-        avail -= l;
-    }
-
-    return -2;  //Too long
-}
-
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <string.h>
+#include "Protocol.h"
+
+#ifndef OS_WIN
+#include <stddef.h> //offsetof
+#include <sys/un.h>
+#endif
+
+SOCKET Connect(const char * addrStr, unsigned short port)
+{
+    SOCKET s;
+    struct sockaddr_in addr;
+    assert(addrStr);
+
+    s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(addrStr);
+    addr.sin_port = htons(port);
+
+    if (connect(s, (struct sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR) {
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+    return s;
+}
+
+#ifndef OS_WIN
+SOCKET ConnectUnix(const char * path)
+{
+    SOCKET s;
+    struct sockaddr_un addr;
+    int len = strlen(path);
+    assert(path);
+
+    if (len >= (int)sizeof(addr.sun_path))
+        return INVALID_SOCKET;
+
+    s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == INVALID_SOCKET) {
+        return INVALID_SOCKET;
+    }
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, len);
+    if (path[0] == '@')
+        addr.sun_path[0] = 0;
+
+    if (connect(s, (struct sockaddr *)&addr, offsetof(struct sockaddr_un, sun_path) + len) == SOCKET_ERROR) {
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+    return s;
+}
+#endif
+
+int SendBreak(SOCKET s, const char * file, int line, int pid, const char * fullpath)
+{
+    SocketBuf sb;
+
+    SB_Init(&sb, s, PROT_BREAK);
+    SB_Print(&sb, "%s\n%d\n%d\n%s\n", file, line, pid, fullpath);
+    return SB_Send(&sb);
+}
+
+int SendQuit(SOCKET s)
+{
+    SocketBuf sb;
+
+    SB_Init(&sb, s, PROT_QUIT);
+    return SB_Send(&sb);
+}
+
+int SendErr(SOCKET s, const char * fmt, ...)
+{
+    SocketBuf sb;
+    va_list ap;
+
+    SB_Init(&sb, s, PROT_ERR);
+    va_start(ap, fmt);
+    SB_VPrint(&sb, fmt, ap);
+    va_end(ap);
+    SB_Add(&sb, "\n", 1);
+    return SB_Send(&sb);
+}
+
+int SendOK(SOCKET s, Writer writer, void * writerData)
+{
+    SocketBuf sb;
+    int rc = 0;
+
+    SB_Init(&sb, s, PROT_OK);
+    if (writer)
+        while ((rc = writer(writerData, &sb)) == 1);
+    SB_Send(&sb);
+    return (rc == 0 && !sb.ioerr) ? 0 : (rc < 0 ? rc : -1);
+}
+
+/*
+** Receive exactly len bytes, return -1 on error or when the peer is closed.
+*/
+static int RecvAll(SOCKET s, char * buf, int len)
+{
+    while (len > 0) {
+        int l = recv(s, buf, len, 0);
+        if (l == SOCKET_ERROR || l == 0)
+            return -1;
+
+        buf += l;
+        len -= l;
+    }
+    return 0;
+}
+
+int RecvCmd(SOCKET s, char * buf, int len)
+{
+    unsigned char h[SB_HEAD_LEN];
+    unsigned int l;
+
+    if (RecvAll(s, (char *)h, SB_HEAD_LEN) < 0)
+        return -1;
+
+    if (h[0] != SB_VERSION || h[1] != PROT_CMD || !(h[2] & SB_FIN))
+        return -1;
+
+    l = ((unsigned int)h[4] << 24) | (h[5] << 16) | (h[6] << 8) | h[7];
+    if (l >= (unsigned int)len) {
+        //Too long, skip it to keep at the frame boundary
+        while (l > 0) {
+            int n = l < (unsigned int)len ? (int)l : len;
+            if (RecvAll(s, buf, n) < 0)
+                return -1;
+            l -= n;
+        }
+        return -2;
+    }
+
+    if (RecvAll(s, buf, (int)l) < 0)
+        return -1;
+
+    buf[l] = 0;
+    return (int)l;
+}
+
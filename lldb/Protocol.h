@@ -1,112 +1,132 @@
-/******************************************************************************
-* Copyright (C) 2009 Zhang Lei.  All rights reserved.
-*
-* Permission is hereby granted, free of charge, to any person obtaining
-* a copy of this software and associated documentation files (the
-* "Software"), to deal in the Software without restriction, including
-* without limitation the rights to use, copy, modify, merge, publish,
-* distribute, sublicense, and/or sell copies of the Software, and to
-* permit persons to whom the Software is furnished to do so, subject to
-* the following conditions:
-*
-* The above copyright notice and this permission notice shall be
-* included in all copies or substantial portions of the Software.
-*
-* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
-* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
-* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
-* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
-* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
-* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
-* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-******************************************************************************/
-
-#ifndef __PROTOCOL_H__
-#define __PROTOCOL_H__
-
-#include "Socket.h"
-#include "SocketBuf.h"
-
-/*
-** Max length of command from the controller, including the terminating zero.
-*/
-#define PROT_MAX_CMD_LEN 1024
-
-/*
-** Max number of arguments contained in one command. The command itself counts,
-** i.g. command "ll 2" containing 2 arguments.
-*/
-#define PROT_MAX_ARGS 8
-
-/*
-** Max length of string to be sent to controller, when a value of type string
-** presents.
-*/
-#define PROT_MAX_STR_LEN 256
-
-/*
-** Connect to a remote controller.
-*/
-SOCKET Connect(const char * addr, unsigned short port);
-
-/*
-** Send break message.
-** Return 0 when success, or -1 when socket error.
-**
-** Message format:
-** BR
-** File
-** Line Number
-**
-*/
-int SendBreak(SOCKET s, const char * file, int line, const char * fullpath);
-
-/*
-** Send quit message.
-**
-** Message format:
-** QT
-**
-*/
-int SendQuit(SOCKET s);
-
-/*
-** Respond with error.
-** Return 0 when success, or -1 when socket error.
-**
-** Message format:
-** ER
-** msg-body
-**
-*/
-int SendErr(SOCKET s, const char * fmt, ...);
-
-/*
-** User defined writer function. When called, should return 1 when there are
-** more data to write, and 0 when no more, and a negative when some error
-** happens. SendOK will return the code by writer. So a writer should not
-** return -1 in order to be distinguished from Socket IO Error(-1) returned by
-** SendOK.
-*/
-typedef int (* Writer)(void * writerData, SocketBuf * sb);
-
-/*
-** Respond with OK.
-** Return 0 when success, or -1 when socket error.
-**
-** Message format:
-** OK
-** msg-body
-**
-*/
-int SendOK(SOCKET s, Writer writer, void * writerData);
-
-/*
-** Wait for command from remote controller.
-** The comand must be a one-line text without a end-of-line character but a
-** terminating zero(EOF).
-** Return the payload length, excluding the end EOF character.
-*/
-int RecvCmd(SOCKET s, char * buf, int len);
-
-#endif
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#ifndef __PROTOCOL_H__
+#define __PROTOCOL_H__
+
+#include "Socket.h"
+#include "SocketBuf.h"
+
+/*
+** Message types, sent in the frame header(see SocketBuf.h).
+*/
+#define PROT_CMD 'C'
+#define PROT_BREAK 'B'
+#define PROT_QUIT 'Q'
+#define PROT_OK 'O'
+#define PROT_ERR 'E'
+
+/*
+** Max length of command from the controller, including the terminating zero.
+*/
+#define PROT_MAX_CMD_LEN 1024
+
+/*
+** Max length of a batch command(bb) from the controller, including the
+** terminating zero. Longer batches are split by the controller.
+*/
+#define PROT_MAX_BATCH_LEN 65536
+
+/*
+** Max number of arguments contained in one command. The command itself counts,
+** i.g. command "ll 2" containing 2 arguments.
+*/
+#define PROT_MAX_ARGS 8
+
+/*
+** Max length of string to be sent to controller, when a value of type string
+** presents. A string watched by w goes up to PROT_MAX_WATCH_STR_LEN.
+*/
+#define PROT_MAX_STR_LEN 256
+#define PROT_MAX_WATCH_STR_LEN (16 << 20)
+
+/*
+** Connect to a remote controller.
+*/
+SOCKET Connect(const char * addr, unsigned short port);
+
+#ifndef OS_WIN
+/*
+** Connect to a controller listening on a unix socket. A leading '@' names an
+** abstract socket(linux).
+*/
+SOCKET ConnectUnix(const char * path);
+#endif
+
+/*
+** Send break message.
+** Return 0 when success, or -1 when socket error.
+**
+** Message format(PROT_BREAK):
+** File
+** Line Number
+** Pid
+** Full path
+**
+*/
+int SendBreak(SOCKET s, const char * file, int line, int pid, const char * fullpath);
+
+/*
+** Send quit message.
+**
+** Message format(PROT_QUIT): empty
+*/
+int SendQuit(SOCKET s);
+
+/*
+** Respond with error.
+** Return 0 when success, or -1 when socket error.
+**
+** Message format(PROT_ERR):
+** msg-body
+*/
+int SendErr(SOCKET s, const char * fmt, ...);
+
+/*
+** User defined writer function. When called, should return 1 when there are
+** more data to write, and 0 when no more, and a negative when some error
+** happens. SendOK will return the code by writer. So a writer should not
+** return -1 in order to be distinguished from Socket IO Error(-1) returned by
+** SendOK.
+*/
+typedef int (* Writer)(void * writerData, SocketBuf * sb);
+
+/*
+** Respond with OK.
+** Return 0 when success, or -1 when socket error.
+**
+** Message format(PROT_OK):
+** msg-body
+*/
+int SendOK(SOCKET s, Writer writer, void * writerData);
+
+/*
+** Wait for command from remote controller.
+** The comand must be a single PROT_CMD frame, the payload is put in buf with a
+** terminating zero added.
+** Return the payload length, -1 on socket or protocol error, or -2 when the
+** command is too long, its payload is skipped then.
+*/
+int RecvCmd(SOCKET s, char * buf, int len);
+
+#endif
@@ -27,10 +27,19 @@
 #include <string.h>
 #include <ctype.h>
 #include "SocketBuf.h"
+#include "Number.h"
 
 #ifdef OS_LINUX
-#define _gcvt gcvt
-#define _CVTBUFSIZE 512
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+#include <netinet/tcp.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef OS_WIN
@@ -52,24 +61,333 @@ BOOL WINAPI DllMain(HINSTANCE hinstDLL, DWORD fdwReason, LPVOID lpvReserved)
 #endif
 
 
-void SB_Init(SocketBuf * sb, SOCKET s)
+void SB_Init(SocketBuf * sb, SOCKET s, int type)
 {
     sb->s = s;
-    sb->avail = SOCKET_BUF_CAP;
-    sb->p = sb->buf;
-    sb->ioerr = 0;
+    sb->type = type;
+    SB_Reset(sb);
 }
 
 void SB_Reset(SocketBuf * sb)
 {
-    sb->avail = SOCKET_BUF_CAP;
-    sb->p = sb->buf;
+    sb->avail = SOCKET_BUF_CAP - SB_HEAD_LEN;
+    sb->p = sb->buf + SB_HEAD_LEN;
     sb->ioerr = 0;
+    sb->ref = NULL;
+    sb->reflen = 0;
+}
+
+#ifdef OS_LINUX
+static SB_Ring * s_ring;
+static size_t s_ring_len;
+static SOCKET s_ring_sock = INVALID_SOCKET;
+
+int SB_MapRing(const char * path)
+{
+    struct stat st;
+    SB_Ring * r;
+    int fd = open(path, O_RDWR | O_CLOEXEC);
+
+    if (fd < 0)
+        return -1;
+    if (fstat(fd, &st) < 0 || st.st_size < (off_t)sizeof(SB_Ring)) {
+        close(fd);
+        return -1;
+    }
+
+    r = (SB_Ring *)mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (r == MAP_FAILED)
+        return -1;
+
+    if (!r->size || (r->size & (r->size - 1))
+        || offsetof(SB_Ring, data) + r->size > (size_t)st.st_size) {
+        munmap(r, st.st_size);
+        return -1;
+    }
+
+    SB_DetachRing();
+    s_ring = r;
+    s_ring_len = st.st_size;
+    return 0;
+}
+
+void SB_UseRing(SOCKET s)
+{
+    s_ring_sock = s;
+}
+
+void SB_DetachRing(void)
+{
+    if (s_ring)
+        munmap(s_ring, s_ring_len);
+    s_ring = NULL;
+    s_ring_sock = INVALID_SOCKET;
+}
+
+/*
+** Write data to the ring with plain stores, waiting for room when it's full.
+** The socket is touched only to wake a sleeping controller.
+*/
+static int SB_RingWrite(SOCKET s, const char * data, int len)
+{
+    static const char wake[SB_HEAD_LEN] = { SB_VERSION, SB_WAKE, SB_FIN };
+    SB_Ring * r = s_ring;
+    unsigned int mask = r->size - 1;
+
+    while (len > 0) {
+        unsigned int head = r->head;
+        unsigned int tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        unsigned int room = r->size - (head - tail);
+        unsigned int off = head & mask;
+        unsigned int n;
+
+        if (!room) {
+            struct timespec ts = { 0, 100 * 1000 * 1000 };
+            char c;
+
+            __atomic_store_n(&r->waiting, 1, __ATOMIC_SEQ_CST);
+            if (__atomic_load_n(&r->tail, __ATOMIC_SEQ_CST) == tail
+                && syscall(SYS_futex, &r->tail, FUTEX_WAIT, tail, &ts, NULL, 0) < 0
+                && errno == ETIMEDOUT
+                && recv(s, &c, 1, MSG_PEEK | MSG_DONTWAIT) == 0) {
+                return -1;  //The controller is gone
+            }
+            continue;
+        }
+
+        n = room < (unsigned int)len ? room : (unsigned int)len;
+        if (n > r->size - off)
+            n = r->size - off;
+        memcpy(r->data + off, data, n);
+        __atomic_store_n(&r->head, head + n, __ATOMIC_SEQ_CST);
+        data += n;
+        len -= n;
+
+        if (__atomic_exchange_n(&r->sleeping, 0, __ATOMIC_SEQ_CST)
+            && SendData(s, wake, SB_HEAD_LEN) < 0)
+            return -1;
+    }
+    return 0;
+}
+#endif
+
+static SOCKET s_lz_sock = INVALID_SOCKET;
+static int s_lz_min;
+
+void SB_UseLZ(SOCKET s, int threshold)
+{
+    s_lz_sock = s;
+    s_lz_min = threshold;
+}
+
+#define LZ_MIN_MATCH 4
+#define LZ_HASH_BITS 12
+
+static unsigned int read32(const unsigned char * p)
+{
+    unsigned int v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static unsigned char * lzLength(unsigned char * op, int n)
+{
+    for (; n >= 255; n -= 255)
+        *op++ = 255;
+    *op++ = (unsigned char)n;
+    return op;
+}
+
+/*
+** Put literals [anchor, ip) and a match of mlen bytes at offset off(none when
+** mlen is 0) to op, in LZ4 sequence format. Return the end, or NULL if it
+** won't fit before oend.
+*/
+static unsigned char * lzSequence(unsigned char * op, unsigned char * oend,
+    const unsigned char * anchor, const unsigned char * ip, int off, int mlen)
+{
+    int lit = (int)(ip - anchor);
+    unsigned char * token = op;
+
+    if (op + 1 + lit / 255 + 1 + lit + 2 + mlen / 255 + 1 > oend)
+        return NULL;
+
+    *op++ = (unsigned char)((lit >= 15 ? 15 : lit) << 4);
+    if (lit >= 15)
+        op = lzLength(op, lit - 15);
+    memcpy(op, anchor, lit);
+    op += lit;
+
+    if (mlen) {
+        mlen -= LZ_MIN_MATCH;
+        *op++ = (unsigned char)off;
+        *op++ = (unsigned char)(off >> 8);
+        *token |= mlen >= 15 ? 15 : mlen;
+        if (mlen >= 15)
+            op = lzLength(op, mlen - 15);
+    }
+    return op;
+}
+
+/*
+** Compress len bytes in src to dst, which has room for cap bytes; a greedy
+** LZ4 block compressor with a single entry hash table.
+** Return the compressed length, or 0 when it won't fit.
+*/
+static int lzCompress(const unsigned char * src, int len, unsigned char * dst, int cap)
+{
+    unsigned short tab[1 << LZ_HASH_BITS];
+    const unsigned char * ip = src;
+    const unsigned char * anchor = src;
+    const unsigned char * end = src + len;
+    unsigned char * op = dst;
+    unsigned char * oend = dst + cap;
+
+    memset(tab, 0, sizeof(tab));
+    while (end - ip >= LZ_MIN_MATCH) {
+        unsigned int seq = read32(ip);
+        unsigned int h = (seq * 2654435761u) >> (32 - LZ_HASH_BITS);
+        const unsigned char * ref = src + tab[h];
+        const unsigned char * m;
+
+        tab[h] = (unsigned short)(ip - src);
+        if (ref >= ip || read32(ref) != seq) {
+            ++ip;
+            continue;
+        }
+
+        for (m = ip + LZ_MIN_MATCH, ref += LZ_MIN_MATCH; m < end && *m == *ref; ++m, ++ref);
+        op = lzSequence(op, oend, anchor, ip, (int)(m - ref), (int)(m - ip));
+        if (!op)
+            return 0;
+        ip = anchor = m;
+    }
+
+    op = lzSequence(op, oend, anchor, end, 0, 0);
+    return op ? (int)(op - dst) : 0;
+}
+
+/*
+** Send a and b in one go.
+*/
+static int SendData2(SOCKET s, const void * a, int alen, const void * b, int blen)
+{
+#ifdef OS_LINUX
+    struct iovec iov[2];
+    struct msghdr msg;
+    struct iovec * v = iov;
+
+    iov[0].iov_base = (void *)a;
+    iov[0].iov_len = alen;
+    iov[1].iov_base = (void *)b;
+    iov[1].iov_len = blen;
+    memset(&msg, 0, sizeof(msg));
+
+    while (v < iov + 2) {
+        ssize_t sent;
+
+        msg.msg_iov = v;
+        msg.msg_iovlen = iov + 2 - v;
+        sent = sendmsg(s, &msg, 0);
+        if (sent == SOCKET_ERROR)
+            return -1;
+
+        //Skip what's sent
+        while (v < iov + 2 && (size_t)sent >= v->iov_len)
+            sent -= (v++)->iov_len;
+        if (v < iov + 2) {
+            v->iov_base = (char *)v->iov_base + sent;
+            v->iov_len -= sent;
+        }
+    }
+    return 0;
+#else
+    if (SendData(s, a, alen) < 0)
+        return -1;
+    return SendData(s, b, blen);
+#endif
+}
+
+/*
+** Send the content in buffer as a frame, followed by the data referenced, and
+** reset the buffer for the next one.
+*/
+static int SB_Flush(SocketBuf * sb, int flags)
+{
+    char z[SOCKET_BUF_CAP];
+    int rc;
+    unsigned int len = (unsigned int)(sb->p - sb->buf) - SB_HEAD_LEN;
+    unsigned char * h = (unsigned char *)sb->buf;
+    const char * ref = sb->ref;
+    unsigned int total = len + sb->reflen;
+
+    if (!ref && sb->s == s_lz_sock && len >= (unsigned int)s_lz_min) {
+        //Only when it's shorter, counting the data length
+        int zlen = lzCompress((unsigned char *)sb->buf + SB_HEAD_LEN, len,
+            (unsigned char *)z + SB_HEAD_LEN + 4, len - 5);
+        if (zlen > 0) {
+            h = (unsigned char *)z;
+            h[8] = (unsigned char)(len >> 24);
+            h[9] = (unsigned char)(len >> 16);
+            h[10] = (unsigned char)(len >> 8);
+            h[11] = (unsigned char)len;
+            len = total = zlen + 4;
+            flags |= SB_LZ;
+        }
+    }
+
+    h[0] = SB_VERSION;
+    h[1] = (unsigned char)sb->type;
+    h[2] = (unsigned char)flags;
+    h[3] = 0;
+    h[4] = (unsigned char)(total >> 24);
+    h[5] = (unsigned char)(total >> 16);
+    h[6] = (unsigned char)(total >> 8);
+    h[7] = (unsigned char)total;
+
+    sb->avail = SOCKET_BUF_CAP - SB_HEAD_LEN;
+    sb->p = sb->buf + SB_HEAD_LEN;
+    sb->ref = NULL;
+    sb->reflen = 0;
+#ifdef OS_LINUX
+    if (s_ring && sb->s == s_ring_sock) {
+        rc = SB_RingWrite(sb->s, (char *)h, SB_HEAD_LEN + len);
+        if (rc == 0 && ref)
+            rc = SB_RingWrite(sb->s, ref, total - len);
+    }
+    else
+#endif
+    if (ref)
+        rc = SendData2(sb->s, h, SB_HEAD_LEN + len, ref, total - len);
+    else
+        rc = SendData(sb->s, h, SB_HEAD_LEN + len);
+    if (rc < 0) {
+        sb->ioerr = 1;
+        return -1;
+    }
+    return 0;
 }
 
 int SB_Add(SocketBuf * sb, const void * data, int len)
 {
     const char * d = (const char *)data;
+
+    //Most adds fit
+    if (len <= sb->avail && !sb->ref && !sb->ioerr) {
+        memcpy(sb->p, d, len);
+        sb->p += len;
+        sb->avail -= len;
+        return 0;
+    }
+
+    if (sb->ioerr)
+        return -1;
+
+    //Keep the order, the data referenced goes first
+    if (sb->ref && SB_Flush(sb, 0) < 0)
+        return -1;
+
     while (len > 0) {
         int l = sb->avail >= len ? len : sb->avail;
         memcpy(sb->p, d, l);
@@ -81,23 +399,69 @@ int SB_Add(SocketBuf * sb, const void * data, int len)
         if (!len)
             break;
 
-        if (SendData(sb->s, sb->buf, SOCKET_BUF_CAP) < 0) {
-            sb->ioerr = 1;
+        if (SB_Flush(sb, 0) < 0)
             return -1;
-        }
-
-        sb->avail = SOCKET_BUF_CAP;
-        sb->p = sb->buf;
     }
     return 0;
 }
 
+int SB_EmitStr(SocketBuf * sb, const char * str)
+{
+    return SB_Add(sb, str, strlen(str));
+}
+
+int SB_EmitInt(SocketBuf * sb, int n)
+{
+    char buf[24];
+    char * begin = FormatInt(buf + sizeof(buf), n);
+    return SB_Add(sb, begin, buf + sizeof(buf) - begin);
+}
+
+int SB_EmitNum(SocketBuf * sb, double d)
+{
+    char buf[32];
+    return SB_Add(sb, buf, FormatNumber(buf, d));
+}
+
+int SB_EmitPtr(SocketBuf * sb, const void * p)
+{
+    char buf[24];
+    char * end = buf + sizeof(buf);
+    char * begin = end;
+    size_t n = (size_t)p;
+
+    do {
+        *--begin = "0123456789abcdef"[n & 0x0F];
+        n >>= 4;
+    } while (n);
+    *--begin = 'x';
+    *--begin = '0';
+    return SB_Add(sb, begin, end - begin);
+}
+
+int SB_AddRef(SocketBuf * sb, const void * data, int len)
+{
+    if (len < SOCKET_BUF_CAP || sb->s == s_lz_sock)
+        return SB_Add(sb, data, len);
+
+    //One reference a frame
+    if (sb->ref && SB_Flush(sb, 0) < 0)
+        return -1;
+
+    sb->ref = (const char *)data;
+    sb->reflen = len;
+    return 0;
+}
+
 /*
 ** Functions like SB_Add except that SB_AddRepeat repeats adding character ch count count,
 ** rather than adds a block of memory.
 */
 static int SB_AddRepeat(SocketBuf * sb, char ch, int count)
 {
+    if (sb->ref && SB_Flush(sb, 0) < 0)
+        return -1;
+
     while (count > 0) {
         int l = sb->avail >= count ? count : sb->avail;
         memset(sb->p, ch, l);
@@ -108,58 +472,8 @@ static int SB_AddRepeat(SocketBuf * sb, char ch, int count)
         if (!count)
             break;
 
-        if (SendData(sb->s, sb->buf, SOCKET_BUF_CAP) < 0) {
-            sb->ioerr = 1;
+        if (SB_Flush(sb, 0) < 0)
             return -1;
-        }
-
-        sb->avail = SOCKET_BUF_CAP;
-        sb->p = sb->buf;
-    }
-    return 0;
-}
-
-static char g_map[16] = {'0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f'};
-
-#define HB(ch) (((ch) >> 4) & 0x0F)
-#define LB(ch) ((ch) & 0x0F)
-
-#define ENCODE(buf, ch)\
-    do {\
-        (buf)[0] = g_map[HB(ch)]; \
-        (buf)[1] = g_map[LB(ch)]; \
-    } while (0);
-
-/*
-** Functions like SB_Add, but SB_AddQuote first encodes the input str, then adds
-** the encoded string to buffer. The encoding method is simple: represent the value
-** of a char variable in two ANSI readable characters. For example, if there's
-** char a = 0x80;
-** then encode(a) == "80"
-*/
-static int SB_AddQuote(SocketBuf * sb, const char * str, int len)
-{
-    const char * end = str + len;
-    while (str < end) {
-        //Fill buf in sb until the buf is full or end of str is reached.
-        while (sb->avail >= 2 && str < end) {
-            ENCODE(sb->p, *str);
-            sb->p += 2;
-            sb->avail -= 2;
-            ++str;
-        }
-        //Return if str is totally put into buf.
-        if (str == end)
-            break;
-
-        //Send current full buf in sb if there's more data in str.
-        if (SendData(sb->s, sb->buf, SOCKET_BUF_CAP - sb->avail) < 0) {
-            sb->ioerr = 1;
-            return -1;
-        }
-        //Reset sb for the next filling.
-        sb->avail = SOCKET_BUF_CAP;
-        sb->p = sb->buf;
     }
     return 0;
 }
@@ -209,7 +523,7 @@ static const char * nextArg(const char * fmt, char * flag, int * width,
         assert(ch != '.' && "Precision is not supported yet!");
         assert(ch != 'h' && ch != 'l' && ch != 'I' && "Type prefix is not supported yet!");
 
-        if (ch == 's' || ch == 'x' || ch == 'd' || ch == 'N' || ch == 'Q' || ch == 'p') {
+        if (ch == 's' || ch == 'x' || ch == 'd' || ch == 'N' || ch == 'R' || ch == 'p') {
             *type = ch;
             *endArg = ++p;
             break;
@@ -242,22 +556,12 @@ int SB_VPrint(SocketBuf * sb, const char * fmt, va_list ap)
         p = argEnd;
 
         if (type == 'd') {
-            int num;
-            char buf[33];
-
             assert(!flag && width == -1);
-            num = va_arg(ap, int);
-            sprintf(buf, "%d", num);
-            rc = SB_Add(sb, buf, strlen(buf));
+            rc = SB_EmitInt(sb, va_arg(ap, int));
         }
         else if (type == 'p') {
-            void *p;
-            char buf[33];
-            
             assert(!flag && width == -1);
-            p = va_arg(ap, void *);
-            sprintf(buf, "%p", p);
-            rc = SB_Add(sb, buf, strlen(buf));
+            rc = SB_EmitPtr(sb, va_arg(ap, void *));
         }
         else if (type == 'x') {
             unsigned int num;
@@ -280,26 +584,17 @@ int SB_VPrint(SocketBuf * sb, const char * fmt, va_list ap)
             rc = SB_Add(sb, str, strlen(str));
         }
         else if (type == 'N') {
-            double d;
-            char buf[_CVTBUFSIZE];
-            int len;
-
             assert(!flag && width == -1);
-            d = va_arg(ap, double);
-            _gcvt(d, 100, buf);
-            len = strlen(buf);
-            if (buf[len - 1] == '.')
-                --len;
-            rc = SB_Add(sb, buf, len);
+            rc = SB_EmitNum(sb, va_arg(ap, double));
         }
-        else if (type == 'Q') {
+        else if (type == 'R') {
             const char * str;
             int len;
 
             assert(!flag && width == -1);
             str = va_arg(ap, const char *);
             len = va_arg(ap, int);
-            rc = SB_AddQuote(sb, str, len);
+            rc = SB_AddRef(sb, str, len);
         }
 
         if (rc < 0)
@@ -325,13 +620,10 @@ int SB_Print(SocketBuf * sb, const char * fmt, ...)
 
 int SB_Send(SocketBuf * sb)
 {
-    int rc;
     if (sb->ioerr)
         return -1;
 
-    rc = SendData(sb->s, sb->buf, SOCKET_BUF_CAP - sb->avail);
-    sb->ioerr = rc < 0 ? 1 : 0;
-    return rc;
+    return SB_Flush(sb, SB_FIN);
 }
 
 int SendData(SOCKET s, const void * buf, int len)
@@ -346,3 +638,11 @@ int SendData(SOCKET s, const void * buf, int len)
     }
     return 0;
 }
+
+void SB_Cork(SOCKET s, int on)
+{
+#ifdef TCP_CORK
+    //Fails on a unix socket, which needs no corking anyway
+    setsockopt(s, IPPROTO_TCP, TCP_CORK, (const char *)&on, sizeof(on));
+#endif
+}
@@ -1,89 +1,185 @@
-/******************************************************************************
-* Copyright (C) 2009 Zhang Lei.  All rights reserved.
-*
-* Permission is hereby granted, free of charge, to any person obtaining
-* a copy of this software and associated documentation files (the
-* "Software"), to deal in the Software without restriction, including
-* without limitation the rights to use, copy, modify, merge, publish,
-* distribute, sublicense, and/or sell copies of the Software, and to
-* permit persons to whom the Software is furnished to do so, subject to
-* the following conditions:
-*
-* The above copyright notice and this permission notice shall be
-* included in all copies or substantial portions of the Software.
-*
-* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
-* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
-* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
-* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
-* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
-* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
-* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-******************************************************************************/
-
-#ifndef __SOCKETBUF_H__
-#define __SOCKETBUF_H__
-
-#include <stdarg.h>
-#include "Socket.h"
-
-#ifndef SOCKET_BUF_CAP
-#define SOCKET_BUF_CAP 4096
-#endif
-
-/*
-** NOTE:
-** The following functions with prefix SB_ all operates on a Socket Bufffer
-** defined immediately below. The main purpose of the series of function is to
-** reduce the times to call send and to provide convenient methods for sending
-** formatted string.
-** All these functions return a negative on failure, and zero on success.
-** IMPORTANT:
-** All these functions, when encounter a socket failure, will set an error flag(ioerr),
-** and the next call to these functions with ioerr set will fail. SB_Reset can
-** clear the error flag.
-*/
-typedef struct {
-    SOCKET s;
-    char * p;
-    int avail;
-    int ioerr;
-    char buf[SOCKET_BUF_CAP];
-} SocketBuf;
-
-/*
-** Init a Socket Buffer
-*/
-void SB_Init(SocketBuf * sb, SOCKET s);
-
-/*
-** Reset a Socket Buffer, that is, clear error flag and reset buffer state to init state.
-*/
-void SB_Reset(SocketBuf * sb);
-
-/*
-** Add a format string to buffer in a Socket Buffer. If the buffer is full, then
-** send the its content and rest the buffer and continue filling the buffer with
-** the rest of string.
-** The fmt argument specifies a format like printf does, but with more restriction
-** and some extension.
-*/
-int SB_Print(SocketBuf * sb, const char * fmt, ...);
-
-int SB_VPrint(SocketBuf * sb, const char * fmt, va_list ap);
-
-/*
-** Add data to buffer in a Socket Buffer. If the buffer is full, then send the
-** buffer's content and reset the buffer and continue filling the buffer with the
-** rest data.
-*/
-int SB_Add(SocketBuf * sb, const void * data, int len);
-
-/*
-** Send the content in buffer right now.
-*/
-int SB_Send(SocketBuf * sb);
-
-int SendData(SOCKET s, const void * buf, int len);
-
-#endif
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#ifndef __SOCKETBUF_H__
+#define __SOCKETBUF_H__
+
+#include <stdarg.h>
+#include "Socket.h"
+
+#ifndef SOCKET_BUF_CAP
+#define SOCKET_BUF_CAP 4096
+#endif
+
+/*
+** Data is sent in frames, each of which is a header followed by the payload:
+** byte 0       version, SB_VERSION
+** byte 1       message type
+** byte 2       flags, SB_FIN set in the last frame of a message, SB_LZ when the
+**              payload is compressed
+** byte 3       reserved, 0
+** byte 4-7     payload length, in network byte order
+** A message larger than a buffer is sent in several frames of the same type.
+*/
+#define SB_VERSION 1
+#define SB_FIN 0x01
+#define SB_LZ 0x02
+#define SB_HEAD_LEN 8
+
+/*
+** Compress the payload of frames sent by socket s which are threshold bytes or
+** longer, when that makes them shorter; INVALID_SOCKET turns it off. The payload
+** of a SB_LZ frame is the data length(4 bytes, network byte order) followed by
+** the data compressed in LZ4 style sequences.
+*/
+void SB_UseLZ(SOCKET s, int threshold);
+
+#ifdef OS_LINUX
+/*
+** Shared memory ring(same host only): once attached, the frames to the
+** controller are written to the ring instead of the socket, which then carries
+** the commands and a SB_WAKE frame when the controller sleeps on an empty ring.
+** Single producer(lldb) and single consumer(lldbg), head and tail count bytes
+** and wrap around; size is a power of 2. Same as SocketBuf.h of lldbg.
+*/
+#define SB_WAKE 'W'
+
+typedef struct {
+    unsigned int head;          //Written by the producer
+    char pad1[60];
+    unsigned int tail;          //Written by the consumer, futex of the producer
+    char pad2[60];
+    int sleeping;               //The consumer waits for a SB_WAKE frame
+    int waiting;                //The producer waits for room on the tail futex
+    unsigned int size;
+    char pad3[52];
+    char data[1];
+} SB_Ring;
+
+/*
+** Map the ring in file path, created by the controller.
+** Return 0 on success, or -1 on failure.
+*/
+int SB_MapRing(const char * path);
+
+/*
+** Send the frames of socket s through the mapped ring from now on.
+*/
+void SB_UseRing(SOCKET s);
+
+/*
+** Unmap the ring, when the session is closed.
+*/
+void SB_DetachRing(void);
+#endif
+
+/*
+** NOTE:
+** The following functions with prefix SB_ all operates on a Socket Bufffer
+** defined immediately below. The main purpose of the series of function is to
+** reduce the times to call send and to provide convenient methods for sending
+** formatted string.
+** All these functions return a negative on failure, and zero on success.
+** IMPORTANT:
+** All these functions, when encounter a socket failure, will set an error flag(ioerr),
+** and the next call to these functions with ioerr set will fail. SB_Reset can
+** clear the error flag.
+*/
+typedef struct {
+    SOCKET s;
+    int type;
+    char * p;
+    int avail;
+    int ioerr;
+    const char * ref;   //Sent in place after buf, in the same frame
+    int reflen;
+    char buf[SOCKET_BUF_CAP];
+} SocketBuf;
+
+/*
+** Init a Socket Buffer for a message of the type.
+*/
+void SB_Init(SocketBuf * sb, SOCKET s, int type);
+
+/*
+** Reset a Socket Buffer, that is, clear error flag and reset buffer state to init state.
+*/
+void SB_Reset(SocketBuf * sb);
+
+/*
+** Add a format string to buffer in a Socket Buffer. If the buffer is full, then
+** send the its content and rest the buffer and continue filling the buffer with
+** the rest of string.
+** The fmt argument specifies a format like printf does, but with more restriction
+** and some extension: %N for a lua number, %R for raw bytes(two arguments: buf
+** and length, sent as they are by SB_AddRef). %p is always 0x<hex>, NULL too.
+*/
+int SB_Print(SocketBuf * sb, const char * fmt, ...);
+
+int SB_VPrint(SocketBuf * sb, const char * fmt, va_list ap);
+
+/*
+** Add data to buffer in a Socket Buffer. If the buffer is full, then send the
+** buffer's content and reset the buffer and continue filling the buffer with the
+** rest data.
+*/
+int SB_Add(SocketBuf * sb, const void * data, int len);
+
+/*
+** Typed emitters for hot paths, the same text as the conversions of SB_Print
+** without a format to parse: SB_EmitLit for a string literal, SB_EmitStr for
+** %s, SB_EmitInt for %d, SB_EmitNum for %N and SB_EmitPtr for %p. Raw bytes(%R)
+** go by SB_AddRef.
+*/
+#define SB_EmitLit(sb, lit) SB_Add((sb), (lit), sizeof(lit) - 1)
+
+int SB_EmitStr(SocketBuf * sb, const char * str);
+
+int SB_EmitInt(SocketBuf * sb, int n);
+
+int SB_EmitNum(SocketBuf * sb, double d);
+
+int SB_EmitPtr(SocketBuf * sb, const void * p);
+
+/*
+** Add data to a Socket Buffer by reference: the data is sent in place right
+** after the content of the buffer, in the same frame and by one vectored send,
+** when the buffer is sent. It must stay unchanged until then. Short data is
+** just copied, and so is the data of a compressed socket(see SB_UseLZ).
+*/
+int SB_AddRef(SocketBuf * sb, const void * data, int len);
+
+/*
+** Send the content in buffer right now, as the last frame of the message.
+*/
+int SB_Send(SocketBuf * sb);
+
+int SendData(SOCKET s, const void * buf, int len);
+
+/*
+** Hold back partial frames on socket s while on is set, so that the replies
+** to a batch of commands leave in as few packets as possible(tcp on linux).
+*/
+void SB_Cork(SOCKET s, int on);
+
+#endif
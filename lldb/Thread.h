@@ -0,0 +1,96 @@
+/******************************************************************************
+* Copyright (C) 2016 Wen Xichang.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#ifndef __THREAD_H__
+#define __THREAD_H__
+
+/*
+** Minimal lock, condition variable, one-time init and atomic wrappers, used
+** when lua states registered to the debugger run on different threads.
+*/
+#if defined(OS_WIN)
+#include <windows.h>
+
+typedef CRITICAL_SECTION MUTEX;
+typedef CONDITION_VARIABLE COND;
+
+#define MUTEX_INIT(m)       InitializeCriticalSection(m)
+#define MUTEX_LOCK(m)       EnterCriticalSection(m)
+#define MUTEX_UNLOCK(m)     LeaveCriticalSection(m)
+
+#define COND_INIT(c)        InitializeConditionVariable(c)
+#define COND_WAIT(c, m)     SleepConditionVariableCS((c), (m), INFINITE)
+#define COND_BROADCAST(c)   WakeAllConditionVariable(c)
+
+#define THREAD_LOCAL        __declspec(thread)
+
+typedef INIT_ONCE ONCE;
+
+#define ONCE_INIT           INIT_ONCE_STATIC_INIT
+#define CALL_ONCE(o, f)     InitOnceExecuteOnce((o), callOnce, (PVOID)(f), NULL)
+
+//Acquire loads and release stores of an int or a pointer read without the lock
+#define ATOMIC_LOAD(p)          InterlockedCompareExchange((LONG volatile *)(p), 0, 0)
+#define ATOMIC_STORE(p, v)      InterlockedExchange((LONG volatile *)(p), (v))
+#define ATOMIC_LOAD_PTR(p)      InterlockedCompareExchangePointer((PVOID volatile *)(p), NULL, NULL)
+#define ATOMIC_STORE_PTR(p, v)  InterlockedExchangePointer((PVOID volatile *)(p), (PVOID)(v))
+
+static BOOL CALLBACK callOnce(PINIT_ONCE once, PVOID f, PVOID * ctx)
+{
+    ((void (*)(void))f)();
+    return TRUE;
+}
+
+#elif defined(OS_LINUX)
+#include <pthread.h>
+
+typedef pthread_mutex_t MUTEX;
+typedef pthread_cond_t COND;
+
+#define MUTEX_INIT(m)       pthread_mutex_init((m), NULL)
+#define MUTEX_LOCK(m)       pthread_mutex_lock(m)
+#define MUTEX_UNLOCK(m)     pthread_mutex_unlock(m)
+
+#define COND_INIT(c)        pthread_cond_init((c), NULL)
+#define COND_WAIT(c, m)     pthread_cond_wait((c), (m))
+#define COND_BROADCAST(c)   pthread_cond_broadcast(c)
+
+#define THREAD_LOCAL        __thread
+
+typedef pthread_once_t ONCE;
+
+#define ONCE_INIT           PTHREAD_ONCE_INIT
+#define CALL_ONCE(o, f)     pthread_once((o), (f))
+
+//Acquire loads and release stores of an int or a pointer read without the lock
+#define ATOMIC_LOAD(p)          __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE(p, v)      __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define ATOMIC_LOAD_PTR(p)      __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ATOMIC_STORE_PTR(p, v)  __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+#else
+#error "Nonsupport OS!"
+
+#endif
+
+#endif
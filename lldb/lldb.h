@@ -0,0 +1,54 @@
+/******************************************************************************
+* Copyright (C) 2016 Wen Xichang.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#ifndef __LLDB_H__
+#define __LLDB_H__
+
+#include <lua.h>
+
+/*
+** Embedding API, for hosts running their own event loop. The host registers
+** its states and polls the control descriptor, so an attach is handled at a
+** point the host chooses and no signal is involved.
+*/
+
+/*
+** Register L to the debugger, same as require "lldb" in L.
+** Return 0.
+*/
+int lldb_register_state(lua_State * L);
+
+/*
+** Return a descriptor to add to the host's poll/epoll set, it turns readable
+** when lldbg asks to attach. Return -1 when not supported(windows).
+** Once created, the attach signal(SIGUSR2 or LDB_SIG) is ignored.
+*/
+int lldb_control_fd(void);
+
+/*
+** Handle attach requests pending on the control descriptor, never blocks.
+** Return 1 when lldbg asked to attach, the states break on their next line.
+*/
+int lldb_poll(void);
+
+#endif
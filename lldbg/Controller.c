@@ -1,1401 +1,3320 @@
-/******************************************************************************
-* Copyright (C) 2009 Zhang Lei.  All rights reserved.
-* Modification work Copyright (C) 2016 Wen Xichang.
-*
-* Permission is hereby granted, free of charge, to any person obtaining
-* a copy of this software and associated documentation files (the
-* "Software"), to deal in the Software without restriction, including
-* without limitation the rights to use, copy, modify, merge, publish,
-* distribute, sublicense, and/or sell copies of the Software, and to
-* permit persons to whom the Software is furnished to do so, subject to
-* the following conditions:
-*
-* The above copyright notice and this permission notice shall be
-* included in all copies or substantial portions of the Software.
-*
-* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
-* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
-* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
-* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
-* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
-* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
-* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-******************************************************************************/
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <ctype.h>
-#include <assert.h>
-#include <string.h>
-#include <errno.h>
-#include <signal.h>
-#include "Socket.h"
-#include "SocketBuf.h"
-#include "Dump.h"
-
-#ifndef OS_WIN
-#include <sys/types.h>
-#include <signal.h>
-#endif
-
-typedef enum
-{
-    CMD_INVALID = -1,
-    CMD_STEP = 0,
-    CMD_NEXT,
-    CMD_OUT,
-    CMD_RUN,
-    CMD_LISTL,
-    CMD_LISTU,
-    CMD_LISTG,
-    CMD_PRINTSTACK,
-    CMD_WATCH,
-    CMD_EXEC,
-    CMD_SETB,
-    CMD_DELB,
-    CMD_LISTB,
-    CMD_MEMORY,
-    CMD_ENB,
-    CMD_DISB,
-    CMD_HELP,
-    CMD_FRAME,
-    CMD_ASD,
-    CMD_LS,
-} CmdType;
-
-/*
-** THIS ARRAY MUST CORRESPOND EXACTLY TO THE ABOVE ENUM TYPE!!!
-*/
-const char * g_cmds[] =
-{
-    "s",
-    "n",
-    "o",
-    "r",
-    "ll",
-    "lu",
-    "lg",
-    "ps",
-    "w",
-    "e",
-    "sb",
-    "db",
-    "lb",
-    "m",
-    "en",
-    "dis",
-    "h",
-    "frame",
-    "asd",
-    "ls",
-    0,
-};
-
-//Connected peer is a localhost address
-static int s_local;
-//Remote pid, send via BREAK command
-static int s_remote_pid;
-
-#ifdef OS_WIN
-#define snprintf    _snprintf
-#define putenv      _putenv
-#else
-#define DEF_SIG     SIGUSR2
-static int s_ldb_sig = DEF_SIG;
-#endif
-
-#define MAX_SRCPATH 512
-static char *s_src_paths[MAX_SRCPATH];
-static int s_nsrc_path;
-
-static void mainloop(SOCKET s);
-static int extractArgs(char * buf, char * argv[]);
-static CmdType validateArgs(char * argv[], int argc);
-static int sendCmd(SOCKET s, CmdType t, char * argv[], int argc);
-static int waitForBreakOrQuit(SocketBuf * sb, const char ** file, const char ** lineno, const char ** fullpath);
-static int waitForResponseFirstLine(SocketBuf * sb);
-static int showError(SocketBuf * sb);
-static int listL(SocketBuf * sb);
-static int printStack(SocketBuf * sb);
-static int watch(SocketBuf * sb);
-static int listB(SocketBuf * sb);
-static int watchM(SocketBuf * sb, char * argv[], int argc);
-static void showHelp();
-
-#define CMD_LINE 1024
-#define MAX_ARGS 8
-
-static int Usage(const char *cmd)
-{
-    printf("Original RLdb 2.0.0 Copyright (C) 2009 Zhang Lei(louirobert@gmail.com) All rights reserved\n"
-        "Modified lldbg 1.0 Copyright (C) 2016 Wen Xichang(wenxichang@163.com)\n"
-        "Usage:\n"
-        "    %s [options] <command> [args]\n"
-        "Options:\n"
-        "    -a,--addr <XXX.XXX.XXX.XXX>   -- specify listening address\n"
-        "    --port <XXXX>                 -- specify listening port\n"
-        "    -s,--source <dir>             -- add source dir\n"
-        "    -p,--pid <pid>                -- attach to process\n", cmd);
-    exit(1);
-}
-
-#ifdef OS_WIN
-static int initSocket()
-{
-    WSADATA wsaData;
-    return WSAStartup(MAKEWORD(2, 2), &wsaData) ? -1 : 0;
-}
-
-void uninitSocket()
-{
-    WSACleanup();
-}
-
-#else
-#define initSocket() 0
-#define uninitSocket()
-#endif
-
-static void addSourceDir(const char *dir)
-{
-    if (s_nsrc_path < MAX_SRCPATH) {
-        s_src_paths[s_nsrc_path] = strdup(dir);
-        if (s_src_paths[s_nsrc_path])
-            s_nsrc_path++;
-    }
-}
-
-static int isLocalConnection(SOCKET s)
-{
-    struct sockaddr_in peer, sock;
-#ifdef OS_LINUX
-    socklen_t len;
-#else
-    int len;
-#endif
-    len = sizeof(peer);
-    getpeername(s, (struct sockaddr *)&peer, &len);
-    len = sizeof(sock);
-    getsockname(s, (struct sockaddr *)&sock, &len);
-    return memcmp(&peer.sin_addr, &sock.sin_addr, sizeof(peer.sin_addr)) == 0;
-}
-
-static int notifyRemote(int pid)
-{
-#ifdef OS_WIN
-    char name[128];
-    HANDLE notify;
-
-    sprintf(name, "Global\\lldb_sigevent_%d", pid);
-
-    notify = OpenEventA(EVENT_MODIFY_STATE, FALSE, name);
-    if (notify == NULL) {
-        printf("\nNot local debugging or remote pid is not avaiable\n?>");
-        return -1;
-    }
-
-    SetEvent(notify);
-    CloseHandle(notify);
-    return 0;
-#else
-    return kill((pid_t)pid, s_ldb_sig);
-#endif
-}
-
-static void interrupt(int sig)
-{
-    if (s_local && s_remote_pid > 0 ) {
-        if (notifyRemote(s_remote_pid)) {
-            printf("\nFailed to interrupt process: %d\n?>", s_remote_pid);
-        }
-    } else {
-        printf("\nNot local debugging or remote pid is not avaiable\n?>");
-    }
-
-#ifdef OS_WIN
-    signal(SIGINT, interrupt);
-#endif
-}
-
-#ifdef OS_WIN
-#define APPEND(s) do {                   \
-    int ls = strlen(s);                  \
-    if (sizeof(argbuf) - bi > ls) {      \
-        memcpy(&argbuf[bi], (s), ls);    \
-        bi += ls;                        \
-        argbuf[bi] = 0;                  \
-    }                                    \
-} while(0)
-
-static HANDLE s_child_process = NULL;
-
-static void termChild()
-{
-    if (s_child_process)
-        TerminateProcess(s_child_process, 1);
-}
-
-static void startProgram(int argc, char * argv[])
-{
-    char argbuf[2048];
-    int bi = 0;
-    int i;
-    STARTUPINFOA sinfo;
-    PROCESS_INFORMATION pinfo;
-
-    assert(argc > 0);
-
-    APPEND("\"");
-    APPEND(argv[0]);
-    APPEND("\"");
-
-    for (i = 1; i < argc; ++i) {
-        APPEND(" ");
-        APPEND(argv[i]);
-    }
-
-    ZeroMemory(&sinfo, sizeof(STARTUPINFOA));
-
-    //Child process will not process CTRL+C
-    SetConsoleCtrlHandler(NULL, TRUE);
-    if (CreateProcessA(NULL, argbuf, NULL, NULL, FALSE, 0, NULL, NULL, &sinfo, &pinfo) == FALSE) {
-        printf("Can not execute: %s", argbuf);
-        exit(1);
-    }
-
-    //Restore ours
-    SetConsoleCtrlHandler(NULL, FALSE);
-    s_child_process = pinfo.hProcess;
-
-    atexit(termChild);
-}
-#else
-static void startProgram(int argc, char * argv[])
-{
-    pid_t pid;
-    
-    assert(argc > 0);
-
-    if ((pid = fork()) < 0) {
-        perror("fork");
-        exit(1);
-    }
-
-    if (pid == 0) {
-        setpgid(0, 0);        //Dont need SIGINT from shell
-        execvp(argv[0], (char *const *)argv);
-        perror("exec");
-        exit(1);
-    }
-}
-#endif
-
-#define NEXT_ARG()    do { i++; if (i >= argc) Usage(argv[0]); }while(0)
-
-int main(int argc, char * argv[])
-{
-    SOCKET s;
-    SOCKET a;
-    struct sockaddr_in addr;
-    char addrStr[64] = {0};
-    unsigned short port = 0;
-    int prog_idx = 0;
-    int prog_pid = 0;
-
-#ifdef OS_LINUX
-    const char *sig = getenv("LDB_SIG");
-    
-    if (sig && atoi(sig))
-        s_ldb_sig = atoi(sig);
-#endif
-
-    if (argc > 1) {
-        int i = 1;
-        for (; i < argc; i++) {
-            if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
-                Usage(argv[0]);
-            }
-            else if (!strcmp(argv[i], "-a") || !strcmp(argv[i], "--addr")) {
-                NEXT_ARG();
-                strncpy(addrStr, argv[i], 63);
-                addrStr[63] = 0;
-            }
-            else if (!strcmp(argv[i], "--port")) {
-                NEXT_ARG();
-                port = (unsigned short)atoi(argv[i]);
-            }
-            else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--pid")) {
-                NEXT_ARG();
-                prog_pid = atoi(argv[i]);
-                if (prog_pid <= 0)
-                    Usage(argv[0]);
-            }
-            else if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--source")) {
-                NEXT_ARG();
-                addSourceDir(argv[i]);
-            }
-            else {
-                prog_idx = i;
-                break;        //Stop parsing
-            }
-        }
-    }
-    if (addrStr[0] == 0)
-        strcpy(addrStr, "127.0.0.1");
-    if (port == 0)
-        port = 2679;
-
-    if (initSocket()) {
-        printf("initSocket failed!\n");
-        return -1;
-    }
-
-    s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
-    if (s == INVALID_SOCKET) {
-        printf("Socket error!\n");
-        uninitSocket();
-        return -1;
-    }
-
-#if defined(OS_LINUX) && defined(SO_REUSEADDR)
-    {
-        int reuse = 1;
-        if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse)) < 0)
-            perror("setsockopt(SO_REUSEADDR) failed");
-    }
-#endif
-
-    addr.sin_family = AF_INET;
-    addr.sin_addr.s_addr = inet_addr(addrStr);
-    addr.sin_port = htons(port);
-
-    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR
-        || listen(s, 1) == SOCKET_ERROR) {
-        printf("Socket error!\nIP %s Port %d\n", addrStr, (int)port);
-        closesocket(s);
-        uninitSocket();
-        return -1;
-    }
-
-    if (prog_pid > 0) {
-        notifyRemote(prog_pid);
-    }
-    else if (prog_idx > 0) {
-        putenv("LDB_STARTUP=1");
-        startProgram(argc - prog_idx, &argv[prog_idx]);
-    }
-    else {
-        printf("<command> or -p <pid> is required.\n\n");
-        Usage(argv[0]);
-    }
-
-    printf("Original RLdb 2.0.0 Copyright (C) 2009 Zhang Lei\n");
-    printf("Modified lldbg 1.0 Copyright (C) 2016 Wen Xichang\n");
-    printf("Waiting at %s:%d for remote debuggee...\n", addrStr, (int)port);
-    do {
-        a = accept(s, NULL, NULL);
-    } while (a == SOCKET_ERROR);
-
-    s_local = isLocalConnection(a);
-    signal(SIGINT, interrupt);
-    
-    if (s_local) {
-        printf("Connected from localhost!\n");
-    } else {
-        printf("Connected from remote host!\n");
-    }
-    
-    closesocket(s);
-    mainloop(a);
-    closesocket(a);
-    uninitSocket();
-    return 0;
-}
-
-static FILE *checkFile(const char * path, const char ** err)
-{
-    FILE *fp;
-    
-    fp = fopen(path, "r");
-    if (!fp) {
-        *err = strerror(errno);
-        return NULL;
-    }
-    
-    if (fgetc(fp) == 0x1b) {    //Precompiled bytecode(lua/luajit)
-        fclose(fp);
-        *err = "Binary source file";
-        return NULL;
-    }
-    
-    rewind(fp);
-    return fp;
-}
-
-static FILE *getFile(const char *file, const char * fullpath, const char ** err)
-{
-    FILE *fp;
-    int i;
-    *err = NULL;
-    
-    if (fullpath) {
-        if ((fp = checkFile(fullpath, err)))
-            return fp;
-    }
-    
-    for (i = 0; i < s_nsrc_path; ++i) {
-        char path[1024];
-        snprintf(path, sizeof(path), "%s/%s", s_src_paths[i], file);
-        if ((fp = checkFile(path, err)))
-            return fp;
-    }
-    
-    if (*err == NULL)
-        *err = "No such file or directory";
-    
-    return NULL;
-}
-
-static void showSource(const char * file, int lineno, const char * fullpath, int count)
-{
-    int i;
-    FILE *fp;
-    char linebuf[4096];
-    const char *err = NULL;
-    
-    assert(file);
-    
-    fp = getFile(file, fullpath, &err);
-    if (!fp) {
-        printf("%s: %s\n", file, err);
-        return;
-    }
-    
-    for (i = 0; i < lineno - 1; ++i) {
-        fgets(linebuf, sizeof(linebuf), fp);
-    }
-    
-    for (i = 0; i < count; ++i) {
-        if (fgets(linebuf, sizeof(linebuf), fp)) {
-            char *p = strchr(linebuf, '\n');
-            if (p)
-                *p = 0;
-            
-            p = strchr(linebuf, '\r');
-            if (p)
-                *p = 0;
-            
-            printf("%d: %s\n", lineno, linebuf);
-            lineno++;
-        }
-    }
-    
-    fclose(fp);
-}
-
-static int ls(const char * file, int line, const char * fullpath, int argc, const char ** argv)
-{
-    int count = 10;
-    if (argc == 2) {
-        line = atoi(argv[1]);
-    } else if (argc == 3) {
-        file = argv[1];
-        line = atoi(argv[2]);
-        fullpath = NULL;
-    } else if (argc == 4) {
-        file = argv[1];
-        line = atoi(argv[2]);
-        count = atoi(argv[3]);
-        fullpath = NULL;
-    }
-    
-    if (line <= 0)
-        line = 1;
-    if (count <= 0)
-        count = 10;
-    
-    showSource(file, line, fullpath, count);
-    return line + count;
-}
-
-void mainloop(SOCKET s)
-{
-    SocketBuf sb;
-    char frame[12] = { 0 };
-    
-    SB_Init(&sb, s);
-    
-    /* setup default frame */
-    frame[0] = '1';
-    
-    while (1) {
-        int rc;
-        const char * _file;
-        const char * _lineno;
-        const char * _fullpath;
-        int line = 1;
-        char file[128];
-        char fullpath[1024];
-        
-        //Wait for a BREAK or QUIT message...
-        rc = waitForBreakOrQuit(&sb, &_file, &_lineno, &_fullpath);
-        if (rc < 0) {
-            printf("Socket or protocol error!\n");
-            break;
-        }
-        if (!rc) {
-            printf("Remote script is over!\n");
-            break;
-        }
-        
-        line = atoi(_lineno);
-        strncpy(file, _file, sizeof(file));
-        file[sizeof(file) - 1] = 0;
-        strncpy(fullpath, _fullpath, sizeof(fullpath));
-        fullpath[sizeof(fullpath) - 1] = 0;
-        
-        printf("Break At \"%s:%d\"\n", file, line);
-        showSource(file, line, fullpath, 1);
-        
-        while (1) {
-            char buf[CMD_LINE];
-            char * argv[MAX_ARGS];
-            int argc;
-            CmdType t = CMD_INVALID;
-
-            //Prompt user...
-            printf("?>");
-            fgets(buf, CMD_LINE, stdin);
-            if ((argc = extractArgs(buf, argv)) > 0)
-                t = validateArgs(argv, argc);
-            if (argc < 1 || t == CMD_INVALID) {
-                printf("Invalid command! Type 'h' for help.\n");
-                continue;
-            }
-
-            if (t == CMD_HELP) {
-                showHelp();
-                continue;
-            }
-
-            if (t == CMD_FRAME) {
-                if (argc == 2) {
-                    strncpy(frame, argv[1], sizeof(frame));
-                    frame[sizeof(frame) - 1] = 0;
-                } else {
-                    printf("Current default level: %s\n", frame);
-                }
-                continue;
-            }
-            
-            if (t == CMD_ASD) {
-                if (argc == 2) {
-                    addSourceDir(argv[1]);
-                }
-                continue;
-            }
-            
-            if (t == CMD_LS) {
-                line = ls(file, line, fullpath, argc, (const char **)argv);
-                continue;
-            }
-            
-            //Setup default level
-            if (argc == 1 && (t == CMD_LISTL || t == CMD_LISTG || t == CMD_LISTU)) {
-                argv[argc++] = frame;
-                printf("Use default level: %s\n", frame);
-            }
-            
-            //Send command...
-            if (sendCmd(s, t, argv, argc) < 0) {
-                printf("Socket error!\n");
-                return;
-            }
-
-            if (t == CMD_STEP || t == CMD_OUT || t == CMD_RUN || t == CMD_NEXT)
-                break;
-
-            //Wait for result message...
-            rc = waitForResponseFirstLine(&sb);
-            if (rc < 0) {
-                printf("Socket or protocol error!\n");
-                return;
-            }
-
-            //Show result...
-            if (rc == 0) {
-                if (showError(&sb) < 0) {
-                    printf("Socket or protocol error!\n");
-                    return;
-                }
-                continue;
-            }
-
-            switch (t) {
-                case CMD_LISTL:
-                case CMD_LISTU:
-                case CMD_LISTG:
-                {
-                    rc = listL(&sb);
-                    break;
-                }
-
-                case CMD_PRINTSTACK: {
-                    rc = printStack(&sb);
-                    break;
-                }
-
-                case CMD_WATCH: {
-                    rc = watch(&sb);
-                    break;
-                }
-//
-//                case CMD_EXEC: {
-//                    rc = exec(&sb);
-//                    break;
-//                }
-//
-                case CMD_SETB:
-                case CMD_DELB:
-                case CMD_ENB:
-                case CMD_DISB:
-                {
-                    //No content in this case, so read out the rest and drop it.
-                    rc = SB_Read(&sb, SB_R_LEFT);
-                    assert(sb.end);
-                    break;
-                }
-
-                case CMD_LISTB: {
-                    rc = listB(&sb);
-                    break;
-                }
-
-                case CMD_MEMORY: {
-                    rc = watchM(&sb, argv, argc);
-                    break;
-                }
-
-                default: {
-                    assert(0 && "Impossibility!");
-                }
-            }
-
-            if (rc < 0) {
-                printf("Socket or protocol error!\n");
-                return;
-            }
-        }
-    }
-}
-
-int extractArgs(char * buf, char * argv[])
-{
-    char * p = buf;
-    int argc = 0;
-
-    while (*p && argc < MAX_ARGS) {
-        while (isspace(*p))
-            ++p;
-        if (!*p)
-            break;
-
-        argv[argc++] = p;
-        if (*p != '"') {
-            while (!isspace(*p) && *p)
-                ++p;
-            if (isspace(*p))
-                *p++ = 0;
-        }
-        else {
-            while (*++p != '"' && *p);
-            if (!*p)
-                return -1;  //End '"' not found!
-            *++p = 0;
-            ++p;
-        }
-    }
-    return argc;
-}
-
-static int allDigits(char * str)
-{
-    while (isdigit(*str))
-        ++str;
-    return *str ? 0 : 1;
-}
-
-CmdType validateArgs(char * argv[], int argc)
-{
-    CmdType t = CMD_INVALID;
-
-    if (argc > 0) {
-        char * p = argv[0];
-
-        if (!strcmp(p, "s")) {
-            if (argc == 1)
-                t = CMD_STEP;
-        }
-        else if (!strcmp(p, "n")) {
-            if (argc == 1)
-                t = CMD_NEXT;
-        }
-        else if (!strcmp(p, "o")) {
-            if (argc == 1)
-                t = CMD_OUT;
-        }
-        else if (!strcmp(p, "r") || !strcmp(p, "c")) {
-            if (argc == 1)
-                t = CMD_RUN;
-        }
-        else if (!strcmp(p, "ll")) {
-            if (argc == 1 || (argc == 2 && allDigits(argv[1])))
-                t = CMD_LISTL;
-        }
-        else if (!strcmp(p, "lu")) {
-            if (argc == 1 || (argc == 2 && allDigits(argv[1])))
-                t = CMD_LISTU;
-        }
-        else if (!strcmp(p, "lg")) {
-            if (argc == 1 || (argc == 2 && allDigits(argv[1])))
-                t = CMD_LISTG;
-        }
-        else if (!strcmp(p, "w")) {
-            if (argc > 1) {
-                if (allDigits(argv[1]) && argc > 3 && argv[2][1] == 0
-                    && (argv[2][0] == 'l' || argv[2][0] == 'u' || argv[2][0] == 'g')) {
-                    if (argc == 5) {
-                        if (argv[4][0] == 'r' && argv[4][1] == 0)
-                            t = CMD_WATCH;
-                    }
-                    else if (argc == 4)
-                        t = CMD_WATCH;
-                }
-                else if (argv[1][0] == '|') {
-                    if (argc == 3) {
-                        if (argv[2][0] == 'r' && argv[2][1] == 0)
-                            t = CMD_WATCH;
-                    }
-                    else if (argc == 2)
-                        t = CMD_WATCH;
-                }
-            }
-        }
-        else if (!strcmp(p, "ps") || !strcmp(p, "bt")) {
-            if (argc == 1)
-                t = CMD_PRINTSTACK;
-        }
-        else if (!strcmp(p, "sb") || !strcmp(p, "b")) {
-            if (argc == 3 && allDigits(argv[2]))
-                t = CMD_SETB;
-        }
-        else if (!strcmp(p, "db")) {
-            if (argc == 2 && allDigits(argv[1]))
-                t = CMD_DELB;
-        }
-        else if (!strcmp(p, "lb")) {
-            if (argc == 1)
-                t = CMD_LISTB;
-        }
-        else if (!strcmp(p, "dis")) {
-            if (argc == 2 && allDigits(argv[1]))
-                t = CMD_DISB;
-        }
-        else if (!strcmp(p, "en")) {
-            if (argc == 2 && allDigits(argv[1]))
-                t = CMD_ENB;
-        }
-        else if (!strcmp(p, "m")) {
-            if (argc == 3) {
-                char * end;
-                char * end2;
-                strtoul(argv[1], &end, 0);
-                strtoul(argv[2], &end2, 0);
-                if (!*end && !*end2)
-                    t = CMD_MEMORY;
-            }
-        }
-        else if (!strcmp(p, "h")) {
-            t = CMD_HELP;
-        }
-        else if (!strcmp(p, "f")) {
-            if (argc == 1 || (argc == 2 && allDigits(argv[1])))
-                t = CMD_FRAME;
-        }
-        else if (!strcmp(p, "asd")) {
-            if (argc == 2)
-                t = CMD_ASD;
-        }
-        else if (!strcmp(p, "ls") || !strcmp(p, "l")) {
-            t = CMD_LS;
-        }
-        else if (!strcmp(p, "q") || !strcmp(p, "quit")) {
-            printf("Bye\n");
-            exit(0);
-        }
-    }
-    return t;
-}
-
-static int SendData(SOCKET s, const char * buf, int len)
-{
-    while (len > 0) {
-        int sent = send(s, buf, len, 0);
-        if (sent == SOCKET_ERROR)
-            return -1;
-        len -= sent;
-        buf += sent;
-    }
-    return 0;
-}
-
-int sendCmd(SOCKET s, CmdType t, char * argv[], int argc)
-{
-    //The buffer size is exactly the same with the one used by fgets in main().
-    //So it's convenient to use strcat without worrying about buffer overflow!
-    char cmdline[CMD_LINE];
-    const char * cmd = g_cmds[t];
-    int i;
-
-    strcpy(cmdline, cmd);
-    for (i = 1; i < argc; i++) {
-        strcat(cmdline, " ");
-        strcat(cmdline, argv[i]);
-    }
-
-    return SendData(s, cmdline, strlen(cmdline) + 1);
-}
-
-int waitForBreakOrQuit(SocketBuf * sb, const char ** file, const char ** lineno, const char ** fullpath)
-{
-    int rc;
-    char * p = sb->lbuf;
-    
-    rc = SB_Read(sb, SB_R_LEFT);
-    if (rc < 0 || !sb->end)
-        return -1;
-
-    if (!strncmp(p, "BR\n", 3)) {
-        p += 3;
-        *file = p;
-        p = strchr(p, '\n');
-        if (!p)
-            return -1;
-        *p++ = 0;
-        *lineno = p;
-        p = strchr(p, '\n');
-        if (!p)
-            return -1;
-        *p++ = 0;
-        s_remote_pid = atoi(p);
-        p = strchr(p, '\n');
-        if (!p)
-            return -1;
-        *p++ = 0;
-        *fullpath = p;
-        p = strchr(p, '\n');
-        if (!p)
-            return -1;
-        *p = 0;
-        return 1;
-    }
-    else if (!strcmp(p, "QT\n\n")) {
-        return 0;
-    }
-    return -1;
-}
-
-int waitForResponseFirstLine(SocketBuf * sb)
-{
-    char * p = sb->lbuf;
-    if (SB_Read(sb, 3) < 0)
-        return -1;
-    if (!strncmp(p, "OK\n", 3)) {
-        return 1;
-    }
-    else if (!strncmp(p, "ER\n", 3)) {
-        return 0;
-    }
-    return -1;
-}
-
-int showError(SocketBuf * sb)
-{
-    char * p = sb->lbuf;
-    if (SB_Read(sb, SB_R_LEFT) < 0 || !sb->end)
-        return -1;
-
-    fprintf(stdout, "%s", p);
-    return 0;
-}
-
-typedef enum
-{
-    LV_NAME = 1,
-    LV_VALUE
-} State_lv;
-
-static int lv(State_lv * st, const char * str, int length);
-
-int listL(SocketBuf * sb)
-{
-    State_lv st = LV_NAME;
-    return SB_ReadAndParse(sb, "\n", (UserParser)lv, &st);
-}
-
-static const char * typestr(char t)
-{
-    const char * tstr;
-    switch (t) {
-        case 's':
-            tstr = "STR";
-            break;
-        case 'n':
-            tstr = "NUM";
-            break;
-        case 't':
-            tstr = "TAB";
-            break;
-        case 'f':
-            tstr = "FNC";
-            break;
-        case 'u':
-            tstr = "URD";
-            break;
-        case 'U':
-            tstr = "LUD";
-            break;
-        case 'b':
-            tstr = "BLN";
-            break;
-        case 'l':
-            tstr = "NIL";
-            break;
-        case 'd':
-            tstr = "THD";
-            break;
-        default:
-            tstr = "";
-    }
-    return tstr;
-}
-
-static void output(const char * str, int length)
-{
-    int i;
-    for (i = 0; i < length; ++i)
-        fputc(str[i], stdout);
-}
-
-#define dec(ch) \
-    ((ch) >= '0' && (ch) <= '9' ? (ch) - '0' : (ch) - 'a' + 10)
-
-#define decode(s, ch) \
-    do {\
-        ch = (dec((s)[0]) << 4) | dec((s)[1]);\
-    } while (0);
-
-static void outputEncStr(const char * str, int length)
-{
-    const char * end = str + length;
-    char ch;
-    for (; str < end; str += 2) {
-        decode(str, ch);
-        fputc(ch, stdout);
-    }
-}
-
-static int outputStr(const char * str, int length)
-{
-    const char * end = str + length;
-    const char * p = strchr(str, ':');
-    int len;
-    if (!p || p > end)
-        return -1;
-    output(str, p - str);
-    str = p + 1;
-    fputs(" Length:", stdout);
-    p = strchr(str, ':');
-    if (!p || p > end)
-        return -1;
-    output(str, p - str);
-    fputs(" Truncated-to:", stdout);
-    str = p + 1;
-    p = strchr(str, ':');
-    if (!p || p > end)
-        return -1;
-    output(str, p - str);
-    fputs(" Content:", stdout);
-    len = strtol(str, NULL, 10);
-    str = p + 1;
-    if (end - str != len * 2)
-        return -1;
-    outputEncStr(str, end - str);
-    return 0;
-}
-
-static int printVar(const char * str, int length)
-{
-    const char * tstr = typestr(str[0]);
-    if (*tstr == 0)
-        return -1;
-
-    fprintf(stdout, "Type:%s \tValue:", tstr);
-    switch(str[0]) {
-        case 's': {
-            if (outputStr(str + 1, length - 1) < 0)
-                return -1;
-            break;
-        }
-
-        case 'n':
-        case 'b':
-        case 't':
-        case 'f':
-        case 'u':
-        case 'U':
-        case 'd':
-        {
-            output(str + 1, length - 1);
-            break;
-        }
-
-        case 'l':
-            fprintf(stdout, "nil");
-            break;
-    }
-    return 0;
-}
-
-int lv(State_lv * st, const char * str, int length)
-{
-    if (*st == LV_NAME) {
-        fprintf(stdout, "Name:");
-        output(str, length);
-        fputc(' ', stdout);
-        fputc('\t', stdout);
-        *st = LV_VALUE;
-    }
-    else {
-        if (printVar(str, length) < 0)
-            return -3;
-
-        fputc('\n', stdout);
-        *st = LV_NAME;
-    }
-    return 0;
-}
-
-typedef enum
-{
-    PS_FILE,
-    PS_LINE,
-    PS_NAME,
-    PS_WHAT
-} State_ps;
-
-static int ps(State_ps * st, const char * word, int length);
-
-int printStack(SocketBuf * sb)
-{
-    State_ps st = PS_FILE;
-    return SB_ReadAndParse(sb, "\n", (UserParser)ps, &st);
-}
-
-int ps(State_ps * st, const char * word, int length)
-{
-    switch (*st) {
-        case PS_FILE: {
-            fputs("At \"", stdout);
-            output(word, length);
-            fputc(':', stdout);
-            *st = PS_LINE;
-            break;
-        }
-        case PS_LINE: {
-            output(word, length);
-            fputs("\" \t", stdout);
-            *st = PS_NAME;
-            break;
-        }
-        case PS_NAME: {
-            output(word, length);
-            fputs(" \t", stdout);
-            *st = PS_WHAT;
-            break;
-        }
-        case PS_WHAT: {
-            output(word, length);
-            fputc('\n', stdout);
-            *st = PS_FILE;
-            break;
-        }
-    }
-    return 0;
-}
-
-typedef enum
-{
-    W_VAR = 1,  //for all
-    W_META,     //for all
-    W_KEY,      //for table
-    W_VAL,      //for table
-    W_SIZE,     //for full userdata
-    W_WHAT,     //for function
-    W_SRC,      //for function
-    W_FIRSTLINE,//for function
-    W_LASTLINE, //for function
-    W_STATUS    //for thread
-} State_w;
-
-typedef struct
-{
-    State_w st;
-    State_w st2;    //What state after W_META
-} Arg_w;
-
-static int w(Arg_w * args, const char * word, int length);
-
-int watch(SocketBuf * sb)
-{
-    Arg_w args = { W_VAR, 0 };
-    return SB_ReadAndParse(sb, "\n", (UserParser)w, &args);
-}
-
-int w(Arg_w * args, const char * word, int length)
-{
-    switch (args->st) {
-        case W_KEY: {
-            fputs("--------------------------------------------------\n", stdout);
-            if (printVar(word, length) < 0)
-                return -3;
-            fputc('\n', stdout);
-            args->st = W_VAL;
-            break;
-        }
-
-        case W_VAL: {
-            if (printVar(word, length) < 0)
-                return -3;
-            fputc('\n', stdout);
-            args->st = W_KEY;
-            break;
-        }
-
-        case W_VAR: {
-            if (printVar(word, length) < 0)
-                return -3;
-            fputc('\n', stdout);
-            args->st = W_META;
-            switch (word[0]) {
-                case 't': {
-                    args->st2 = W_KEY;
-                    break;
-                }
-                case 'u': {
-                    args->st2 = W_SIZE;
-                    break;
-                }
-                case 'f': {
-                    args->st2 = W_WHAT;
-                    break;
-                }
-                case 'd': {
-                    args->st2 = W_STATUS;
-                    break;
-                }
-                default: {
-                    args->st2 = 0;
-                }
-            }
-            break;
-        }
-
-        case W_META: {
-            if (length != 1)
-                return -3;
-
-            if (word[0] == '1') {
-                fputs("HasMetatable:Yes\n", stdout);
-            }
-            else {
-                fputs("HasMetatable:No\n", stdout);
-            }
-            args->st = args->st2;
-            break;
-        }
-
-        case W_SIZE: {
-            fputs("Size:", stdout);
-            output(word, length);
-            fputc('\n', stdout);
-            args->st = 0;
-            break;
-        }
-
-        case W_WHAT: {
-            fputs("What:", stdout);
-            output(word, length);
-            args->st = W_SRC;
-            break;
-        }
-
-        case W_SRC: {
-            fputs(" \tFile:", stdout);
-            output(word, length);
-            args->st = W_FIRSTLINE;
-            break;
-        }
-
-        case W_FIRSTLINE: {
-            fputs(" \tLineDefined:", stdout);
-            output(word, length);
-            args->st = W_LASTLINE;
-            break;
-        }
-
-        case W_LASTLINE: {
-            fputs(" \tLastLine:", stdout);
-            output(word, length);
-            fputc('\n', stdout);
-            args->st = 0;
-            break;
-        }
-
-        case W_STATUS: {
-            fputs("Status:", stdout);
-            output(word, length);
-            fputc('\n', stdout);
-            args->st = 0;
-            break;
-        }
-
-        default: {
-            return -3;
-        }
-    }
-    return 0;
-}
-
-typedef enum
-{
-    LB_IDX,
-    LB_FILE,
-    LB_LINE,
-    LB_ENABLE,
-} State_lb;
-
-static int lb(State_lb * st, const char * word, int length);
-
-int listB(SocketBuf * sb)
-{
-    State_lb st = LB_IDX;
-    return SB_ReadAndParse(sb, "\n", (UserParser)lb, &st);
-}
-
-int lb(State_lb * st, const char * word, int length)
-{
-    switch (*st) {
-    case LB_IDX:
-        output(word, length);
-        fputs(". ", stdout);
-        *st = LB_FILE;
-        break;
-    case LB_FILE:
-        fputc('"', stdout);
-        output(word, length);
-        fputc(':', stdout);
-        *st = LB_LINE;
-        break;
-    case LB_LINE:
-        output(word, length);
-        fputs("\"", stdout);
-        *st = LB_ENABLE;
-        break;
-    case LB_ENABLE:
-        fputs(*word == '0' ? ", disable\n" : ", enable\n", stdout);
-        *st = LB_IDX;
-        break;
-    default:
-        assert(0);
-    }
-    return 0;
-}
-
-#define PROVIDER_BUF_SIZE 1024
-
-typedef struct
-{
-    SOCKET s;
-    unsigned int len;
-    char buf[PROVIDER_BUF_SIZE];
-} Arg_wm;
-
-static int provide(Arg_wm * args, const char ** buf, unsigned int * size);
-
-int watchM(SocketBuf * sb, char * argv[], int argc)
-{
-    unsigned int addr = strtoul(argv[1], NULL, 0);
-    unsigned int len;
-    char * end;
-    Arg_wm args;
-
-    if (SB_Read(sb, 9) < 0 || sb->end)
-        return -1;
-
-    len = strtoul(sb->lbuf, &end, 16);
-    if (len == 0 || *end != '\n' || sb->lbuf + 8 != end)
-        return -2;
-
-    args.s = sb->s;
-    args.len = len;
-    return Dump(addr, (DataProvider)provide, &args, stdout, NULL, NULL);
-}
-
-int provide(Arg_wm * args, const char ** buf, unsigned int * size)
-{
-    if (args->len > 0) {
-        int l = recv(args->s, args->buf,
-            args->len < PROVIDER_BUF_SIZE ? args->len : PROVIDER_BUF_SIZE, 0);
-        if (l == SOCKET_ERROR || !l)
-            return -1;
-        args->len -= l;
-        *size = l;
-        *buf = args->buf;
-        return 1;
-    }
-    return 0;
-}
-
-static const char *HELP_CONTENT =
-"RLdb 2.0.0 Copyright (C) 2009 Zhang Lei(louirobert@gmail.com) All rights reserved.\n"
-"Modified lldbg 1.0 Copyright (C) 2016 Wen Xichang(wenxichang@163.com)\n"
-"\n"
-"Valid commands:\n"
-"  sb or b <file-path> <line-no>       -- Set a breakpoint\n"
-"  db <index>                          -- Delete a breakpoint(lb to list breakpoint)\n"
-"  en <index>                          -- Enable a breakpoint\n"
-"  dis <index>                         -- Disable a breakpoint\n"
-"  lb                                  -- List breakpoints\n"
-"  f <stack-level>                     -- Set default stack-level for lg/ll/lu\n"
-"  lg [stack-level]                    -- List globals\n"
-"  ll [stack-level]                    -- List locals\n"
-"  lu [stack-level]                    -- List upvalues\n"
-"  m <start-address> <length>          -- Watch memory\n"
-"  n                                   -- Run to next line\n"
-"  o                                   -- Step out\n"
-"  ps or bt                            -- Print calling stack\n"
-"  r or c                              -- Run program until a breakpoint\n"
-"  s                                   -- Step into\n"
-"  w <stack-level> <l|u|g> <variable-name>[properties] [r]\n"
-"    or w <properties> [r]             -- Watch a variable\n"
-"  asd <source-dir>                    -- Add source dir for source searching\n"
-"  ls [file] [lineno] [count]          -- View source code\n"
-"\n"
-"  q or quit                           -- Quit debugger\n"
-"  ctrl+c                              -- Break program(local host only)\n";
-
-void showHelp()
-{
-    fputs(HELP_CONTENT, stdout);
-}
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+* Modification work Copyright (C) 2016 Wen Xichang.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <ctype.h>
+#include <assert.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include "Socket.h"
+#include "SocketBuf.h"
+#include "Controller.h"
+#include "Dump.h"
+
+#ifndef OS_WIN
+#include <sys/types.h>
+#include <sys/un.h>
+#include <signal.h>
+#include <stddef.h>
+#include <fcntl.h>
+#include "Dap.h"
+#endif
+
+#ifdef OS_LINUX
+#include <stdio_ext.h>
+#endif
+
+typedef enum
+{
+    CMD_INVALID = -1,
+    CMD_STEP = 0,
+    CMD_NEXT,
+    CMD_OUT,
+    CMD_RUN,
+    CMD_LISTL,
+    CMD_LISTU,
+    CMD_LISTG,
+    CMD_PRINTSTACK,
+    CMD_WATCH,
+    CMD_EXEC,
+    CMD_SETB,
+    CMD_DELB,
+    CMD_LISTB,
+    CMD_MEMORY,
+    CMD_ENB,
+    CMD_DISB,
+    CMD_HELP,
+    CMD_FRAME,
+    CMD_ASD,
+    CMD_LS,
+    CMD_STATE,
+    CMD_BUDGET,
+    CMD_RELOAD,
+    CMD_BLOAD,
+    CMD_BSAVE,
+    CMD_QUIT,
+    CMD_WNEXT,
+    CMD_SESSIONS,
+    CMD_FOCUS,
+    CMD_ON,
+    CMD_REFRESH,
+} CmdType;
+
+/*
+** THIS ARRAY MUST CORRESPOND EXACTLY TO THE ABOVE ENUM TYPE!!!
+*/
+const char * g_cmds[] =
+{
+    "s",
+    "n",
+    "o",
+    "r",
+    "ll",
+    "lu",
+    "lg",
+    "ps",
+    "w",
+    "e",
+    "sb",
+    "db",
+    "lb",
+    "m",
+    "en",
+    "dis",
+    "h",
+    "frame",
+    "asd",
+    "ls",
+    "st",
+    "pb",
+    "reload",
+    "bload",
+    "bsave",
+    "q",
+    "wn",
+    "ss",
+    "focus",
+    "on",
+    "refresh",
+    0,
+};
+
+//Connected peer is a localhost address
+static int s_local;
+//Remote pid, send via BREAK command
+static int s_remote_pid;
+
+Session g_sessions[MAX_SESSION];
+int g_nsession;
+static int s_nseen;
+
+//The session asked by focus, served next
+static int s_focus_pid;
+
+//Breakpoints "<file> <line> [options]" set by sb, bload or --breakpoints,
+//set in every debuggee when it breaks
+#define MAX_FLEET_BP 1024
+static char *s_fleet_bps[MAX_FLEET_BP];
+static int s_nfleet_bp;
+
+#ifdef OS_WIN
+#define snprintf    _snprintf
+#define putenv      _putenv
+#else
+#define DEF_SIG     SIGUSR2
+static int s_ldb_sig = DEF_SIG;
+
+//Listening unix socket(lldbg --unix)
+static char s_unix_path[108];
+
+//lldbg --no-ring, replies of unix socket sessions come by the socket too
+static int s_no_ring;
+#endif
+
+//Listening socket, debuggees connect to it
+static SOCKET s_listen = INVALID_SOCKET;
+
+//Seconds to wait for a reply of a paused debuggee before dropping it, 0 to wait
+//for ever, by lldbg --timeout
+#define DEF_TIMEOUT 0
+static int s_timeout = DEF_TIMEOUT;
+
+#ifndef OS_WIN
+//Self-pipe, the SIGINT handler writes a byte to [1] for the loops to serve
+static int s_sigpipe[2] = { -1, -1 };
+#endif
+
+//Compress replies of 0 no sessions, 1 remote sessions, 2 all sessions,
+//by lldbg --no-compress/--compress
+static int s_compress = 1;
+
+//Frames shorter than this are sent as they are
+#define LZ_THRESHOLD 512
+
+#define MAX_SRCPATH 512
+static char *s_src_paths[MAX_SRCPATH];
+static int s_nsrc_path;
+
+static void mainloop(SOCKET l);
+static int waitReply(SOCKET s);
+static int extractArgs(char * buf, char * argv[]);
+static CmdType validateArgs(char * argv[], int argc);
+static int watchArgs(char * argv[], int argc);
+static void pageWatch(char * argv[], int * argc);
+static int formatCmd(char * cmdline, CmdType t, char * argv[], int argc);
+static int sendCmd(SOCKET s, CmdType t, char * argv[], int argc);
+static int loadBreakpoints(const char * path);
+static int waitForBreakOrQuit(SocketBuf * sb, const char ** file, const char ** lineno, const char ** fullpath);
+static int showError(SocketBuf * sb);
+static int listL(SocketBuf * sb);
+static int printStack(SocketBuf * sb);
+static int watch(SocketBuf * sb);
+static int listB(SocketBuf * sb);
+static int watchM(SocketBuf * sb, char * argv[], int argc);
+static int listS(SocketBuf * sb);
+static int listPB(SocketBuf * sb);
+static int listRL(SocketBuf * sb);
+static int allDigits(char * str);
+static void output(const char * str, int length);
+static void showHelp();
+
+#define CMD_LINE 1024
+#define MAX_ARGS 8
+
+//Same as PROT_MAX_BATCH_LEN of lldb
+#define MAX_BATCH 65536
+
+//Pairs of a table shown by w at a time, wn for the next page
+#define W_PAGE "100"
+
+//The last w without its offset and limit, and where its next page starts(-1
+//when there's none)
+static char s_w_base[CMD_LINE];
+static int s_w_limit;
+static int s_w_next = -1;
+
+//Raw bytes of a string still to come, see outputStr
+static int s_raw;
+
+//Replies of the queries at the current stop(ps, ll, lu, lg, w and m) by the
+//command sent, shown again without a round trip. Dropped when the debuggee
+//runs or another one is served, and by refresh.
+typedef struct
+{
+    char * cmd;
+    int type;       //PROT_OK or PROT_ERR
+    char * data;
+    int len;
+} CachedReply;
+
+#define MAX_CACHED 256
+#define MAX_CACHED_BYTES (16 << 20)
+static CachedReply s_cache[MAX_CACHED];
+static int s_ncache;
+static int s_cache_bytes;
+static SB_Rec s_rec;
+static SocketBuf s_replay;
+
+//Commands typed on one line, separated by ';'. The ones after a resume command
+//are left for the next break.
+typedef struct
+{
+    char buf[CMD_LINE];
+    char * argv[MAX_ARGS];
+    int argc;
+    CmdType t;
+    int sent;       //Sent ahead, the reply is on its way
+    char line[CMD_LINE + 16];   //As sent
+    CachedReply * cached;       //Not sent, the reply is shown from the cache
+} QueuedCmd;
+
+#define MAX_QUEUE 16
+static QueuedCmd s_queue[MAX_QUEUE];
+static int s_nqueue;
+static int s_iqueue;
+
+#ifndef OS_WIN
+//Bytes typed and not taken as lines yet, and whether stdin is closed
+static char s_in[CMD_LINE * 4];
+static int s_nin;
+static int s_eof;
+#endif
+
+static int Usage(const char *cmd)
+{
+    printf("Original RLdb 2.0.0 Copyright (C) 2009 Zhang Lei(louirobert@gmail.com) All rights reserved\n"
+        "Modified lldbg 1.0 Copyright (C) 2016 Wen Xichang(wenxichang@163.com)\n"
+        "Usage:\n"
+        "    %s [options] <command> [args]\n"
+        "Options:\n"
+        "    -a,--addr <XXX.XXX.XXX.XXX>   -- specify listening address\n"
+        "    --port <XXXX>                 -- specify listening port\n"
+        "    --unix <path>                 -- listen on a unix socket(linux, @ leads an abstract name,\n"
+        "                                     @ alone for the default one of debuggee/lldbg pid)\n"
+        "    --no-ring                     -- don't use shared memory for replies of --unix sessions\n"
+        "    --compress                    -- compress big replies of local sessions too(remote ones by default)\n"
+        "    --no-compress                 -- never compress replies\n"
+        "    --timeout <secs>              -- drop a paused debuggee not replying in time(0 by default, to wait for ever)\n"
+        "    -s,--source <dir>             -- add source dir\n"
+        "    -p,--pid <pid>                -- attach to process\n"
+        "    --non-stop                    -- a break pauses only the lua state hitting it\n"
+        "    --breakpoints <file>          -- set the breakpoints in file(see bload) at the first break\n"
+        "    --dap                         -- serve an editor by the debug adapter protocol on stdin/stdout\n"
+        "                                     (not windows), output goes to stderr\n", cmd);
+    exit(1);
+}
+
+#ifdef OS_WIN
+static int initSocket()
+{
+    WSADATA wsaData;
+    return WSAStartup(MAKEWORD(2, 2), &wsaData) ? -1 : 0;
+}
+
+void uninitSocket()
+{
+    WSACleanup();
+}
+
+#else
+#define initSocket() 0
+#define uninitSocket()
+#endif
+
+static void addSourceDir(const char *dir)
+{
+    if (s_nsrc_path < MAX_SRCPATH) {
+        s_src_paths[s_nsrc_path] = strdup(dir);
+        if (s_src_paths[s_nsrc_path])
+            s_nsrc_path++;
+    }
+}
+
+static int isLocalConnection(SOCKET s)
+{
+    struct sockaddr_in peer, sock;
+#ifdef OS_LINUX
+    socklen_t len;
+#else
+    int len;
+#endif
+    len = sizeof(peer);
+    //A unix socket, or an ipv4 one
+    if (getsockname(s, (struct sockaddr *)&sock, &len) == 0 && sock.sin_family != AF_INET)
+        return 1;
+    len = sizeof(peer);
+    getpeername(s, (struct sockaddr *)&peer, &len);
+    len = sizeof(sock);
+    getsockname(s, (struct sockaddr *)&sock, &len);
+    return memcmp(&peer.sin_addr, &sock.sin_addr, sizeof(peer.sin_addr)) == 0;
+}
+
+#ifndef OS_WIN
+/*
+** The attach signal kills a process not loading lldb, make sure it does.
+*/
+static int hasAgent(int pid)
+{
+    char path[64];
+    char line[1024];
+    FILE *fp;
+    int found = 0;
+
+    snprintf(path, sizeof(path), "/proc/%d/maps", pid);
+    fp = fopen(path, "r");
+    if (!fp)
+        return 0;
+
+    while (!found && fgets(line, sizeof(line), fp)) {
+        const char *name = strrchr(line, '/');
+        found = name && !strncmp(name + 1, "lldb", 4);
+    }
+    fclose(fp);
+    return found;
+}
+#endif
+
+/*
+** Ask pid to attach, check it loads lldb before signaling when checkAgent is set.
+*/
+int notifyRemote(int pid, int checkAgent)
+{
+#ifdef OS_WIN
+    char name[128];
+    HANDLE notify;
+
+    sprintf(name, "Global\\lldb_sigevent_%d", pid);
+
+    notify = OpenEventA(EVENT_MODIFY_STATE, FALSE, name);
+    if (notify == NULL) {
+        printf("\nNot local debugging or remote pid is not avaiable\n?>");
+        return -1;
+    }
+
+    SetEvent(notify);
+    CloseHandle(notify);
+    return 0;
+#else
+    struct sockaddr_un addr;
+    socklen_t len;
+    SOCKET s;
+
+    //A host polling lldb_control_fd attaches at a safe point, try it first
+    s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s != INVALID_SOCKET) {
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        len = offsetof(struct sockaddr_un, sun_path) + 1
+            + snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1, "lldb_ctl_%d", pid);
+        if (connect(s, (struct sockaddr *)&addr, len) == 0) {
+            closesocket(s);
+            return 0;
+        }
+        closesocket(s);
+    }
+
+    if (checkAgent && !hasAgent(pid)) {
+        printf("Process %d has not loaded lldb!\n", pid);
+        return -1;
+    }
+    return kill((pid_t)pid, s_ldb_sig);
+#endif
+}
+
+static void interruptRemote(void)
+{
+    if (s_local && s_remote_pid > 0 ) {
+        if (notifyRemote(s_remote_pid, 0)) {
+            printf("\nFailed to interrupt process: %d\n?>", s_remote_pid);
+        }
+    } else {
+        printf("\nNot local debugging or remote pid is not avaiable\n?>");
+    }
+    fflush(stdout);
+}
+
+static void interrupt(int sig)
+{
+#ifdef OS_WIN
+    interruptRemote();
+    signal(SIGINT, interrupt);
+#else
+    //Nothing but write is safe here, the loops do the rest
+    int e = errno;
+    char c = (char)sig;
+    if (write(s_sigpipe[1], &c, 1) < 0) {
+        //Full, an interrupt is pending already
+    }
+    errno = e;
+#endif
+}
+
+#ifndef OS_WIN
+static int setupInterrupt(void)
+{
+    if (pipe(s_sigpipe) < 0)
+        return -1;
+    fcntl(s_sigpipe[0], F_SETFL, O_NONBLOCK);
+    fcntl(s_sigpipe[1], F_SETFL, O_NONBLOCK);
+    fcntl(s_sigpipe[0], F_SETFD, FD_CLOEXEC);
+    fcntl(s_sigpipe[1], F_SETFD, FD_CLOEXEC);
+    signal(SIGINT, interrupt);
+    return 0;
+}
+#else
+#define setupInterrupt() (signal(SIGINT, interrupt), 0)
+#endif
+
+#ifdef OS_WIN
+#define APPEND(s) do {                   \
+    int ls = strlen(s);                  \
+    if (sizeof(argbuf) - bi > ls) {      \
+        memcpy(&argbuf[bi], (s), ls);    \
+        bi += ls;                        \
+        argbuf[bi] = 0;                  \
+    }                                    \
+} while(0)
+
+static HANDLE s_child_process = NULL;
+
+static void termChild()
+{
+    if (s_child_process)
+        TerminateProcess(s_child_process, 1);
+}
+
+static void startProgram(int argc, char * argv[])
+{
+    char argbuf[2048];
+    int bi = 0;
+    int i;
+    STARTUPINFOA sinfo;
+    PROCESS_INFORMATION pinfo;
+
+    assert(argc > 0);
+
+    APPEND("\"");
+    APPEND(argv[0]);
+    APPEND("\"");
+
+    for (i = 1; i < argc; ++i) {
+        APPEND(" ");
+        APPEND(argv[i]);
+    }
+
+    ZeroMemory(&sinfo, sizeof(STARTUPINFOA));
+
+    //Child process will not process CTRL+C
+    SetConsoleCtrlHandler(NULL, TRUE);
+    if (CreateProcessA(NULL, argbuf, NULL, NULL, FALSE, 0, NULL, NULL, &sinfo, &pinfo) == FALSE) {
+        printf("Can not execute: %s", argbuf);
+        exit(1);
+    }
+
+    //Restore ours
+    SetConsoleCtrlHandler(NULL, FALSE);
+    s_child_process = pinfo.hProcess;
+
+    atexit(termChild);
+}
+#else
+static void startProgram(int argc, char * argv[])
+{
+    pid_t pid;
+    
+    assert(argc > 0);
+
+    if ((pid = fork()) < 0) {
+        perror("fork");
+        exit(1);
+    }
+
+    if (pid == 0) {
+        setpgid(0, 0);        //Dont need SIGINT from shell
+        execvp(argv[0], (char *const *)argv);
+        perror("exec");
+        exit(1);
+    }
+}
+#endif
+
+static SOCKET listenTcp(const char * addrStr, unsigned short port)
+{
+    SOCKET s;
+    struct sockaddr_in addr;
+
+    s = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (s == INVALID_SOCKET) {
+        printf("Socket error!\n");
+        return INVALID_SOCKET;
+    }
+
+#if defined(OS_LINUX) && defined(SO_REUSEADDR)
+    {
+        int reuse = 1;
+        if (setsockopt(s, SOL_SOCKET, SO_REUSEADDR, (const char*)&reuse, sizeof(reuse)) < 0)
+            perror("setsockopt(SO_REUSEADDR) failed");
+    }
+#endif
+
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = inet_addr(addrStr);
+    addr.sin_port = htons(port);
+
+    if (bind(s, (struct sockaddr *)&addr, sizeof(addr)) == SOCKET_ERROR
+        || listen(s, SOMAXCONN) == SOCKET_ERROR) {
+        printf("Socket error!\nIP %s Port %d\n", addrStr, (int)port);
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+    return s;
+}
+
+#ifndef OS_WIN
+static void removeUnixPath(void)
+{
+    unlink(s_unix_path);
+}
+
+/*
+** Listen on a unix socket, a leading '@' names an abstract one. The path is
+** passed to the started program by LDB_SOCK.
+*/
+static SOCKET listenUnix(const char * path)
+{
+    static char env[sizeof(s_unix_path) + 16];
+    SOCKET s;
+    struct sockaddr_un addr;
+    int len = strlen(path);
+
+    if (len >= (int)sizeof(addr.sun_path)) {
+        printf("Unix socket path is too long!\n");
+        return INVALID_SOCKET;
+    }
+
+    s = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (s == INVALID_SOCKET) {
+        printf("Socket error!\n");
+        return INVALID_SOCKET;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    memcpy(addr.sun_path, path, len);
+    if (path[0] == '@') {
+        addr.sun_path[0] = 0;
+    }
+    else {
+        //A stale one left by a killed lldbg
+        unlink(path);
+    }
+
+    if (bind(s, (struct sockaddr *)&addr, offsetof(struct sockaddr_un, sun_path) + len) == SOCKET_ERROR
+        || listen(s, SOMAXCONN) == SOCKET_ERROR) {
+        printf("Socket error!\nUnix socket %s\n", path);
+        closesocket(s);
+        return INVALID_SOCKET;
+    }
+
+    if (path[0] != '@') {
+        if (path != s_unix_path)
+            strcpy(s_unix_path, path);
+        atexit(removeUnixPath);
+    }
+
+    sprintf(env, "LDB_SOCK=%s", path);
+    putenv(env);
+    return s;
+}
+#endif
+
+#define NEXT_ARG()    do { i++; if (i >= argc) Usage(argv[0]); }while(0)
+
+int main(int argc, char * argv[])
+{
+    SOCKET s;
+    char addrStr[64] = {0};
+    unsigned short port = 0;
+    const char * unixPath = NULL;
+    int prog_idx = 0;
+    int prog_pid = 0;
+#ifndef OS_WIN
+    FILE * dap = NULL;
+#endif
+
+#ifdef OS_LINUX
+    const char *sig = getenv("LDB_SIG");
+    
+    if (sig && atoi(sig))
+        s_ldb_sig = atoi(sig);
+
+    //Single threaded, a reply is printed by many calls that need no locks
+    __fsetlocking(stdout, FSETLOCKING_BYCALLER);
+#endif
+
+    if (argc > 1) {
+        int i = 1;
+        for (; i < argc; i++) {
+            if (!strcmp(argv[i], "-h") || !strcmp(argv[i], "--help")) {
+                Usage(argv[0]);
+            }
+            else if (!strcmp(argv[i], "-a") || !strcmp(argv[i], "--addr")) {
+                NEXT_ARG();
+                strncpy(addrStr, argv[i], 63);
+                addrStr[63] = 0;
+            }
+            else if (!strcmp(argv[i], "--port")) {
+                NEXT_ARG();
+                port = (unsigned short)atoi(argv[i]);
+            }
+#ifndef OS_WIN
+            else if (!strcmp(argv[i], "--unix")) {
+                NEXT_ARG();
+                unixPath = argv[i];
+            }
+            else if (!strcmp(argv[i], "--no-ring")) {
+                s_no_ring = 1;
+            }
+            else if (!strcmp(argv[i], "--dap")) {
+                //The messages go to the real stdout, all else(the debuggee's too) to stderr
+                int fd = dup(1);
+                if (fd < 0 || dup2(2, 1) < 0 || !(dap = fdopen(fd, "w"))) {
+                    fprintf(stderr, "Failed to set up stdout!\n");
+                    return -1;
+                }
+            }
+#endif
+            else if (!strcmp(argv[i], "--compress")) {
+                s_compress = 2;
+            }
+            else if (!strcmp(argv[i], "--no-compress")) {
+                s_compress = 0;
+            }
+            else if (!strcmp(argv[i], "--timeout")) {
+                NEXT_ARG();
+                s_timeout = atoi(argv[i]);
+                if (s_timeout < 0)
+                    Usage(argv[0]);
+            }
+            else if (!strcmp(argv[i], "-p") || !strcmp(argv[i], "--pid")) {
+                NEXT_ARG();
+                prog_pid = atoi(argv[i]);
+                if (prog_pid <= 0)
+                    Usage(argv[0]);
+            }
+            else if (!strcmp(argv[i], "-s") || !strcmp(argv[i], "--source")) {
+                NEXT_ARG();
+                addSourceDir(argv[i]);
+            }
+            else if (!strcmp(argv[i], "--non-stop")) {
+                putenv("LDB_NONSTOP=1");
+            }
+            else if (!strcmp(argv[i], "--breakpoints")) {
+                NEXT_ARG();
+                if (loadBreakpoints(argv[i]) < 0)
+                    return -1;
+            }
+            else {
+                prog_idx = i;
+                break;        //Stop parsing
+            }
+        }
+    }
+    if (addrStr[0] == 0)
+        strcpy(addrStr, "127.0.0.1");
+    if (port == 0)
+        port = 2679;
+
+    if (initSocket()) {
+        printf("initSocket failed!\n");
+        return -1;
+    }
+
+#ifndef OS_WIN
+    if (unixPath) {
+        //Default to a per-pid abstract name, an attached process tries it first
+        if (!strcmp(unixPath, "@")) {
+            if (prog_pid > 0)
+                sprintf(s_unix_path, "@lldb_%d", prog_pid);
+            else
+                sprintf(s_unix_path, "@lldbg_%d", (int)getpid());
+            unixPath = s_unix_path;
+        }
+        s = listenUnix(unixPath);
+    }
+    else
+#endif
+    s = listenTcp(addrStr, port);
+
+    if (s == INVALID_SOCKET) {
+        uninitSocket();
+        return -1;
+    }
+
+    if (prog_pid > 0) {
+        if (notifyRemote(prog_pid, 1)) {
+            printf("Failed to attach to process %d\n", prog_pid);
+            closesocket(s);
+            uninitSocket();
+            return -1;
+        }
+    }
+    else if (prog_idx > 0) {
+        putenv("LDB_STARTUP=1");
+        startProgram(argc - prog_idx, &argv[prog_idx]);
+    }
+    else {
+        printf("<command> or -p <pid> is required.\n\n");
+        Usage(argv[0]);
+    }
+
+    printf("Original RLdb 2.0.0 Copyright (C) 2009 Zhang Lei\n");
+    printf("Modified lldbg 1.0 Copyright (C) 2016 Wen Xichang\n");
+#ifndef OS_WIN
+    if (unixPath)
+        printf("Waiting at %s for remote debuggee...\n", unixPath);
+    else
+#endif
+    printf("Waiting at %s:%d for remote debuggee...\n", addrStr, (int)port);
+    if (setupInterrupt() < 0) {
+        printf("Failed to set up Ctrl+C!\n");
+        closesocket(s);
+        uninitSocket();
+        return -1;
+    }
+    SB_SetWaiter(waitReply);
+    
+#ifndef OS_WIN
+    if (dap)
+        DapLoop(s, dap);
+    else
+#endif
+    //Keep listening, forked debuggees connect when they break
+    mainloop(s);
+    closesocket(s);
+    uninitSocket();
+    return 0;
+}
+
+static FILE *checkFile(const char * path, const char ** err)
+{
+    FILE *fp;
+    
+    fp = fopen(path, "r");
+    if (!fp) {
+        *err = strerror(errno);
+        return NULL;
+    }
+    
+    if (fgetc(fp) == 0x1b) {    //Precompiled bytecode(lua/luajit)
+        fclose(fp);
+        *err = "Binary source file";
+        return NULL;
+    }
+    
+    rewind(fp);
+    return fp;
+}
+
+int findSource(const char * file, char * path, int size)
+{
+    int i;
+    FILE *fp;
+
+    for (i = 0; i < s_nsrc_path; ++i) {
+        snprintf(path, size, "%s/%s", s_src_paths[i], file);
+        if ((fp = fopen(path, "r"))) {
+            fclose(fp);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static FILE *getFile(const char *file, const char * fullpath, const char ** err)
+{
+    FILE *fp;
+    int i;
+    *err = NULL;
+    
+    if (fullpath) {
+        if ((fp = checkFile(fullpath, err)))
+            return fp;
+    }
+    
+    for (i = 0; i < s_nsrc_path; ++i) {
+        char path[1024];
+        snprintf(path, sizeof(path), "%s/%s", s_src_paths[i], file);
+        if ((fp = checkFile(path, err)))
+            return fp;
+    }
+    
+    if (*err == NULL)
+        *err = "No such file or directory";
+    
+    return NULL;
+}
+
+static void showSource(const char * file, int lineno, const char * fullpath, int count)
+{
+    int i;
+    FILE *fp;
+    char linebuf[4096];
+    const char *err = NULL;
+    
+    assert(file);
+    
+    fp = getFile(file, fullpath, &err);
+    if (!fp) {
+        printf("%s: %s\n", file, err);
+        return;
+    }
+    
+    for (i = 0; i < lineno - 1; ++i) {
+        fgets(linebuf, sizeof(linebuf), fp);
+    }
+    
+    for (i = 0; i < count; ++i) {
+        if (fgets(linebuf, sizeof(linebuf), fp)) {
+            char *p = strchr(linebuf, '\n');
+            if (p)
+                *p = 0;
+            
+            p = strchr(linebuf, '\r');
+            if (p)
+                *p = 0;
+            
+            printf("%d: %s\n", lineno, linebuf);
+            lineno++;
+        }
+    }
+    
+    fclose(fp);
+}
+
+static int ls(const char * file, int line, const char * fullpath, int argc, const char ** argv)
+{
+    int count = 10;
+    if (argc == 2) {
+        line = atoi(argv[1]);
+    } else if (argc == 3) {
+        file = argv[1];
+        line = atoi(argv[2]);
+        fullpath = NULL;
+    } else if (argc == 4) {
+        file = argv[1];
+        line = atoi(argv[2]);
+        count = atoi(argv[3]);
+        fullpath = NULL;
+    }
+    
+    if (line <= 0)
+        line = 1;
+    if (count <= 0)
+        count = 10;
+    
+    showSource(file, line, fullpath, count);
+    return line + count;
+}
+
+void acceptSession(SOCKET l)
+{
+    Session * ss;
+    SOCKET a = accept(l, NULL, NULL);
+
+    if (a == SOCKET_ERROR)
+        return;
+
+    if (g_nsession >= MAX_SESSION) {
+        printf("Too many debuggees!\n");
+        closesocket(a);
+        return;
+    }
+
+    ss = &g_sessions[g_nsession++];
+    ss->s = a;
+    ss->pid = 0;
+    ss->nbp = 0;
+    ss->local = isLocalConnection(a);
+    ss->ring = 0;
+    ss->lz = s_compress == 2 || (s_compress == 1 && !ss->local);
+    ss->paused = 0;
+    ss->gone = 0;
+    ss->ops = NULL;
+    ss->nops = 0;
+    SB_Init(&ss->sb, a);
+    s_nseen++;
+
+    {
+        struct sockaddr_in peer;
+#ifdef OS_LINUX
+        socklen_t len = sizeof(peer);
+#else
+        int len = sizeof(peer);
+#endif
+        if (getpeername(a, (struct sockaddr *)&peer, &len) == 0 && peer.sin_family == AF_INET)
+            snprintf(ss->host, sizeof(ss->host), "%s", inet_ntoa(peer.sin_addr));
+        else
+            strcpy(ss->host, "unix");
+    }
+
+#ifndef OS_WIN
+    {
+        struct sockaddr_un addr;
+        socklen_t len = sizeof(addr);
+        if (getsockname(a, (struct sockaddr *)&addr, &len) == 0 && addr.sun_family == AF_UNIX)
+            ss->ring = !s_no_ring;
+    }
+#endif
+
+    if (ss->local) {
+        printf("Connected from localhost!\n");
+    } else {
+        printf("Connected from remote host!\n");
+    }
+}
+
+void dropSession(Session * ss)
+{
+    closesocket(ss->s);
+    free(ss->ops);
+#ifndef OS_WIN
+    if (ss->sb.ring)
+        SB_FreeRing(ss->sb.ring);
+#endif
+    *ss = g_sessions[--g_nsession];
+}
+
+#ifndef OS_WIN
+/*
+** Replies of a same host debuggee come by a shared memory ring, rather than
+** a send/recv every 4K. The socket still works if it fails.
+** Return -1 on socket or protocol error.
+*/
+static int setupRing(Session * ss)
+{
+    static int n;
+    char path[64];
+    char cmd[80];
+    SB_Ring * ring;
+    int rc;
+
+    if (!ss->ring)
+        return 0;
+    ss->ring = 0;
+
+    snprintf(path, sizeof(path), "/dev/shm/lldbg_%d_%d", (int)getpid(), ++n);
+    ring = SB_CreateRing(path, SB_RING_SIZE);
+    if (!ring)
+        return 0;
+
+    snprintf(cmd, sizeof(cmd), "ring %s", path);
+    rc = SendFrame(ss->s, PROT_CMD, cmd, strlen(cmd));
+    if (rc == 0)
+        rc = waitForResponseFirstLine(&ss->sb);
+    if (rc >= 0 && SB_Read(&ss->sb, SB_R_LEFT) < 0)
+        rc = -1;
+
+    //Mapped by both now
+    unlink(path);
+    if (rc == 1) {
+        ss->sb.ring = ring;
+        return 0;
+    }
+    SB_FreeRing(ring);
+    return rc;
+}
+#else
+#define setupRing(ss) 0
+#endif
+
+/*
+** Ask the debuggee to compress the replies of LZ_THRESHOLD bytes or longer, for
+** a slow link. An old one says no, which is fine.
+** Return -1 on socket or protocol error.
+*/
+static int setupLZ(Session * ss)
+{
+    char cmd[32];
+    int rc;
+
+    if (!ss->lz)
+        return 0;
+    ss->lz = 0;
+
+    snprintf(cmd, sizeof(cmd), "lz %d", LZ_THRESHOLD);
+    rc = SendFrame(ss->s, PROT_CMD, cmd, strlen(cmd));
+    if (rc == 0)
+        rc = waitForResponseFirstLine(&ss->sb);
+    if (rc >= 0 && SB_Read(&ss->sb, SB_R_LEFT) < 0)
+        rc = -1;
+    return rc < 0 ? -1 : 0;
+}
+
+int prepareSession(Session * ss)
+{
+    return setupRing(ss) < 0 || setupLZ(ss) < 0 ? -1 : 0;
+}
+
+SOCKET watchSessions(fd_set * rfds, SOCKET maxfd, Session * focus, int * pending)
+{
+    int i;
+    for (i = 0; i < g_nsession; ++i) {
+        Session * ss = &g_sessions[i];
+        if (ss == focus || ss->paused || ss->gone)
+            continue;
+        FD_SET(ss->s, rfds);
+        if (ss->s > maxfd)
+            maxfd = ss->s;
+        if (SB_Arm(&ss->sb))
+            *pending = 1;
+    }
+    return maxfd;
+}
+
+void serveSessions(fd_set * rfds, Session * focus, int prompting)
+{
+    int i;
+    for (i = 0; i < g_nsession; ++i) {
+        Session * ss = &g_sessions[i];
+        const char * file;
+        const char * lineno;
+        const char * fullpath;
+        int pid = s_remote_pid;
+        int rc;
+
+        if (ss == focus || ss->paused || ss->gone)
+            continue;
+        if (FD_ISSET(ss->s, rfds))
+            rc = SB_Poll(&ss->sb);
+        else
+            rc = SB_Pending(&ss->sb);
+        if (rc == 0)
+            continue;
+
+        //Wait for a BREAK or QUIT message...
+        if (rc > 0)
+            rc = waitForBreakOrQuit(&ss->sb, &file, &lineno, &fullpath);
+        if (rc > 0) {
+            ss->pid = s_remote_pid;
+            ss->line = atoi(lineno);
+            snprintf(ss->file, sizeof(ss->file), "%s", file);
+            snprintf(ss->fullpath, sizeof(ss->fullpath), "%s", fullpath);
+            ss->paused = 1;
+            if (prompting) {
+                //Ctrl+C still goes to the one served
+                s_remote_pid = pid;
+                printf("\nProcess %d breaks at \"%s:%d\", 'focus %d' to serve it.\n?>",
+                    ss->pid, ss->file, ss->line, ss->pid);
+            }
+            continue;
+        }
+
+        s_remote_pid = pid;
+        if (prompting)
+            printf("\n");
+        if (rc < 0)
+            printf("Socket or protocol error!\n");
+        else if (g_nsession > 1)
+            printf("Process %d is over!\n", ss->pid);
+        if (prompting)
+            printf("?>");
+        ss->gone = 1;
+    }
+    fflush(stdout);
+}
+
+#ifndef OS_WIN
+/*
+** Add what's served whatever lldbg waits for to rfds: Ctrl+C, new debuggees
+** when accepting, and stdin when a line is wanted. Return the max fd.
+*/
+static SOCKET watchCommon(fd_set * rfds, SOCKET maxfd, int accepting, int input)
+{
+    FD_SET(s_sigpipe[0], rfds);
+    if (s_sigpipe[0] > maxfd)
+        maxfd = s_sigpipe[0];
+    if (accepting) {
+        FD_SET(s_listen, rfds);
+        if (s_listen > maxfd)
+            maxfd = s_listen;
+    }
+    if (input && !s_eof && s_nin < (int)sizeof(s_in)) {
+        FD_SET(0, rfds);
+    }
+    return maxfd;
+}
+
+static void serveCommon(fd_set * rfds, int accepting, int input)
+{
+    if (FD_ISSET(s_sigpipe[0], rfds)) {
+        char buf[16];
+        while (read(s_sigpipe[0], buf, sizeof(buf)) > 0)
+            ;
+        interruptRemote();
+    }
+    if (accepting && FD_ISSET(s_listen, rfds))
+        acceptSession(s_listen);
+    if (input && FD_ISSET(0, rfds)) {
+        int n = read(0, s_in + s_nin, sizeof(s_in) - s_nin);
+        if (n > 0)
+            s_nin += n;
+        else if (n == 0 || errno != EINTR)
+            s_eof = 1;
+    }
+}
+
+/*
+** Take a line typed into buf, the way fgets does. A line longer than buf is
+** split, and the last one needs no line feed once stdin is closed.
+** Return 0 when there's no line yet.
+*/
+static int takeLine(char * buf)
+{
+    char * lf = memchr(s_in, '\n', s_nin);
+    int n = lf ? (int)(lf - s_in) + 1 : s_nin;
+
+    if (!lf && !s_eof && n < CMD_LINE - 1)
+        return 0;
+    if (n == 0)
+        return 0;
+    if (n > CMD_LINE - 1)
+        n = CMD_LINE - 1;
+    memcpy(buf, s_in, n);
+    buf[n] = 0;
+    s_nin -= n;
+    memmove(s_in, s_in + n, s_nin);
+    return 1;
+}
+#endif
+
+/*
+** Read a line typed while focus is served, accepting new debuggees, telling
+** the breaks of the others and serving Ctrl+C meanwhile. stdin is left alone
+** otherwise: a debuggee started by lldbg may read it.
+** Return 0 when stdin is closed.
+*/
+static int readLine(Session * focus, char * buf)
+{
+#ifdef OS_WIN
+    return fgets(buf, CMD_LINE, stdin) != NULL;
+#else
+    fflush(stdout);
+    while (!takeLine(buf)) {
+        fd_set rfds;
+        SOCKET maxfd;
+        struct timeval tv = { 0, 0 };
+        int pending = 0;
+
+        if (s_eof)
+            return 0;
+        FD_ZERO(&rfds);
+        maxfd = watchCommon(&rfds, 0, 1, 1);
+        maxfd = watchSessions(&rfds, maxfd, focus, &pending);
+        if (select((int)maxfd + 1, &rfds, NULL, NULL, pending ? &tv : NULL) == SOCKET_ERROR) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+        serveCommon(&rfds, 1, 1);
+        serveSessions(&rfds, focus, 1);
+    }
+    return 1;
+#endif
+}
+
+/*
+** The waiter of SocketBuf: wait for a reply on s for s_timeout seconds at most,
+** serving Ctrl+C meanwhile.
+*/
+int waitReply(SOCKET s)
+{
+    time_t deadline = time(NULL) + s_timeout;
+
+    while (1) {
+        fd_set rfds;
+        SOCKET maxfd = s;
+        struct timeval tv = { 0, 0 };
+        int rc;
+
+        FD_ZERO(&rfds);
+        FD_SET(s, &rfds);
+#ifndef OS_WIN
+        maxfd = watchCommon(&rfds, maxfd, 0, 0);
+#endif
+        if (s_timeout > 0) {
+            time_t now = time(NULL);
+            tv.tv_sec = deadline > now ? (long)(deadline - now) : 0;
+        }
+
+        rc = select((int)maxfd + 1, &rfds, NULL, NULL, s_timeout > 0 ? &tv : NULL);
+        if (rc == SOCKET_ERROR) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        if (rc == 0) {
+            printf("No reply in %d seconds!\n", s_timeout);
+            return -1;
+        }
+#ifndef OS_WIN
+        serveCommon(&rfds, 0, 0);
+#endif
+        if (FD_ISSET(s, &rfds))
+            return 0;
+    }
+}
+
+/*
+** Wait until one of the debuggees breaks, accepting new debuggees meanwhile.
+** A paused one goes first, the one asked by focus before the others.
+** Return 1 with *pss set to the breaking session, 0 when all are over.
+*/
+static int waitForBreak(SOCKET l, Session ** pss)
+{
+    while (1) {
+        fd_set rfds;
+        SOCKET maxfd = l;
+        struct timeval tv = { 0, 0 };
+        Session * paused = NULL;
+        int pending = 0;
+        int i;
+
+        for (i = g_nsession - 1; i >= 0; --i) {
+            Session * ss = &g_sessions[i];
+            if (ss->gone)
+                dropSession(ss);
+        }
+        for (i = 0; i < g_nsession; ++i) {
+            Session * ss = &g_sessions[i];
+            if (ss->paused && (!paused || ss->pid == s_focus_pid))
+                paused = ss;
+        }
+        if (paused) {
+            paused->paused = 0;
+            s_remote_pid = paused->pid;
+            s_local = paused->local;
+            s_focus_pid = 0;
+            *pss = paused;
+            return 1;
+        }
+        if (g_nsession == 0 && s_nseen)
+            return 0;
+
+        FD_ZERO(&rfds);
+        FD_SET(l, &rfds);
+#ifndef OS_WIN
+        maxfd = watchCommon(&rfds, maxfd, 0, 0);
+#endif
+        maxfd = watchSessions(&rfds, maxfd, NULL, &pending);
+
+        //Don't block when a message is received already
+        if (select((int)maxfd + 1, &rfds, NULL, NULL, pending ? &tv : NULL) == SOCKET_ERROR) {
+            if (errno == EINTR)
+                continue;
+            return 0;
+        }
+#ifndef OS_WIN
+        serveCommon(&rfds, 0, 0);
+#endif
+        serveSessions(&rfds, NULL, 0);
+
+        if (FD_ISSET(l, &rfds))
+            acceptSession(l);
+    }
+}
+
+typedef struct
+{
+    int idx;
+    int nok;
+    int nerr;
+} Arg_bb;
+
+static int lbb(Arg_bb * args, const char * word, int length)
+{
+    if (length == 2 && !strncmp(word, "OK", 2)) {
+        args->nok++;
+    } else {
+        args->nerr++;
+        printf("Breakpoint \"%s\": ", s_fleet_bps[args->idx]);
+        output(word, length);
+        fputc('\n', stdout);
+
+        //Rejected, don't send it to the others again
+        free(s_fleet_bps[args->idx]);
+        s_fleet_bps[args->idx] = NULL;
+    }
+    args->idx++;
+    return 0;
+}
+
+/*
+** Remove the breakpoints dropped(NULL) from the recorded ones.
+*/
+static void compactFleetBreakpoints(void)
+{
+    int i, j;
+    int n = 0;
+
+    for (i = 0; i < s_nfleet_bp; ++i) {
+        if (s_fleet_bps[i]) {
+            s_fleet_bps[n++] = s_fleet_bps[i];
+            continue;
+        }
+        for (j = 0; j < g_nsession; ++j) {
+            if (g_sessions[j].nbp > n)
+                g_sessions[j].nbp--;
+        }
+    }
+    s_nfleet_bp = n;
+}
+
+/*
+** Set the recorded breakpoints ss doesn't have yet, with one bb command for up
+** to MAX_BATCH bytes of them. The ones rejected are dropped from the records.
+** Return -1 on socket or protocol error.
+*/
+static int applyFleetBreakpoints(Session * ss, int verbose)
+{
+    static char msg[MAX_BATCH];
+    Arg_bb args = { 0, 0, 0 };
+
+    while (ss->nbp < s_nfleet_bp) {
+        int len = 3;
+        int rc;
+
+        strcpy(msg, "bb\n");
+        args.idx = ss->nbp;
+        while (ss->nbp < s_nfleet_bp) {
+            int l = strlen(s_fleet_bps[ss->nbp]);
+            if (len + l + 2 > MAX_BATCH)
+                break;
+            memcpy(msg + len, s_fleet_bps[ss->nbp], l);
+            len += l;
+            msg[len++] = '\n';
+            ss->nbp++;
+        }
+        msg[len] = 0;
+
+        if (SendFrame(ss->s, PROT_CMD, msg, len) < 0)
+            return -1;
+
+        rc = waitForResponseFirstLine(&ss->sb);
+        if (rc < 0)
+            return -1;
+        if (rc == 0)
+            rc = showError(&ss->sb);
+        else
+            rc = SB_ReadAndParse(&ss->sb, "\n", (UserParser)lbb, &args);
+        if (args.nerr)
+            compactFleetBreakpoints();
+        if (rc < 0)
+            return -1;
+    }
+
+    if (verbose || args.nerr)
+        printf("%d breakpoints set, %d failed\n", args.nok, args.nerr);
+    return 0;
+}
+
+/*
+** Record breakpoint "<file> <line> [options]". A known one is moved to the
+** tail, so that it is applied again(it may have been deleted since).
+*/
+static void recordBreakpoint(const char * bp)
+{
+    int i, j;
+    for (i = 0; i < s_nfleet_bp; ++i) {
+        char * known = s_fleet_bps[i];
+        if (strcmp(known, bp))
+            continue;
+
+        memmove(&s_fleet_bps[i], &s_fleet_bps[i + 1], (s_nfleet_bp - i - 1) * sizeof(char *));
+        s_fleet_bps[s_nfleet_bp - 1] = known;
+        for (j = 0; j < g_nsession; ++j) {
+            if (g_sessions[j].nbp > i)
+                g_sessions[j].nbp--;
+        }
+        return;
+    }
+
+    if (s_nfleet_bp < MAX_FLEET_BP) {
+        s_fleet_bps[s_nfleet_bp] = strdup(bp);
+        if (s_fleet_bps[s_nfleet_bp])
+            s_nfleet_bp++;
+    }
+}
+
+/*
+** Record "sb <file> <line> [options]" set in ss, argv as typed with file resolved.
+*/
+static void addFleetBreakpoint(Session * ss, const char * file, char * argv[], int argc)
+{
+    char bp[CMD_LINE];
+    int i;
+
+    snprintf(bp, sizeof(bp), "%s", file);
+    for (i = 2; i < argc; ++i) {
+        if (strlen(bp) + strlen(argv[i]) + 2 > sizeof(bp))
+            return;
+        strcat(bp, " ");
+        strcat(bp, argv[i]);
+    }
+
+    //Already set in this one
+    recordBreakpoint(bp);
+    if (ss->nbp == s_nfleet_bp - 1)
+        ss->nbp = s_nfleet_bp;
+}
+
+/*
+** Record the breakpoints in file, a "<file> <line> [options]" each line(sb or b
+** may lead), # for comments.
+** Return the number of breakpoints, or -1 when file can't be read.
+*/
+static int loadBreakpoints(const char * path)
+{
+    char line[CMD_LINE];
+    int n = 0;
+    FILE *fp = fopen(path, "r");
+
+    if (!fp) {
+        printf("Can't open %s\n", path);
+        return -1;
+    }
+
+    while (fgets(line, sizeof(line), fp)) {
+        char bp[CMD_LINE];
+        char * argv[MAX_ARGS];
+        int argc = extractArgs(line, argv);
+        int i = 0;
+
+        if (argc > 0 && argv[0][0] == '#')
+            continue;
+        if (argc > 0 && (!strcmp(argv[0], "sb") || !strcmp(argv[0], "b")))
+            i = 1;
+        if (argc - i < 2 || !allDigits(argv[i + 1])) {
+            if (argc > 0)
+                printf("Invalid breakpoint: %s\n", argv[argc > i ? i : 0]);
+            continue;
+        }
+
+        strcpy(bp, argv[i]);
+        for (++i; i < argc; ++i) {
+            strcat(bp, " ");
+            strcat(bp, argv[i]);
+        }
+        recordBreakpoint(bp);
+        n++;
+    }
+    fclose(fp);
+    return n;
+}
+
+typedef enum
+{
+    BS_IDX,
+    BS_FILE,
+    BS_LINE,
+    BS_ENABLE,
+    BS_HITS,
+    BS_SKIPS,
+    BS_LIMIT,
+    BS_PERIOD,
+    BS_SAMPLE,
+} State_bs;
+
+typedef struct
+{
+    State_bs st;
+    FILE *fp;
+    char bp[CMD_LINE];
+    int enable;
+    int limit;
+} Arg_bs;
+
+static void appendWord(char * bp, const char * prefix, const char * word, int length)
+{
+    int l = strlen(bp);
+    int pl = strlen(prefix);
+
+    if (l + pl + length + 1 > CMD_LINE)
+        return;
+    memcpy(bp + l, prefix, pl);
+    memcpy(bp + l + pl, word, length);
+    bp[l + pl + length] = 0;
+}
+
+static int lbs(Arg_bs * args, const char * word, int length)
+{
+    switch (args->st) {
+    case BS_FILE:
+        args->bp[0] = 0;
+        appendWord(args->bp, "", word, length);
+        break;
+    case BS_LINE:
+        appendWord(args->bp, " ", word, length);
+        break;
+    case BS_ENABLE:
+        args->enable = *word != '0';
+        break;
+    case BS_LIMIT:
+        args->limit = atoi(word);
+        if (args->limit)
+            appendWord(args->bp, " limit ", word, length);
+        break;
+    case BS_PERIOD:
+        if (args->limit)
+            appendWord(args->bp, "/", word, length);
+        break;
+    case BS_SAMPLE:
+        if (atoi(word) > 1)
+            appendWord(args->bp, " sample ", word, length);
+        //Keep disabled ones, commented out
+        fprintf(args->fp, "%s%s\n", args->enable ? "" : "# ", args->bp);
+        args->st = BS_IDX;
+        return 0;
+    default:
+        break;
+    }
+    args->st++;
+    return 0;
+}
+
+/*
+** Write the breakpoints of ss to path, in the format of loadBreakpoints.
+** Return -1 on socket or protocol error.
+*/
+static int saveBreakpoints(Session * ss, const char * path)
+{
+    char * argv[1] = { "lb" };
+    Arg_bs args;
+    int rc;
+
+    if (sendCmd(ss->s, CMD_LISTB, argv, 1) < 0)
+        return -1;
+
+    rc = waitForResponseFirstLine(&ss->sb);
+    if (rc <= 0)
+        return rc < 0 ? -1 : showError(&ss->sb);
+
+    memset(&args, 0, sizeof(args));
+    args.st = BS_IDX;
+    args.fp = fopen(path, "w");
+    if (!args.fp) {
+        printf("Can't open %s\n", path);
+        return SB_Read(&ss->sb, SB_R_LEFT) < 0 ? -1 : 0;
+    }
+
+    rc = SB_ReadAndParse(&ss->sb, "\n", (UserParser)lbs, &args);
+    fclose(args.fp);
+    return rc;
+}
+
+/*
+** Send the breakpoint commands queued for ss by on in one frame, and show what
+** fails. Return -1 on socket or protocol error.
+*/
+static int applyOps(Session * ss)
+{
+    int n = ss->nops;
+    int rc;
+
+    if (!n)
+        return 0;
+    rc = SendFrame(ss->s, PROT_CMD, ss->ops, strlen(ss->ops));
+    free(ss->ops);
+    ss->ops = NULL;
+    ss->nops = 0;
+    if (rc < 0)
+        return -1;
+
+    while (n-- > 0) {
+        rc = waitForResponseFirstLine(&ss->sb);
+        if (rc < 0)
+            return -1;
+        if (rc == 0) {
+            printf("Process %d: ", ss->pid);
+            rc = showError(&ss->sb);
+        }
+        else {
+            rc = SB_Read(&ss->sb, SB_R_LEFT);
+        }
+        if (rc < 0)
+            return -1;
+    }
+    return 0;
+}
+
+static int queueOp(Session * ss, const char * cmd)
+{
+    int len = ss->ops ? strlen(ss->ops) : 0;
+    char * ops = realloc(ss->ops, len + strlen(cmd) + 2);
+
+    if (!ops)
+        return -1;
+    if (len)
+        ops[len++] = '\n';
+    strcpy(ops + len, cmd);
+    ss->ops = ops;
+    ss->nops++;
+    return 0;
+}
+
+static int inPidList(const char * list, int pid)
+{
+    const char * p = list;
+
+    if (!strcmp(list, "all"))
+        return 1;
+    while (*p) {
+        if (atoi(p) == pid)
+            return 1;
+        p = strchr(p, ',');
+        if (!p)
+            break;
+        ++p;
+    }
+    return 0;
+}
+
+/*
+** on <pid>[,<pid>...]|all <sb|db|en|dis ...>: the breakpoint command for the
+** sessions chosen, focus and the paused ones get it at once, the running ones
+** at their next break.
+** Return -1 on socket or protocol error of focus.
+*/
+static int onSessions(Session * focus, const char * file, char * argv[], int argc)
+{
+    char cmd[CMD_LINE];
+    CmdType t = validateArgs(argv + 2, argc - 2);
+    int rc = 0;
+    int n = 0;
+    int i;
+
+    if (t != CMD_SETB && t != CMD_DELB && t != CMD_ENB && t != CMD_DISB) {
+        printf("Only sb, db, en and dis go to other sessions!\n");
+        return 0;
+    }
+    if (t == CMD_SETB && !strcmp(argv[3], "."))
+        argv[3] = (char *)file;
+    formatCmd(cmd, t, argv + 2, argc - 2);
+
+    for (i = 0; i < g_nsession; ++i) {
+        Session * ss = &g_sessions[i];
+
+        if (ss->gone || !inPidList(argv[1], ss->pid))
+            continue;
+        n++;
+        if (queueOp(ss, cmd) < 0) {
+            printf("Process %d: out of memory!\n", ss->pid);
+            continue;
+        }
+        if (ss != focus && !ss->paused) {
+            printf("Process %d is running, queued for its next break.\n", ss->pid);
+            continue;
+        }
+        if (applyOps(ss) < 0) {
+            if (ss == focus) {
+                rc = -1;
+                continue;
+            }
+            printf("Process %d: socket or protocol error!\n", ss->pid);
+            ss->gone = 1;
+        }
+    }
+
+    if (n == 0)
+        printf("No such process!\n");
+    return rc;
+}
+
+static void listSessions(Session * focus)
+{
+    int i;
+    for (i = 0; i < g_nsession; ++i) {
+        Session * ss = &g_sessions[i];
+
+        if (ss->gone)
+            continue;
+        printf("Pid:%d \tHost:%s \tState:", ss->pid, ss->host);
+        if (ss == focus)
+            printf("Served\n");
+        else if (ss->paused)
+            printf("Paused at \"%s:%d\"\n", ss->file, ss->line);
+        else
+            printf("Running\n");
+    }
+}
+
+/*
+** focus <pid>: serve the paused session of pid, leaving focus paused.
+** Return 1 when switching.
+*/
+static int focusSession(Session * focus, int pid)
+{
+    int i;
+
+    if (pid == focus->pid) {
+        printf("Process %d is served already!\n", pid);
+        return 0;
+    }
+    for (i = 0; i < g_nsession; ++i) {
+        Session * ss = &g_sessions[i];
+
+        if (ss->gone || ss->pid != pid)
+            continue;
+        if (!ss->paused) {
+            printf("Process %d is running!\n", pid);
+            return 0;
+        }
+        s_focus_pid = pid;
+        focus->paused = 1;
+        return 1;
+    }
+    printf("No such process!\n");
+    return 0;
+}
+
+/*
+** Tell whether t is served by lldb, rather than by lldbg itself.
+*/
+static int isRemote(CmdType t)
+{
+    switch (t) {
+        case CMD_INVALID:
+        case CMD_HELP:
+        case CMD_FRAME:
+        case CMD_ASD:
+        case CMD_LS:
+        case CMD_BLOAD:
+        case CMD_BSAVE:
+        case CMD_QUIT:
+        case CMD_WNEXT:
+        case CMD_SESSIONS:
+        case CMD_FOCUS:
+        case CMD_ON:
+        case CMD_REFRESH:
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+/*
+** Tell whether w remembers the value it shows(r), for w without a base.
+*/
+static int remembers(char * argv[], int argc)
+{
+    int i = watchArgs(argv, argc);
+    return i > 1 && !strcmp(argv[i - 1], "r");
+}
+
+/*
+** Tell whether the reply of t can be kept for the current stop. A w remembering
+** its value is always sent, it changes what w without a base shows.
+*/
+static int isCachable(CmdType t, char * argv[], int argc)
+{
+    if (t == CMD_WATCH)
+        return !remembers(argv, argc);
+    return t == CMD_PRINTSTACK || t == CMD_LISTL || t == CMD_LISTU || t == CMD_LISTG
+        || t == CMD_MEMORY;
+}
+
+static CachedReply * findCached(const char * cmd)
+{
+    int i;
+    for (i = 0; i < s_ncache; ++i) {
+        if (!strcmp(s_cache[i].cmd, cmd))
+            return &s_cache[i];
+    }
+    return NULL;
+}
+
+/*
+** Keep the reply recorded in s_rec for cmd, when there's room.
+*/
+static void cacheReply(const char * cmd, int type)
+{
+    CachedReply * cr;
+
+    if (s_rec.err || s_ncache >= MAX_CACHED || s_cache_bytes + s_rec.len > MAX_CACHED_BYTES
+        || findCached(cmd))
+        return;
+
+    cr = &s_cache[s_ncache];
+    cr->cmd = strdup(cmd);
+    if (!cr->cmd)
+        return;
+    cr->type = type;
+    cr->data = s_rec.buf;
+    cr->len = s_rec.len;
+    s_cache_bytes += s_rec.len;
+    s_ncache++;
+
+    //Taken
+    memset(&s_rec, 0, sizeof(s_rec));
+}
+
+/*
+** Stop recording the reply of cmd, and cache it when it's read to the end.
+*/
+static void endRecord(SocketBuf * sb, const char * cmd, int type, int rc)
+{
+    if (!sb->rec)
+        return;
+    SB_Record(sb, NULL);
+    if (rc >= 0 && sb->end)
+        cacheReply(cmd, type);
+}
+
+/*
+** Forget the replies of w without a base, its value is replaced. They stay in
+** place for the queued commands taking them already.
+*/
+static void forgetWatch(void)
+{
+    int i;
+    for (i = 0; i < s_ncache; ++i) {
+        if (!strncmp(s_cache[i].cmd, "w |", 3))
+            s_cache[i].cmd[0] = 0;
+    }
+}
+
+static void dropCache(void)
+{
+    int i;
+    for (i = 0; i < s_ncache; ++i) {
+        free(s_cache[i].cmd);
+        free(s_cache[i].data);
+    }
+    s_ncache = 0;
+    s_cache_bytes = 0;
+}
+
+static int isResume(CmdType t, int argc)
+{
+    return t == CMD_STEP || t == CMD_OUT || t == CMD_RUN || t == CMD_NEXT
+        || (t == CMD_STATE && argc == 2);
+}
+
+/*
+** Split a line typed into the commands separated by ';'(not quoted ones) and
+** queue them, dropping what's left in the queue.
+*/
+static void queueCommands(const char * line)
+{
+    const char * p = line;
+
+    s_nqueue = s_iqueue = 0;
+    while (*p && s_nqueue < MAX_QUEUE) {
+        QueuedCmd * c = &s_queue[s_nqueue];
+        const char * q = p;
+        int quoted = 0;
+
+        while (*q && (quoted || *q != ';')) {
+            if (*q == '"')
+                quoted = !quoted;
+            ++q;
+        }
+        memcpy(c->buf, p, q - p);
+        c->buf[q - p] = 0;
+        p = *q ? q + 1 : q;
+
+        c->argc = extractArgs(c->buf, c->argv);
+        if (c->argc == 0)
+            continue;   //Empty, "ps;" for example
+        c->t = c->argc > 0 ? validateArgs(c->argv, c->argc) : CMD_INVALID;
+        if (c->t == CMD_WATCH)
+            pageWatch(c->argv, &c->argc);
+        c->sent = 0;
+        s_nqueue++;
+    }
+}
+
+/*
+** Send the queued commands from i on in one frame, up to the first one served
+** by lldbg itself or a resume command. lldb serves them one after another, so
+** their replies come back in one round trip. The ones cached are not sent,
+** unless they follow a reload or a w remembering its value.
+** Return -1 on socket error.
+*/
+static int sendAhead(SOCKET s, int i, char * frame)
+{
+    static char msg[MAX_QUEUE * (CMD_LINE + 17)];
+    int len = 0;
+    int fresh = 0;
+
+    for (; i < s_nqueue && isRemote(s_queue[i].t); ++i) {
+        QueuedCmd * c = &s_queue[i];
+        char * argv[MAX_ARGS + 1];
+        int argc = c->argc;
+        int l;
+
+        memcpy(argv, c->argv, argc * sizeof(char *));
+        if (argc == 1 && (c->t == CMD_LISTL || c->t == CMD_LISTG || c->t == CMD_LISTU))
+            argv[argc++] = frame;
+
+        l = formatCmd(c->line, c->t, argv, argc);
+        c->sent = 1;
+        c->cached = !fresh && isCachable(c->t, c->argv, c->argc) ? findCached(c->line) : NULL;
+        if (c->cached)
+            continue;
+        if (c->t == CMD_RELOAD || (c->t == CMD_WATCH && remembers(c->argv, c->argc)))
+            fresh = 1;
+
+        if (len)
+            msg[len++] = '\n';
+        memcpy(msg + len, c->line, l);
+        len += l;
+
+        if (isResume(c->t, c->argc))
+            break;
+    }
+    return len ? SendFrame(s, PROT_CMD, msg, len) : 0;
+}
+
+void mainloop(SOCKET l)
+{
+    char frame[12] = { 0 };
+    
+    s_listen = l;
+
+    /* setup default frame */
+    frame[0] = '1';
+    
+    while (1) {
+        int rc;
+        int line = 1;
+        char * file;
+        char * fullpath;
+        Session * ss;
+        SOCKET s;
+        SocketBuf * sb;
+        SocketBuf * rsb;
+        int resumed;
+        
+        if (!waitForBreak(l, &ss)) {
+            printf("Remote script is over!\n");
+            break;
+        }
+        s = ss->s;
+        sb = &ss->sb;
+        dropCache();
+        
+        line = ss->line;
+        file = ss->file;
+        fullpath = ss->fullpath;
+        
+        if (s_nseen > 1)
+            printf("Break At \"%s:%d\"(pid %d)\n", file, line, ss->pid);
+        else
+            printf("Break At \"%s:%d\"\n", file, line);
+        showSource(file, line, fullpath, 1);
+        
+        if (prepareSession(ss) < 0 || applyFleetBreakpoints(ss, 0) < 0 || applyOps(ss) < 0) {
+            printf("Socket or protocol error!\n");
+            dropSession(ss);
+            continue;
+        }
+        
+        resumed = 0;
+        while (1) {
+            QueuedCmd * c;
+            char ** argv;
+            int argc;
+            CmdType t;
+
+            //Prompt user when the commands typed are all done...
+            if (s_iqueue >= s_nqueue) {
+                char buf[CMD_LINE];
+
+                printf("?>");
+                if (!readLine(ss, buf)) {
+                    printf("Bye\n");
+                    exit(0);
+                }
+                queueCommands(buf);
+                if (!s_nqueue) {
+                    printf("Invalid command! Type 'h' for help.\n");
+                    continue;
+                }
+            }
+            c = &s_queue[s_iqueue++];
+            argv = c->argv;
+            argc = c->argc;
+            t = c->t;
+            if (argc < 1 || t == CMD_INVALID) {
+                printf("Invalid command! Type 'h' for help.\n");
+                continue;
+            }
+
+            if (t == CMD_QUIT) {
+                printf("Bye\n");
+                exit(0);
+            }
+
+            if (t == CMD_WNEXT) {
+                if (s_w_next < 0) {
+                    printf("No more to watch!\n");
+                    continue;
+                }
+                snprintf(c->buf, CMD_LINE, "w %.*s %d %d", CMD_LINE - 32, s_w_base, s_w_next, s_w_limit);
+                argc = c->argc = extractArgs(c->buf, argv);
+                t = c->t = CMD_WATCH;
+            }
+
+            if (t == CMD_WATCH) {
+                int i;
+                int base = watchArgs(argv, argc);
+
+                s_w_base[0] = 0;
+                for (i = 1; i < base; ++i) {
+                    if (i > 1)
+                        strcat(s_w_base, " ");
+                    strcat(s_w_base, argv[i]);
+                }
+                s_w_limit = atoi(argv[base + 1]);
+            }
+
+            if (t == CMD_HELP) {
+                showHelp();
+                continue;
+            }
+
+            if (t == CMD_SESSIONS) {
+                listSessions(ss);
+                continue;
+            }
+
+            if (t == CMD_FOCUS) {
+                if (focusSession(ss, atoi(argv[1]))) {
+                    //The commands after it go to the session served next
+                    resumed = 1;
+                    break;
+                }
+                continue;
+            }
+
+            if (t == CMD_REFRESH) {
+                dropCache();
+                continue;
+            }
+
+            if (t == CMD_ON) {
+                if (onSessions(ss, file, argv, argc) < 0) {
+                    printf("Socket or protocol error!\n");
+                    dropSession(ss);
+                    break;
+                }
+                continue;
+            }
+
+            if (t == CMD_FRAME) {
+                if (argc == 2) {
+                    strncpy(frame, argv[1], sizeof(frame));
+                    frame[sizeof(frame) - 1] = 0;
+                } else {
+                    printf("Current default level: %s\n", frame);
+                }
+                continue;
+            }
+            
+            if (t == CMD_ASD) {
+                if (argc == 2) {
+                    addSourceDir(argv[1]);
+                }
+                continue;
+            }
+            
+            if (t == CMD_LS) {
+                line = ls(file, line, fullpath, argc, (const char **)argv);
+                continue;
+            }
+
+            if (t == CMD_BLOAD || t == CMD_BSAVE) {
+                if (t == CMD_BLOAD)
+                    rc = loadBreakpoints(argv[1]) < 0 ? 0 : applyFleetBreakpoints(ss, 1);
+                else
+                    rc = saveBreakpoints(ss, argv[1]);
+                if (rc < 0) {
+                    printf("Socket or protocol error!\n");
+                    dropSession(ss);
+                    break;
+                }
+                continue;
+            }
+            
+            //Setup default level
+            if (argc == 1 && (t == CMD_LISTL || t == CMD_LISTG || t == CMD_LISTU)) {
+                argv[argc++] = frame;
+                printf("Use default level: %s\n", frame);
+            }
+            
+            //Send command, and the ones following it...
+            if (!c->sent && sendAhead(s, s_iqueue - 1, frame) < 0) {
+                printf("Socket error!\n");
+                dropSession(ss);
+                break;
+            }
+
+            if (t == CMD_STEP || t == CMD_OUT || t == CMD_RUN || t == CMD_NEXT) {
+                dropCache();
+                resumed = 1;
+                break;
+            }
+
+            if (t == CMD_WATCH && remembers(argv, argc))
+                forgetWatch();
+
+            //Wait for result message, or take it from the cache...
+            if (c->cached) {
+                SB_Replay(&s_replay, c->cached->type, c->cached->data, c->cached->len);
+                rsb = &s_replay;
+                rc = c->cached->type == PROT_OK;
+            }
+            else {
+                rsb = sb;
+                rc = waitForResponseFirstLine(sb);
+                if (rc < 0) {
+                    printf("Socket or protocol error!\n");
+                    dropSession(ss);
+                    break;
+                }
+                if (isCachable(t, argv, argc)) {
+                    s_rec.len = 0;
+                    s_rec.err = 0;
+                    SB_Record(sb, &s_rec);
+                }
+            }
+
+            //Show result...
+            if (rc == 0) {
+                rc = showError(rsb);
+                endRecord(sb, c->line, PROT_ERR, rc);
+                if (rc < 0) {
+                    printf("Socket or protocol error!\n");
+                    dropSession(ss);
+                    break;
+                }
+                continue;
+            }
+
+            switch (t) {
+                case CMD_LISTL:
+                case CMD_LISTU:
+                case CMD_LISTG:
+                {
+                    rc = listL(rsb);
+                    break;
+                }
+
+                case CMD_PRINTSTACK: {
+                    rc = printStack(rsb);
+                    break;
+                }
+
+                case CMD_WATCH: {
+                    rc = watch(rsb);
+                    break;
+                }
+//
+//                case CMD_EXEC: {
+//                    rc = exec(sb);
+//                    break;
+//                }
+//
+                case CMD_SETB: {
+                    rc = SB_Read(sb, SB_R_LEFT);
+                    assert(sb->end);
+                    addFleetBreakpoint(ss, strcmp(argv[1], ".") ? argv[1] : file, argv, argc);
+                    break;
+                }
+
+                case CMD_DELB:
+                case CMD_ENB:
+                case CMD_DISB:
+                {
+                    //No content in this case, so read out the rest and drop it.
+                    rc = SB_Read(sb, SB_R_LEFT);
+                    assert(sb->end);
+                    break;
+                }
+
+                case CMD_LISTB: {
+                    rc = listB(sb);
+                    break;
+                }
+
+                case CMD_MEMORY: {
+                    rc = watchM(rsb, argv, argc);
+                    break;
+                }
+
+                case CMD_RELOAD: {
+                    //The functions reloaded may show in the replies cached
+                    dropCache();
+                    rc = listRL(sb);
+                    break;
+                }
+
+                case CMD_BUDGET: {
+                    if (argc == 1) {
+                        rc = listPB(sb);
+                        break;
+                    }
+                    rc = SB_Read(sb, SB_R_LEFT);
+                    assert(sb->end);
+                    break;
+                }
+
+                case CMD_STATE: {
+                    if (argc == 1) {
+                        rc = listS(sb);
+                        break;
+                    }
+                    //Switched, the state taking the session sends its break
+                    rc = SB_Read(sb, SB_R_LEFT);
+                    assert(sb->end);
+                    break;
+                }
+
+                default: {
+                    assert(0 && "Impossibility!");
+                }
+            }
+            endRecord(sb, c->line, PROT_OK, rc);
+
+            if (rc < 0) {
+                printf("Socket or protocol error!\n");
+                dropSession(ss);
+                break;
+            }
+
+            if (t == CMD_STATE && argc == 2) {
+                resumed = 1;
+                break;
+            }
+        }
+
+        //The replies sent ahead are gone with the session
+        if (!resumed)
+            s_nqueue = s_iqueue = 0;
+    }
+}
+
+int extractArgs(char * buf, char * argv[])
+{
+    char * p = buf;
+    int argc = 0;
+
+    while (*p && argc < MAX_ARGS) {
+        while (isspace(*p))
+            ++p;
+        if (!*p)
+            break;
+
+        argv[argc++] = p;
+        if (*p != '"') {
+            while (!isspace(*p) && *p)
+                ++p;
+            if (isspace(*p))
+                *p++ = 0;
+        }
+        else {
+            while (*++p != '"' && *p);
+            if (!*p)
+                return -1;  //End '"' not found!
+            *++p = 0;
+            ++p;
+        }
+    }
+    return argc;
+}
+
+static int allDigits(char * str)
+{
+    while (isdigit(*str))
+        ++str;
+    return *str ? 0 : 1;
+}
+
+//N or N/T
+static int isRate(char * str)
+{
+    char * slash = strchr(str, '/');
+    if (slash) {
+        *slash = 0;
+        if (!*str || !allDigits(str) || !slash[1] || !allDigits(slash + 1)) {
+            *slash = '/';
+            return 0;
+        }
+        *slash = '/';
+        return 1;
+    }
+    return *str && allDigits(str);
+}
+
+//Breakpoint options: limit N/T, sample K
+static int validBreakOptions(char * argv[], int argc)
+{
+    int i;
+    if (argc % 2)
+        return 0;
+
+    for (i = 0; i < argc; i += 2) {
+        if (!strcmp(argv[i], "limit")) {
+            if (!isRate(argv[i + 1]))
+                return 0;
+        }
+        else if (!strcmp(argv[i], "sample")) {
+            if (!*argv[i + 1] || !allDigits(argv[i + 1]) || !atoi(argv[i + 1]))
+                return 0;
+        }
+        else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+CmdType validateArgs(char * argv[], int argc)
+{
+    CmdType t = CMD_INVALID;
+
+    if (argc > 0) {
+        char * p = argv[0];
+
+        if (!strcmp(p, "s")) {
+            if (argc == 1)
+                t = CMD_STEP;
+        }
+        else if (!strcmp(p, "n")) {
+            if (argc == 1)
+                t = CMD_NEXT;
+        }
+        else if (!strcmp(p, "o")) {
+            if (argc == 1)
+                t = CMD_OUT;
+        }
+        else if (!strcmp(p, "r") || !strcmp(p, "c")) {
+            if (argc == 1)
+                t = CMD_RUN;
+        }
+        else if (!strcmp(p, "ll")) {
+            if (argc == 1 || (argc == 2 && allDigits(argv[1])))
+                t = CMD_LISTL;
+        }
+        else if (!strcmp(p, "lu")) {
+            if (argc == 1 || (argc == 2 && allDigits(argv[1])))
+                t = CMD_LISTU;
+        }
+        else if (!strcmp(p, "lg")) {
+            if (argc == 1 || (argc == 2 && allDigits(argv[1])))
+                t = CMD_LISTG;
+        }
+        else if (!strcmp(p, "w")) {
+            int i = watchArgs(argv, argc);
+            if (i > 0 && argc - i <= 2 && (i == argc || allDigits(argv[i]))
+                && (i + 1 >= argc || allDigits(argv[i + 1])))
+                t = CMD_WATCH;
+        }
+        else if (!strcmp(p, "wn")) {
+            if (argc == 1)
+                t = CMD_WNEXT;
+        }
+        else if (!strcmp(p, "ps") || !strcmp(p, "bt")) {
+            if (argc == 1)
+                t = CMD_PRINTSTACK;
+        }
+        else if (!strcmp(p, "sb") || !strcmp(p, "b")) {
+            if (argc >= 3 && allDigits(argv[2]) && validBreakOptions(argv + 3, argc - 3))
+                t = CMD_SETB;
+        }
+        else if (!strcmp(p, "db")) {
+            if (argc == 2 && allDigits(argv[1]))
+                t = CMD_DELB;
+        }
+        else if (!strcmp(p, "lb")) {
+            if (argc == 1)
+                t = CMD_LISTB;
+        }
+        else if (!strcmp(p, "bload")) {
+            if (argc == 2)
+                t = CMD_BLOAD;
+        }
+        else if (!strcmp(p, "bsave")) {
+            if (argc == 2)
+                t = CMD_BSAVE;
+        }
+        else if (!strcmp(p, "reload")) {
+            if (argc == 2 || argc == 3)
+                t = CMD_RELOAD;
+        }
+        else if (!strcmp(p, "pb")) {
+            if (argc == 1 || (argc == 2 && isRate(argv[1])))
+                t = CMD_BUDGET;
+        }
+        else if (!strcmp(p, "dis")) {
+            if (argc == 2 && allDigits(argv[1]))
+                t = CMD_DISB;
+        }
+        else if (!strcmp(p, "en")) {
+            if (argc == 2 && allDigits(argv[1]))
+                t = CMD_ENB;
+        }
+        else if (!strcmp(p, "m")) {
+            if (argc == 3) {
+                char * end;
+                char * end2;
+                strtoul(argv[1], &end, 0);
+                strtoul(argv[2], &end2, 0);
+                if (!*end && !*end2)
+                    t = CMD_MEMORY;
+            }
+        }
+        else if (!strcmp(p, "h")) {
+            t = CMD_HELP;
+        }
+        else if (!strcmp(p, "f")) {
+            if (argc == 1 || (argc == 2 && allDigits(argv[1])))
+                t = CMD_FRAME;
+        }
+        else if (!strcmp(p, "asd")) {
+            if (argc == 2)
+                t = CMD_ASD;
+        }
+        else if (!strcmp(p, "ls") || !strcmp(p, "l")) {
+            t = CMD_LS;
+        }
+        else if (!strcmp(p, "st")) {
+            if (argc == 1 || (argc == 2 && allDigits(argv[1])))
+                t = CMD_STATE;
+        }
+        else if (!strcmp(p, "q") || !strcmp(p, "quit")) {
+            t = CMD_QUIT;
+        }
+        else if (!strcmp(p, "ss")) {
+            if (argc == 1)
+                t = CMD_SESSIONS;
+        }
+        else if (!strcmp(p, "focus")) {
+            if (argc == 2 && allDigits(argv[1]))
+                t = CMD_FOCUS;
+        }
+        else if (!strcmp(p, "on")) {
+            if (argc >= 3)
+                t = CMD_ON;
+        }
+        else if (!strcmp(p, "refresh")) {
+            if (argc == 1)
+                t = CMD_REFRESH;
+        }
+    }
+    return t;
+}
+
+/*
+** Return the index of the offset argument of w(argc when there's none), or -1
+** when the arguments before it are invalid.
+*/
+int watchArgs(char * argv[], int argc)
+{
+    int i;
+
+    if (argc > 3 && allDigits(argv[1]) && argv[2][0] && argv[2][1] == 0
+        && strchr("lug", argv[2][0]))
+        i = 4;
+    else if (argc > 1 && (argv[1][0] == '|' || argv[1][0] == '#'))
+        i = 2;
+    else
+        return -1;
+
+    if (i < argc && !strcmp(argv[i], "r"))
+        ++i;
+    return i;
+}
+
+/*
+** Ask w for the first page of a table, when offset or limit is not given.
+*/
+void pageWatch(char * argv[], int * argc)
+{
+    static char offset[] = "0";
+    static char limit[] = W_PAGE;
+    int i = watchArgs(argv, *argc);
+
+    if (*argc == i)
+        argv[(*argc)++] = offset;
+    if (*argc == i + 1)
+        argv[(*argc)++] = limit;
+}
+
+/*
+** Put the command line of t and its arguments in cmdline, return its length.
+*/
+int formatCmd(char * cmdline, CmdType t, char * argv[], int argc)
+{
+    //The buffer size is exactly the same with the one used by fgets in main().
+    //So it's convenient to use strcat without worrying about buffer overflow!
+    const char * cmd = g_cmds[t];
+    int i;
+
+    strcpy(cmdline, cmd);
+    for (i = 1; i < argc; i++) {
+        strcat(cmdline, " ");
+        strcat(cmdline, argv[i]);
+    }
+    return (int)strlen(cmdline);
+}
+
+int sendCmd(SOCKET s, CmdType t, char * argv[], int argc)
+{
+    char cmdline[CMD_LINE];
+    return SendFrame(s, PROT_CMD, cmdline, formatCmd(cmdline, t, argv, argc));
+}
+
+int waitForBreakOrQuit(SocketBuf * sb, const char ** file, const char ** lineno, const char ** fullpath)
+{
+    int rc;
+    char * p = sb->lbuf;
+    
+    rc = SB_Next(sb);
+    if (rc == PROT_QUIT)
+        return 0;
+    if (rc != PROT_BREAK)
+        return -1;
+
+    rc = SB_Read(sb, SB_R_LEFT);
+    if (rc < 0 || !sb->end)
+        return -1;
+
+    *file = p;
+    p = strchr(p, '\n');
+    if (!p)
+        return -1;
+    *p++ = 0;
+    *lineno = p;
+    p = strchr(p, '\n');
+    if (!p)
+        return -1;
+    *p++ = 0;
+    s_remote_pid = atoi(p);
+    p = strchr(p, '\n');
+    if (!p)
+        return -1;
+    *p++ = 0;
+    *fullpath = p;
+    p = strchr(p, '\n');
+    if (!p)
+        return -1;
+    *p = 0;
+    return 1;
+}
+
+int waitForResponseFirstLine(SocketBuf * sb)
+{
+    int rc = SB_Next(sb);
+    if (rc == PROT_OK) {
+        return 1;
+    }
+    else if (rc == PROT_ERR) {
+        return 0;
+    }
+    return -1;
+}
+
+int showError(SocketBuf * sb)
+{
+    char * p = sb->lbuf;
+    if (SB_Read(sb, SB_R_LEFT) < 0 || !sb->end)
+        return -1;
+
+    fprintf(stdout, "%s", p);
+    return 0;
+}
+
+typedef enum
+{
+    LV_NAME = 1,
+    LV_VALUE
+} State_lv;
+
+static int lv(State_lv * st, const char * str, int length);
+
+int listL(SocketBuf * sb)
+{
+    State_lv st = LV_NAME;
+    s_raw = 0;
+    return SB_ReadAndParse(sb, "\n", (UserParser)lv, &st);
+}
+
+static const char * typestr(char t)
+{
+    const char * tstr;
+    switch (t) {
+        case 's':
+            tstr = "STR";
+            break;
+        case 'n':
+            tstr = "NUM";
+            break;
+        case 't':
+            tstr = "TAB";
+            break;
+        case 'f':
+            tstr = "FNC";
+            break;
+        case 'u':
+            tstr = "URD";
+            break;
+        case 'U':
+            tstr = "LUD";
+            break;
+        case 'b':
+            tstr = "BLN";
+            break;
+        case 'l':
+            tstr = "NIL";
+            break;
+        case 'd':
+            tstr = "THD";
+            break;
+        default:
+            tstr = "";
+    }
+    return tstr;
+}
+
+static void output(const char * str, int length)
+{
+    fwrite(str, 1, length, stdout);
+}
+
+static int outputStr(const char * str, int length)
+{
+    const char * end = str + length;
+    const char * p = strchr(str, ':');
+    int len;
+    if (!p || p > end)
+        return -1;
+    output(str, p - str);
+    str = p + 1;
+    fputs(" Length:", stdout);
+    p = strchr(str, ':');
+    if (!p || p > end)
+        return -1;
+    output(str, p - str);
+    fputs(" Truncated-to:", stdout);
+    str = p + 1;
+    p = strchr(str, ':');
+    if (!p || p > end)
+        return -1;
+    output(str, p - str);
+    fputs(" Content:", stdout);
+    len = strtol(str, NULL, 10);
+    str = p + 1;
+    if (end != str || len < 0)
+        return -1;
+
+    //The content follows raw
+    s_raw = len;
+    return len;
+}
+
+/*
+** Return 0 when done, a negative on error, or the bytes of a string to come,
+** which are to be passed here too.
+*/
+static int printVar(const char * str, int length)
+{
+    const char * tstr;
+
+    if (s_raw > 0) {
+        fwrite(str, 1, length, stdout);
+        s_raw -= length;
+        return s_raw;
+    }
+
+    tstr = typestr(str[0]);
+    if (*tstr == 0)
+        return -1;
+
+    fputs("Type:", stdout);
+    fputs(tstr, stdout);
+    fputs(" \tValue:", stdout);
+    switch(str[0]) {
+        case 's': {
+            return outputStr(str + 1, length - 1);
+        }
+
+        case 'n':
+        case 'b':
+        case 'U':
+        {
+            output(str + 1, length - 1);
+            break;
+        }
+
+        case 't':
+        case 'f':
+        case 'u':
+        case 'd':
+        {
+            //The handle, for w #<ref>
+            const char * ref = memchr(str, '#', length);
+            if (!ref)
+                ref = str + length;
+            output(str + 1, ref - str - 1);
+            if (ref < str + length) {
+                fputs(" \tRef:", stdout);
+                output(ref, str + length - ref);
+            }
+            break;
+        }
+
+        case 'l':
+            fprintf(stdout, "nil");
+            break;
+    }
+    return 0;
+}
+
+int lv(State_lv * st, const char * str, int length)
+{
+    if (*st == LV_NAME) {
+        fprintf(stdout, "Name:");
+        output(str, length);
+        fputc(' ', stdout);
+        fputc('\t', stdout);
+        *st = LV_VALUE;
+    }
+    else {
+        int rc = printVar(str, length);
+        if (rc != 0)
+            return rc < 0 ? -3 : rc;
+
+        fputc('\n', stdout);
+        *st = LV_NAME;
+    }
+    return 0;
+}
+
+typedef enum
+{
+    PS_FILE,
+    PS_LINE,
+    PS_NAME,
+    PS_WHAT
+} State_ps;
+
+static int ps(State_ps * st, const char * word, int length);
+
+int printStack(SocketBuf * sb)
+{
+    State_ps st = PS_FILE;
+    return SB_ReadAndParse(sb, "\n", (UserParser)ps, &st);
+}
+
+int ps(State_ps * st, const char * word, int length)
+{
+    switch (*st) {
+        case PS_FILE: {
+            fputs("At \"", stdout);
+            output(word, length);
+            fputc(':', stdout);
+            *st = PS_LINE;
+            break;
+        }
+        case PS_LINE: {
+            output(word, length);
+            fputs("\" \t", stdout);
+            *st = PS_NAME;
+            break;
+        }
+        case PS_NAME: {
+            output(word, length);
+            fputs(" \t", stdout);
+            *st = PS_WHAT;
+            break;
+        }
+        case PS_WHAT: {
+            output(word, length);
+            fputc('\n', stdout);
+            *st = PS_FILE;
+            break;
+        }
+    }
+    return 0;
+}
+
+typedef enum
+{
+    W_VAR = 1,  //for all
+    W_META,     //for all
+    W_ALEN,     //for table
+    W_HCOUNT,   //for table
+    W_KEY,      //for table
+    W_VAL,      //for table
+    W_SIZE,     //for full userdata
+    W_WHAT,     //for function
+    W_SRC,      //for function
+    W_FIRSTLINE,//for function
+    W_LASTLINE, //for function
+    W_STATUS    //for thread
+} State_w;
+
+typedef struct
+{
+    State_w st;
+    State_w st2;    //What state after W_META
+} Arg_w;
+
+static int w(Arg_w * args, const char * word, int length);
+
+int watch(SocketBuf * sb)
+{
+    Arg_w args = { W_VAR, 0 };
+    s_w_next = -1;
+    s_raw = 0;
+    return SB_ReadAndParse(sb, "\n", (UserParser)w, &args);
+}
+
+int w(Arg_w * args, const char * word, int length)
+{
+    int rc;
+
+    switch (args->st) {
+        case W_ALEN: {
+            fputs("ArrayPart:", stdout);
+            output(word, length);
+            args->st = W_HCOUNT;
+            break;
+        }
+
+        case W_HCOUNT: {
+            fputs(" \tHashPart:~", stdout);
+            output(word, length);
+            fputc('\n', stdout);
+            args->st = W_KEY;
+            break;
+        }
+
+        case W_KEY: {
+            //The page is over, the next one starts from here
+            if (!s_raw && word[0] == '+') {
+                s_w_next = atoi(word + 1);
+                printf("-- More from %d, 'wn' for the next page.\n", s_w_next);
+                args->st = 0;
+                break;
+            }
+            if (!s_raw)
+                fputs("--------------------------------------------------\n", stdout);
+            if ((rc = printVar(word, length)) != 0)
+                return rc < 0 ? -3 : rc;
+            fputc('\n', stdout);
+            args->st = W_VAL;
+            break;
+        }
+
+        case W_VAL: {
+            if ((rc = printVar(word, length)) != 0)
+                return rc < 0 ? -3 : rc;
+            fputc('\n', stdout);
+            args->st = W_KEY;
+            break;
+        }
+
+        case W_VAR: {
+            //The raw bytes of a string tell nothing of the type
+            if (!s_raw) {
+                switch (word[0]) {
+                    case 't': {
+                        args->st2 = W_ALEN;
+                        break;
+                    }
+                    case 'u': {
+                        args->st2 = W_SIZE;
+                        break;
+                    }
+                    case 'f': {
+                        args->st2 = W_WHAT;
+                        break;
+                    }
+                    case 'd': {
+                        args->st2 = W_STATUS;
+                        break;
+                    }
+                    default: {
+                        args->st2 = 0;
+                    }
+                }
+            }
+            if ((rc = printVar(word, length)) != 0)
+                return rc < 0 ? -3 : rc;
+            fputc('\n', stdout);
+            args->st = W_META;
+            break;
+        }
+
+        case W_META: {
+            if (length != 1)
+                return -3;
+
+            if (word[0] == '1') {
+                fputs("HasMetatable:Yes\n", stdout);
+            }
+            else {
+                fputs("HasMetatable:No\n", stdout);
+            }
+            args->st = args->st2;
+            break;
+        }
+
+        case W_SIZE: {
+            fputs("Size:", stdout);
+            output(word, length);
+            fputc('\n', stdout);
+            args->st = 0;
+            break;
+        }
+
+        case W_WHAT: {
+            fputs("What:", stdout);
+            output(word, length);
+            args->st = W_SRC;
+            break;
+        }
+
+        case W_SRC: {
+            fputs(" \tFile:", stdout);
+            output(word, length);
+            args->st = W_FIRSTLINE;
+            break;
+        }
+
+        case W_FIRSTLINE: {
+            fputs(" \tLineDefined:", stdout);
+            output(word, length);
+            args->st = W_LASTLINE;
+            break;
+        }
+
+        case W_LASTLINE: {
+            fputs(" \tLastLine:", stdout);
+            output(word, length);
+            fputc('\n', stdout);
+            args->st = 0;
+            break;
+        }
+
+        case W_STATUS: {
+            fputs("Status:", stdout);
+            output(word, length);
+            fputc('\n', stdout);
+            args->st = 0;
+            break;
+        }
+
+        default: {
+            return -3;
+        }
+    }
+    return 0;
+}
+
+typedef enum
+{
+    LB_IDX,
+    LB_FILE,
+    LB_LINE,
+    LB_ENABLE,
+    LB_HITS,
+    LB_SKIPS,
+    LB_LIMIT,
+    LB_PERIOD,
+    LB_SAMPLE,
+} State_lb;
+
+typedef struct
+{
+    State_lb st;
+    int limit;
+} Arg_lb;
+
+static int lb(Arg_lb * args, const char * word, int length);
+
+int listB(SocketBuf * sb)
+{
+    Arg_lb args = { LB_IDX, 0 };
+    return SB_ReadAndParse(sb, "\n", (UserParser)lb, &args);
+}
+
+int lb(Arg_lb * args, const char * word, int length)
+{
+    State_lb * st = &args->st;
+
+    switch (*st) {
+    case LB_IDX:
+        output(word, length);
+        fputs(". ", stdout);
+        *st = LB_FILE;
+        break;
+    case LB_FILE:
+        fputc('"', stdout);
+        output(word, length);
+        fputc(':', stdout);
+        *st = LB_LINE;
+        break;
+    case LB_LINE:
+        output(word, length);
+        fputs("\"", stdout);
+        *st = LB_ENABLE;
+        break;
+    case LB_ENABLE:
+        fputs(*word == '0' ? ", disable" : ", enable", stdout);
+        *st = LB_HITS;
+        break;
+    case LB_HITS:
+        fputs(", hits ", stdout);
+        output(word, length);
+        *st = LB_SKIPS;
+        break;
+    case LB_SKIPS:
+        if (*word != '0') {
+            fputs(", skipped ", stdout);
+            output(word, length);
+        }
+        *st = LB_LIMIT;
+        break;
+    case LB_LIMIT:
+        args->limit = atoi(word);
+        if (args->limit) {
+            fputs(", limit ", stdout);
+            output(word, length);
+        }
+        *st = LB_PERIOD;
+        break;
+    case LB_PERIOD:
+        if (args->limit) {
+            fputc('/', stdout);
+            output(word, length);
+            fputc('s', stdout);
+        }
+        *st = LB_SAMPLE;
+        break;
+    case LB_SAMPLE:
+        if (atoi(word) > 1) {
+            fputs(", sample 1/", stdout);
+            output(word, length);
+        }
+        fputc('\n', stdout);
+        *st = LB_IDX;
+        break;
+    default:
+        assert(0);
+    }
+    return 0;
+}
+
+static int lrl(void * args, const char * word, int length);
+
+int listRL(SocketBuf * sb)
+{
+    return SB_ReadAndParse(sb, "\n", (UserParser)lrl, NULL);
+}
+
+int lrl(void * args, const char * word, int length)
+{
+    fputs("Reloaded ", stdout);
+    output(word, length);
+    fputc('\n', stdout);
+    return 0;
+}
+
+typedef enum
+{
+    PB_LIMIT,
+    PB_PERIOD,
+    PB_COUNT,
+} State_pb;
+
+typedef struct
+{
+    State_pb st;
+    int limit;
+} Arg_pb;
+
+static int lpb(Arg_pb * args, const char * word, int length);
+
+int listPB(SocketBuf * sb)
+{
+    Arg_pb args = { PB_LIMIT, 0 };
+    return SB_ReadAndParse(sb, "\n", (UserParser)lpb, &args);
+}
+
+int lpb(Arg_pb * args, const char * word, int length)
+{
+    switch (args->st) {
+    case PB_LIMIT:
+        args->limit = atoi(word);
+        if (args->limit) {
+            fputs("Pause budget: ", stdout);
+            output(word, length);
+        } else {
+            fputs("No pause budget\n", stdout);
+        }
+        args->st = PB_PERIOD;
+        break;
+    case PB_PERIOD:
+        if (args->limit) {
+            fputc('/', stdout);
+            output(word, length);
+            fputc('s', stdout);
+        }
+        args->st = PB_COUNT;
+        break;
+    case PB_COUNT:
+        if (args->limit) {
+            fputs(", used ", stdout);
+            output(word, length);
+            fputc('\n', stdout);
+        }
+        args->st = PB_LIMIT;
+        break;
+    default:
+        assert(0);
+    }
+    return 0;
+}
+
+typedef enum
+{
+    LS_IDX,
+    LS_STATE,
+    LS_STATUS,
+    LS_FILE,
+    LS_LINE,
+} State_ls;
+
+typedef struct
+{
+    State_ls st;
+    int paused;
+} Arg_ls;
+
+static int lst(Arg_ls * args, const char * word, int length);
+
+int listS(SocketBuf * sb)
+{
+    Arg_ls args = { LS_IDX, 0 };
+    return SB_ReadAndParse(sb, "\n", (UserParser)lst, &args);
+}
+
+int lst(Arg_ls * args, const char * word, int length)
+{
+    switch (args->st) {
+    case LS_IDX:
+        output(word, length);
+        fputs(". ", stdout);
+        args->st = LS_STATE;
+        break;
+    case LS_STATE:
+        output(word, length);
+        args->st = LS_STATUS;
+        break;
+    case LS_STATUS:
+        if (*word == 'c')
+            fputs(" \tcurrent", stdout);
+        else if (*word == 'p')
+            fputs(" \tpaused", stdout);
+        else
+            fputs(" \trunning", stdout);
+        args->paused = *word != 'r';
+        args->st = LS_FILE;
+        break;
+    case LS_FILE:
+        if (args->paused) {
+            fputs(" at \"", stdout);
+            output(word, length);
+            fputc(':', stdout);
+        }
+        args->st = LS_LINE;
+        break;
+    case LS_LINE:
+        if (args->paused) {
+            output(word, length);
+            fputc('"', stdout);
+        }
+        fputc('\n', stdout);
+        args->st = LS_IDX;
+        break;
+    default:
+        assert(0);
+    }
+    return 0;
+}
+
+static int provide(SocketBuf * sb, const char ** buf, size_t * size);
+
+int watchM(SocketBuf * sb, char * argv[], int argc)
+{
+    unsigned int addr = strtoul(argv[1], NULL, 0);
+    return Dump(addr, (DataProvider)provide, sb, stdout, NULL, NULL);
+}
+
+int provide(SocketBuf * sb, const char ** buf, size_t * size)
+{
+    int l;
+
+    if (sb->end)
+        return 0;
+
+    l = SB_Read(sb, SB_R_LEFT);
+    if (l < 0)
+        return -1;
+    *size = l;
+    *buf = sb->lbuf;
+    return l > 0 ? 1 : 0;
+}
+
+static const char *HELP_CONTENT =
+"RLdb 2.0.0 Copyright (C) 2009 Zhang Lei(louirobert@gmail.com) All rights reserved.\n"
+"Modified lldbg 1.0 Copyright (C) 2016 Wen Xichang(wenxichang@163.com)\n"
+"\n"
+"Valid commands:\n"
+"  sb or b <file-path> <line-no> [limit <N>/<T>] [sample <K>]\n"
+"                                      -- Set a breakpoint(also set in forked processes),\n"
+"                                         pausing at most N times every T seconds, or\n"
+"                                         once in K hits(random)\n"
+"  db <index>                          -- Delete a breakpoint(lb to list breakpoint)\n"
+"  en <index>                          -- Enable a breakpoint\n"
+"  dis <index>                         -- Disable a breakpoint\n"
+"  lb                                  -- List breakpoints, with hits and skipped hits\n"
+"  bload <file>                        -- Set the breakpoints in file in one go, each line\n"
+"                                         \"<file-path> <line-no> [options]\", # for comments\n"
+"  bsave <file>                        -- Save breakpoints to file\n"
+"  pb [N/T]                            -- Show or set the pause budget: at most N\n"
+"                                         breakpoint pauses every T seconds, 0 for none\n"
+"  f <stack-level>                     -- Set default stack-level for lg/ll/lu\n"
+"  lg [stack-level]                    -- List globals\n"
+"  ll [stack-level]                    -- List locals\n"
+"  lu [stack-level]                    -- List upvalues\n"
+"  m <start-address> <length>          -- Watch memory\n"
+"  n                                   -- Run to next line\n"
+"  o                                   -- Step out\n"
+"  ps or bt                            -- Print calling stack\n"
+"  r or c                              -- Run program until a breakpoint\n"
+"  s                                   -- Step into\n"
+"  w <stack-level> <l|u|g> <variable-name>[properties] [r] [offset [limit]]\n"
+"    or w <properties> [r] [offset [limit]]\n"
+"    or w #<ref>[properties] [r] [offset [limit]]\n"
+"                                      -- Watch a variable, a table "W_PAGE" pairs a page\n"
+"  wn                                  -- Watch the next page of the table\n"
+"  asd <source-dir>                    -- Add source dir for source searching\n"
+"  ls [file] [lineno] [count]          -- View source code\n"
+"  st [index]                          -- List lua states, or switch to a paused one\n"
+"  ss                                  -- List debuggee processes, with pid, host and state\n"
+"  focus <pid>                         -- Serve another paused process, this one stays paused\n"
+"  on <pid>[,<pid>...]|all <sb|db|en|dis ...>\n"
+"                                      -- Set/delete/enable/disable a breakpoint in the\n"
+"                                         processes chosen, running ones at their next break\n"
+"  reload <file-path> [function]       -- Reload the functions of a file(. for current)\n"
+"  refresh                             -- Fetch again the replies of ps/ll/lu/lg/w/m, which\n"
+"                                         are kept till the program runs\n"
+"  <command>; <command>...             -- Run several commands in one round trip, the ones\n"
+"                                         after a resume command(s/n/o/r) at the next break\n"
+"\n"
+"  q or quit                           -- Quit debugger\n"
+"  ctrl+c                              -- Break program(local host only)\n";
+
+void showHelp()
+{
+    fputs(HELP_CONTENT, stdout);
+}
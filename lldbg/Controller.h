@@ -0,0 +1,97 @@
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#ifndef __CONTROLLER_H__
+#define __CONTROLLER_H__
+
+#include "SocketBuf.h"
+
+/*
+** Sessions of lldbg, shared by the command line(Controller.c) and the debug
+** adapter(Dap.c).
+*/
+
+//A connected debuggee process
+typedef struct
+{
+    SOCKET s;
+    int pid;
+    int local;
+    int nbp;        //Number of fleet breakpoints applied
+    int ring;       //By a unix socket, set up the shared memory ring at break
+    int lz;         //Ask for compressed replies at break
+    char host[48];  //Peer address
+    int paused;     //Broke while another one is served, at file:line
+    int gone;       //Over, dropped by waitForBreak
+    int line;
+    char file[128];
+    char fullpath[1024];
+    char * ops;     //Breakpoint commands queued by on, sent at the next break
+    int nops;
+    SocketBuf sb;
+} Session;
+
+#define MAX_SESSION 64
+extern Session g_sessions[MAX_SESSION];
+extern int g_nsession;
+
+void acceptSession(SOCKET l);
+void dropSession(Session * ss);
+
+/*
+** Add the sockets of the running sessions but focus to rfds, and set *pending
+** when one has a message received already. Return the max fd.
+*/
+SOCKET watchSessions(fd_set * rfds, SOCKET maxfd, Session * focus, int * pending);
+
+/*
+** Read the BREAK or QUIT messages come to the sessions watched, a session
+** breaking is paused and one quitting is gone. Tell it when prompting, the
+** prompt is printed already.
+*/
+void serveSessions(fd_set * rfds, Session * focus, int prompting);
+
+/*
+** Set up the ring and compression of a session at its first break.
+** Return -1 on socket or protocol error.
+*/
+int prepareSession(Session * ss);
+
+/*
+** Read the first line of a reply. Return 1 for OK, 0 for an error message to
+** read, or -1 on socket or protocol error.
+*/
+int waitForResponseFirstLine(SocketBuf * sb);
+
+/*
+** Ask pid to break, or attach to it. Return 0 on success.
+*/
+int notifyRemote(int pid, int checkAgent);
+
+/*
+** Find file reported by lldb in the source dirs(asd, -s), the path found goes
+** to path. Return 0 when it's not found.
+*/
+int findSource(const char * file, char * path, int size);
+
+#endif
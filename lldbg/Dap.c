@@ -0,0 +1,1721 @@
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <strings.h>
+#include <limits.h>
+#include "Controller.h"
+#include "Json.h"
+#include "Dap.h"
+
+/*
+** An editor speaks DAP on stdin/stdout, a debuggee is a thread(id is its pid).
+** A stop prefetches the stack and the locals and upvalues of the top frame in
+** one round trip, and what is fetched is cached till the debuggee runs again,
+** so the editor gets most of its requests answered at once. Tables come in
+** pages, a "..." child at the end of a page has the next.
+*/
+
+//Pairs of a table a page, same as w of the command line
+#define DAP_PAGE 100
+
+//Same as PROT_MAX_BATCH_LEN of lldb
+#define DAP_BATCH 65536
+
+typedef enum
+{
+    REF_FRAME = 1,
+    REF_LOCALS,
+    REF_UPVALUES,
+    REF_GLOBALS,
+    REF_TABLE,
+} RefKind;
+
+//A frameId or variablesReference(its index + 1), good for one stop
+typedef struct
+{
+    RefKind kind;
+    int pid;
+    int stop;
+    int level;      //Stack level of frames and scopes
+    int handle;     //Of a table, by lldb
+    int offset;     //First pair of the page of a table
+    char * vars;    //The variables, a JSON array once fetched
+} Ref;
+
+typedef struct
+{
+    char file[256];
+    int line;
+    char name[128];
+    char what[16];
+} Frame;
+
+/*
+** A value of lldb: a type char and its text, the content for strings.
+*/
+typedef struct
+{
+    char type;
+    char * text;
+    int len;
+    int cap;
+    int size;       //Length of a string, text may be truncated
+    int handle;
+    int raw;        //Bytes of the string still to come
+} Value;
+
+//A variable of the top frame
+typedef struct
+{
+    char name[256];
+    Value v;
+} Var;
+
+//The variables of the top frame lldb sent last by ll or lu d/f, kept by
+//position as lldb does, the next stop gets the ones changed only
+typedef struct
+{
+    Var * vars;
+    int n;
+    int cap;
+    int valid;      //Same as lldb has, it can send a delta
+} VarList;
+
+//A debuggee
+typedef struct
+{
+    int pid;
+    int stop;               //Stops so far, refs of the other ones are stale
+    int stopped;            //The stop is told, or held at entry
+    int held;               //Paused at entry before configurationDone
+    const char * reason;    //Of the next stopped event
+    int bpgen;              //Breakpoints synced
+    Frame * frames;         //Stack of the stop, NULL till fetched
+    int nframe;
+    VarList top[2];         //Locals and upvalues of the top frame
+} Thread;
+
+//Breakpoints set by the editor in a file, by base name as lldb matches
+typedef struct
+{
+    char file[128];
+    int * lines;
+    int nline;
+} Source;
+
+static FILE * s_out;
+static int s_seq;
+
+static char * s_in;
+static int s_nin;
+static int s_capin;
+
+static Ref * s_refs;
+static int s_nref;
+static int s_capref;
+
+static Thread s_threads[MAX_SESSION];
+static int s_nthread;
+
+static Source * s_sources;
+static int s_nsource;
+static int s_bpgen;
+
+static int s_configured;
+static int s_stop_on_entry;
+static int s_accepted;
+static int s_terminated;
+static int s_quit;
+
+//Called after the response of the request being served
+static void (* s_after)(void);
+
+static void sendMessage(JsonBuf * jb)
+{
+    fprintf(s_out, "Content-Length: %d\r\n\r\n", jb->len);
+    fwrite(jb->buf, 1, jb->len, s_out);
+    fflush(s_out);
+}
+
+static void beginMessage(JsonBuf * jb, const char * type)
+{
+    JB_Init(jb);
+    JB_Open(jb, NULL, '{');
+    JB_Int(jb, "seq", ++s_seq);
+    JB_Str(jb, "type", type);
+}
+
+/*
+** Send an event, with body(an object) when it's not NULL.
+*/
+static void sendEvent(const char * event, JsonBuf * body)
+{
+    JsonBuf jb;
+
+    beginMessage(&jb, "event");
+    JB_Str(&jb, "event", event);
+    if (body && body->len)
+        JB_Raw(&jb, "body", body->buf, body->len);
+    JB_Close(&jb, '}');
+    if (!jb.err)
+        sendMessage(&jb);
+    JB_Free(&jb);
+}
+
+static void sendResponse(Json * req, const char * err, JsonBuf * body)
+{
+    JsonBuf jb;
+
+    beginMessage(&jb, "response");
+    JB_Int(&jb, "request_seq", (long long)Json_GetNum(req, "seq", 0));
+    JB_Bool(&jb, "success", err == NULL);
+    JB_Str(&jb, "command", Json_GetStr(req, "command", ""));
+    if (err)
+        JB_Str(&jb, "message", err);
+    else if (body->len)
+        JB_Raw(&jb, "body", body->buf, body->len);
+    JB_Close(&jb, '}');
+    if (jb.err) {
+        JB_Free(&jb);
+        beginMessage(&jb, "response");
+        JB_Int(&jb, "request_seq", (long long)Json_GetNum(req, "seq", 0));
+        JB_Bool(&jb, "success", 0);
+        JB_Str(&jb, "command", Json_GetStr(req, "command", ""));
+        JB_Str(&jb, "message", "Out of memory!");
+        JB_Close(&jb, '}');
+    }
+    sendMessage(&jb);
+    JB_Free(&jb);
+}
+
+static Thread * findThread(int pid)
+{
+    int i;
+    for (i = 0; i < s_nthread; ++i) {
+        if (s_threads[i].pid == pid)
+            return &s_threads[i];
+    }
+    return NULL;
+}
+
+static Session * findSession(int pid)
+{
+    int i;
+    for (i = 0; i < g_nsession; ++i) {
+        if (g_sessions[i].pid == pid && !g_sessions[i].gone)
+            return &g_sessions[i];
+    }
+    return NULL;
+}
+
+/*
+** The session of a thread stopped, the one of the stop when thread is NULL.
+*/
+static Session * stoppedSession(int pid, Thread ** pt)
+{
+    Session * ss = findSession(pid);
+    Thread * t = findThread(pid);
+
+    if (!ss || !t || !t->stopped || t->held)
+        return NULL;
+    *pt = t;
+    return ss;
+}
+
+static void freeFrames(Thread * t)
+{
+    free(t->frames);
+    t->frames = NULL;
+    t->nframe = 0;
+}
+
+static void clearRefs(void)
+{
+    int i;
+    for (i = 0; i < s_nref; ++i)
+        free(s_refs[i].vars);
+    s_nref = 0;
+}
+
+/*
+** Find the ref, or make one. Return its id, 0 when out of memory.
+*/
+static int getRef(RefKind kind, Thread * t, int level, int handle, int offset)
+{
+    Ref * r;
+    int i;
+
+    for (i = 0; i < s_nref; ++i) {
+        r = &s_refs[i];
+        if (r->kind == kind && r->pid == t->pid && r->stop == t->stop && r->level == level
+            && r->handle == handle && r->offset == offset)
+            return i + 1;
+    }
+
+    if (s_nref == s_capref) {
+        int cap = s_capref ? s_capref * 2 : 64;
+        Ref * refs = realloc(s_refs, cap * sizeof(Ref));
+        if (!refs)
+            return 0;
+        s_refs = refs;
+        s_capref = cap;
+    }
+    r = &s_refs[s_nref++];
+    r->kind = kind;
+    r->pid = t->pid;
+    r->stop = t->stop;
+    r->level = level;
+    r->handle = handle;
+    r->offset = offset;
+    r->vars = NULL;
+    return s_nref;
+}
+
+/*
+** The ref of id, NULL when it's unknown or stale.
+*/
+static Ref * findRef(int id, Thread ** pt, Session ** pss)
+{
+    Ref * r;
+
+    if (id < 1 || id > s_nref)
+        return NULL;
+    r = &s_refs[id - 1];
+    *pss = stoppedSession(r->pid, pt);
+    if (!*pss || (*pt)->stop != r->stop)
+        return NULL;
+    return r;
+}
+
+/*
+** Send commands separated by '\n' to ss in one frame, their replies come one
+** after another. Return -1 on socket error, ss is gone then.
+*/
+static int sendCmds(Session * ss, const char * cmds)
+{
+    if (SendFrame(ss->s, PROT_CMD, cmds, strlen(cmds)) < 0) {
+        ss->gone = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static int dropWord(void * arg, const char * word, int length)
+{
+    return 0;
+}
+
+/*
+** Read a reply of ss, parsed by parser(dropped when NULL). Return 1 for OK, 0
+** for an error with the message in err, or -1 on socket or protocol error, ss
+** is gone then.
+*/
+static int readReply(Session * ss, UserParser parser, void * arg, char * err, int size)
+{
+    int rc = waitForResponseFirstLine(&ss->sb);
+
+    if (rc == 0) {
+        int l;
+        if (SB_Read(&ss->sb, SB_R_LEFT) < 0 || !ss->sb.end) {
+            ss->gone = 1;
+            return -1;
+        }
+        l = strlen(ss->sb.lbuf);
+        if (l > size - 1)
+            l = size - 1;
+        memcpy(err, ss->sb.lbuf, l);
+        err[l] = 0;
+        while (l > 0 && (err[l - 1] == '\n' || err[l - 1] == '\r'))
+            err[--l] = 0;
+        return 0;
+    }
+    if (rc > 0 && SB_ReadAndParse(&ss->sb, "\n", parser ? parser : dropWord, arg) < 0)
+        rc = -1;
+    if (rc < 0)
+        ss->gone = 1;
+    return rc;
+}
+
+static int addText(Value * v, const char * s, int len)
+{
+    if (v->len + len + 1 > v->cap) {
+        int cap = v->cap ? v->cap : 64;
+        char * text;
+        while (cap < v->len + len + 1)
+            cap *= 2;
+        text = realloc(v->text, cap);
+        if (!text)
+            return -1;
+        v->text = text;
+        v->cap = cap;
+    }
+    memcpy(v->text + v->len, s, len);
+    v->len += len;
+    v->text[v->len] = 0;
+    return 0;
+}
+
+/*
+** Take a word of a value: its first one, or the raw bytes of a string.
+** Return the bytes still to come, or -3 when it's invalid.
+*/
+static int valueWord(Value * v, const char * word, int length)
+{
+    const char * end = word + length;
+    const char * p;
+
+    if (v->raw > 0) {
+        if (addText(v, word, length) < 0)
+            return -3;
+        v->raw -= length;
+        return 0;
+    }
+
+    v->type = word[0];
+    v->len = 0;
+    v->size = 0;
+    v->handle = 0;
+    if (addText(v, "", 0) < 0)
+        return -3;
+
+    switch (word[0]) {
+        case 's': {
+            //s<address>:<length>:<sent>:, the content follows raw
+            p = memchr(word, ':', length);
+            if (!p)
+                return -3;
+            v->size = atoi(p + 1);
+            p = memchr(p + 1, ':', end - p - 1);
+            if (!p)
+                return -3;
+            v->raw = atoi(p + 1);
+            if (v->raw < 0)
+                return -3;
+            return v->raw;
+        }
+        case 't':
+        case 'f':
+        case 'u':
+        case 'd': {
+            p = memchr(word, '#', length);
+            if (p)
+                v->handle = atoi(p + 1);
+            else
+                p = end;
+            return addText(v, word + 1, p - word - 1) < 0 ? -3 : 0;
+        }
+        case 'n':
+        case 'b':
+        case 'U':
+        case 'l':
+            return addText(v, word + 1, length - 1) < 0 ? -3 : 0;
+        default:
+            return -3;
+    }
+}
+
+static const char * typeName(char t)
+{
+    switch (t) {
+        case 's': return "string";
+        case 'n': return "number";
+        case 't': return "table";
+        case 'f': return "function";
+        case 'u': return "userdata";
+        case 'U': return "lightuserdata";
+        case 'b': return "boolean";
+        case 'd': return "thread";
+        default: return "nil";
+    }
+}
+
+/*
+** The text of v as a member key of jb, a string quoted unless asKey.
+*/
+static void writeValueText(JsonBuf * jb, const char * key, Value * v, int asKey)
+{
+    JB_Key(jb, key);
+    JB_Add(jb, "\"", 1);
+    switch (v->type) {
+        case 's':
+            if (!asKey)
+                JB_Add(jb, "\\\"", 2);
+            JB_Escape(jb, v->text, v->len);
+            if (!asKey)
+                JB_Add(jb, "\\\"", 2);
+            if (v->len < v->size)
+                JB_Add(jb, "...", 3);
+            break;
+        case 'n':
+            if (asKey)
+                JB_Add(jb, "[", 1);
+            JB_Escape(jb, v->text, v->len);
+            if (asKey)
+                JB_Add(jb, "]", 1);
+            break;
+        case 'l':
+            JB_Add(jb, "nil", 3);
+            break;
+        case 'b': {
+            //1 or 0
+            const char * b = v->len == 1 && v->text[0] == '0' ? "false" : "true";
+            if (asKey)
+                JB_Add(jb, "[", 1);
+            JB_Add(jb, b, strlen(b));
+            if (asKey)
+                JB_Add(jb, "]", 1);
+            break;
+        }
+        case 'U':
+            if (asKey)
+                JB_Add(jb, "[", 1);
+            JB_Escape(jb, v->text, v->len);
+            if (asKey)
+                JB_Add(jb, "]", 1);
+            break;
+        default:
+            if (asKey)
+                JB_Add(jb, "[", 1);
+            JB_Escape(jb, typeName(v->type), strlen(typeName(v->type)));
+            JB_Add(jb, ": ", 2);
+            JB_Escape(jb, v->text, v->len);
+            if (asKey)
+                JB_Add(jb, "]", 1);
+    }
+    JB_Add(jb, "\"", 1);
+}
+
+/*
+** A variable of name(a plain name when name is NULL) and value v to jb.
+*/
+static void writeVariable(JsonBuf * jb, Thread * t, const char * plain, Value * name, Value * v)
+{
+    JB_Open(jb, NULL, '{');
+    if (plain)
+        JB_Str(jb, "name", plain);
+    else
+        writeValueText(jb, "name", name, 1);
+    writeValueText(jb, "value", v, 0);
+    JB_Str(jb, "type", typeName(v->type));
+    JB_Int(jb, "variablesReference", v->type == 't' && v->handle > 0
+        ? getRef(REF_TABLE, t, 0, v->handle, 0) : 0);
+    JB_Close(jb, '}');
+}
+
+typedef struct
+{
+    JsonBuf * jb;
+    Thread * t;
+    int value;      //Reading a value, after its name
+    char name[256];
+    Value v;
+} Arg_vars;
+
+/*
+** Name and value pairs of ll, lu or lg.
+*/
+static int lvars(Arg_vars * args, const char * word, int length)
+{
+    int rc;
+
+    if (!args->value) {
+        int l = length < (int)sizeof(args->name) - 1 ? length : (int)sizeof(args->name) - 1;
+        memcpy(args->name, word, l);
+        args->name[l] = 0;
+        args->value = 1;
+        return 0;
+    }
+
+    rc = valueWord(&args->v, word, length);
+    if (rc != 0)
+        return rc;
+    if (args->v.raw == 0) {
+        writeVariable(args->jb, args->t, args->name, NULL, &args->v);
+        args->value = 0;
+    }
+    return 0;
+}
+
+typedef enum
+{
+    TW_VAR,
+    TW_META,
+    TW_ALEN,
+    TW_HCOUNT,
+    TW_KEY,
+    TW_VAL,
+    TW_OTHER,
+} State_tw;
+
+typedef struct
+{
+    JsonBuf * jb;           //Pairs of a table, NULL to take the value only
+    Thread * t;
+    State_tw st;
+    Value key;
+    Value v;
+    int next;               //Where the next page starts, -1 for none
+} Arg_tw;
+
+/*
+** Reply of w: the value, whether it has a metatable, and for a table its size
+** and the pairs of a page.
+*/
+static int tw(Arg_tw * args, const char * word, int length)
+{
+    int rc;
+
+    switch (args->st) {
+        case TW_VAR:
+            rc = valueWord(&args->v, word, length);
+            if (rc != 0)
+                return rc;
+            if (args->v.raw == 0)
+                args->st = TW_META;
+            break;
+        case TW_META:
+            args->st = args->v.type == 't' ? TW_ALEN : TW_OTHER;
+            break;
+        case TW_ALEN:
+            args->st = TW_HCOUNT;
+            break;
+        case TW_HCOUNT:
+            args->st = TW_KEY;
+            break;
+        case TW_KEY:
+            if (args->key.raw == 0 && word[0] == '+') {
+                args->next = atoi(word + 1);
+                args->st = TW_OTHER;
+                break;
+            }
+            rc = valueWord(&args->key, word, length);
+            if (rc != 0)
+                return rc;
+            if (args->key.raw == 0)
+                args->st = TW_VAL;
+            break;
+        case TW_VAL:
+            rc = valueWord(&args->v, word, length);
+            if (rc != 0)
+                return rc;
+            if (args->v.raw == 0) {
+                if (args->jb)
+                    writeVariable(args->jb, args->t, NULL, &args->key, &args->v);
+                args->st = TW_KEY;
+            }
+            break;
+        default:
+            break;
+    }
+    return 0;
+}
+
+static int ps(Thread * t, const char * word, int length)
+{
+    //Four words a frame
+    int i = t->nframe / 4;
+    int n = length;
+    Frame * f;
+
+    if (t->nframe % 4 == 0) {
+        Frame * frames = realloc(t->frames, (i + 1) * sizeof(Frame));
+        if (!frames)
+            return -3;
+        t->frames = frames;
+        memset(&frames[i], 0, sizeof(Frame));
+    }
+    f = &t->frames[i];
+
+    switch (t->nframe++ % 4) {
+        case 0:
+            if (n > (int)sizeof(f->file) - 1)
+                n = sizeof(f->file) - 1;
+            memcpy(f->file, word, n);
+            break;
+        case 1:
+            f->line = atoi(word);
+            break;
+        case 2:
+            if (n > (int)sizeof(f->name) - 1)
+                n = sizeof(f->name) - 1;
+            memcpy(f->name, word, n);
+            break;
+        case 3:
+            if (n > (int)sizeof(f->what) - 1)
+                n = sizeof(f->what) - 1;
+            memcpy(f->what, word, n);
+            break;
+    }
+    return 0;
+}
+
+/*
+** Fetch the variables of r, a JSON array. Return -1 when the session is gone.
+*/
+static int fetchVars(Session * ss, Thread * t, Ref * r, int id, char * err, int size)
+{
+    static const char * cmds[] = { NULL, NULL, "ll", "lu", "lg" };
+    char cmd[64];
+    JsonBuf jb;
+    int rc;
+
+    JB_Init(&jb);
+    JB_Open(&jb, NULL, '[');
+    if (r->kind == REF_TABLE) {
+        Arg_tw args;
+
+        memset(&args, 0, sizeof(args));
+        args.jb = &jb;
+        args.t = t;
+        args.next = -1;
+        snprintf(cmd, sizeof(cmd), "w #%d %d %d", r->handle, r->offset, DAP_PAGE);
+        rc = sendCmds(ss, cmd);
+        if (rc == 0)
+            rc = readReply(ss, (UserParser)tw, &args, err, size);
+        free(args.key.text);
+        free(args.v.text);
+        if (rc > 0 && args.next >= 0) {
+            JB_Open(&jb, NULL, '{');
+            JB_Str(&jb, "name", "...");
+            snprintf(cmd, sizeof(cmd), "more from %d", args.next);
+            JB_Str(&jb, "value", cmd);
+            JB_Int(&jb, "variablesReference", getRef(REF_TABLE, t, 0, r->handle, args.next));
+            JB_Close(&jb, '}');
+        }
+    }
+    else {
+        Arg_vars args;
+
+        memset(&args, 0, sizeof(args));
+        args.jb = &jb;
+        args.t = t;
+        snprintf(cmd, sizeof(cmd), "%s %d", cmds[r->kind], r->level);
+        rc = sendCmds(ss, cmd);
+        if (rc == 0)
+            rc = readReply(ss, (UserParser)lvars, &args, err, size);
+        free(args.v.text);
+    }
+    JB_Close(&jb, ']');
+
+    if (rc < 0 || jb.err) {
+        JB_Free(&jb);
+        return -1;
+    }
+    //getRef may have moved s_refs
+    s_refs[id - 1].vars = jb.buf;
+    return 0;
+}
+
+static void freeVars(VarList * vl)
+{
+    int i;
+    for (i = 0; i < vl->cap; ++i)
+        free(vl->vars[i].v.text);
+    free(vl->vars);
+    memset(vl, 0, sizeof(VarList));
+}
+
+typedef enum
+{
+    DL_INDEX,
+    DL_NAME,
+    DL_VALUE,
+} State_dl;
+
+typedef struct
+{
+    VarList * vl;
+    State_dl st;
+    Var * var;
+    int count;      //Sent last, -1 till then
+} Arg_dl;
+
+/*
+** Delta reply of ll or lu d/f: "index" and the variable changed, "index#handle"
+** for a table or such not changed, and "=count" at last.
+*/
+static int dl(Arg_dl * args, const char * word, int length)
+{
+    VarList * vl = args->vl;
+    const char * p;
+    int idx;
+    int rc;
+
+    switch (args->st) {
+        case DL_INDEX:
+            if (word[0] == '=') {
+                args->count = atoi(word + 1);
+                if (args->count < 0 || args->count > vl->n)
+                    return -3;
+                vl->n = args->count;
+                break;
+            }
+            idx = atoi(word) - 1;
+            if (idx < 0)
+                return -3;
+            p = memchr(word, '#', length);
+            if (p) {
+                if (idx >= vl->n)
+                    return -3;
+                vl->vars[idx].v.handle = atoi(p + 1);
+                break;
+            }
+
+            //Those after the last ones all come
+            if (idx > vl->n)
+                return -3;
+            if (idx == vl->cap) {
+                int cap = vl->cap ? vl->cap * 2 : 32;
+                Var * vars = realloc(vl->vars, cap * sizeof(Var));
+                if (!vars)
+                    return -3;
+                memset(vars + vl->cap, 0, (cap - vl->cap) * sizeof(Var));
+                vl->vars = vars;
+                vl->cap = cap;
+            }
+            if (idx == vl->n)
+                vl->n++;
+            args->var = &vl->vars[idx];
+            args->st = DL_NAME;
+            break;
+        case DL_NAME: {
+            int l = length < (int)sizeof(args->var->name) - 1 ? length : (int)sizeof(args->var->name) - 1;
+            memcpy(args->var->name, word, l);
+            args->var->name[l] = 0;
+            args->st = DL_VALUE;
+            break;
+        }
+        case DL_VALUE:
+            rc = valueWord(&args->var->v, word, length);
+            if (rc != 0)
+                return rc;
+            if (args->var->v.raw == 0)
+                args->st = DL_INDEX;
+            break;
+    }
+    return 0;
+}
+
+/*
+** Fetch the stack, and the locals and upvalues of the top frame, in one round
+** trip. The variables come as a delta of the last stop's when there's one.
+** Return -1 when the session is gone.
+*/
+static int prefetch(Session * ss, Thread * t)
+{
+    static const RefKind kinds[] = { REF_LOCALS, REF_UPVALUES };
+    char cmds[32];
+    char err[256];
+    int rc;
+    int i;
+
+    freeFrames(t);
+    sprintf(cmds, "ps\nll 1 %c\nlu 1 %c", t->top[0].valid ? 'd' : 'f', t->top[1].valid ? 'd' : 'f');
+    if (sendCmds(ss, cmds) < 0)
+        return -1;
+    if (readReply(ss, (UserParser)ps, t, err, sizeof(err)) < 0)
+        return -1;
+    t->nframe /= 4;
+
+    for (i = 0; i < 2; ++i) {
+        VarList * vl = &t->top[i];
+        Arg_dl args;
+        JsonBuf jb;
+        int id;
+        int j;
+
+        if (!vl->valid)
+            vl->n = 0;
+        vl->valid = 0;
+        memset(&args, 0, sizeof(args));
+        args.vl = vl;
+        args.count = -1;
+        rc = readReply(ss, (UserParser)dl, &args, err, sizeof(err));
+        if (rc < 0)
+            return -1;
+        if (rc == 0 || args.count < 0 || args.st != DL_INDEX)
+            continue;
+        vl->valid = 1;
+
+        JB_Init(&jb);
+        JB_Open(&jb, NULL, '[');
+        for (j = 0; j < vl->n; ++j)
+            writeVariable(&jb, t, vl->vars[j].name, NULL, &vl->vars[j].v);
+        JB_Close(&jb, ']');
+
+        id = getRef(kinds[i], t, 1, 0, 0);
+        if (id && !jb.err && !s_refs[id - 1].vars)
+            s_refs[id - 1].vars = jb.buf;
+        else
+            JB_Free(&jb);
+    }
+    return 0;
+}
+
+static Source * findSource_(const char * file)
+{
+    int i;
+    for (i = 0; i < s_nsource; ++i) {
+        if (!strcmp(s_sources[i].file, file))
+            return &s_sources[i];
+    }
+    return NULL;
+}
+
+typedef struct
+{
+    int n;          //Words so far
+    int idx;
+    char file[128];
+    int * dels;     //Indexes to delete
+    int ndel;
+} Arg_lb;
+
+/*
+** Take the breakpoints of lldb that the editor has deleted, nine words each.
+*/
+static int lb(Arg_lb * args, const char * word, int length)
+{
+    switch (args->n++ % 9) {
+        case 0:
+            args->idx = atoi(word);
+            break;
+        case 1: {
+            int l = length < (int)sizeof(args->file) - 1 ? length : (int)sizeof(args->file) - 1;
+            memcpy(args->file, word, l);
+            args->file[l] = 0;
+            break;
+        }
+        case 2: {
+            Source * src = findSource_(args->file);
+            int line = atoi(word);
+            int i;
+
+            if (!src)
+                break;
+            for (i = 0; i < src->nline; ++i) {
+                if (src->lines[i] == line)
+                    break;
+            }
+            if (i < src->nline)
+                break;
+
+            if (args->ndel % 16 == 0) {
+                int * dels = realloc(args->dels, (args->ndel + 16) * sizeof(int));
+                if (!dels)
+                    return -3;
+                args->dels = dels;
+            }
+            args->dels[args->ndel++] = args->idx;
+            break;
+        }
+    }
+    return 0;
+}
+
+typedef struct
+{
+    char ** errs;   //Results of the lines of src, NULL for OK
+    Source * src;
+    Source * cur;
+    int i;
+} Arg_bb;
+
+static int bb(Arg_bb * args, const char * word, int length)
+{
+    //Skip the sources emptied
+    while (args->cur < s_sources + s_nsource && args->i >= args->cur->nline) {
+        args->cur++;
+        args->i = 0;
+    }
+    if (args->cur >= s_sources + s_nsource)
+        return 0;
+
+    if (args->cur == args->src && args->errs && !(length == 2 && !strncmp(word, "OK", 2))) {
+        args->errs[args->i] = malloc(length + 1);
+        if (args->errs[args->i]) {
+            memcpy(args->errs[args->i], word, length);
+            args->errs[args->i][length] = 0;
+        }
+    }
+    args->i++;
+    return 0;
+}
+
+/*
+** Send the commands in cmds and read the replies: ndb ones of db, then one of
+** bb when bargs is set. cmds is emptied. Return -1 when ss is gone.
+*/
+static int flushCmds(Session * ss, JsonBuf * cmds, int ndb, Arg_bb * bargs)
+{
+    char err[256];
+    int rc = cmds->err ? -1 : sendCmds(ss, cmds->buf);
+    int i;
+
+    JB_Free(cmds);
+    if (rc < 0) {
+        ss->gone = 1;
+        return -1;
+    }
+
+    for (i = 0; i < ndb; ++i) {
+        if (readReply(ss, NULL, NULL, err, sizeof(err)) < 0)
+            return -1;
+    }
+    if (bargs && readReply(ss, (UserParser)bb, bargs, err, sizeof(err)) < 0)
+        return -1;
+    return 0;
+}
+
+/*
+** Make the breakpoints of ss the ones of the editor: delete the ones gone(by
+** lb first) and set all the others, in frames of up to DAP_BATCH bytes. errs
+** gets the results of the lines of src.
+** Return -1 when ss is gone.
+*/
+static int syncBreakpoints(Session * ss, Thread * t, Source * src, char ** errs)
+{
+    Arg_lb args;
+    Arg_bb bargs;
+    JsonBuf cmds;
+    char err[256];
+    int ndb = 0;
+    int rc = 0;
+    int i;
+
+    memset(&args, 0, sizeof(args));
+    if (sendCmds(ss, "lb") < 0 || readReply(ss, (UserParser)lb, &args, err, sizeof(err)) < 0) {
+        free(args.dels);
+        return -1;
+    }
+
+    //The last first, the indexes of those before stay
+    JB_Init(&cmds);
+    for (i = args.ndel - 1; i >= 0 && rc == 0; --i) {
+        char cmd[32];
+        if (cmds.len + (int)sizeof(cmd) > DAP_BATCH) {
+            rc = flushCmds(ss, &cmds, ndb, NULL);
+            ndb = 0;
+        }
+        JB_Add(&cmds, cmd, sprintf(cmd, "db %d\n", args.dels[i]));
+        ndb++;
+    }
+    free(args.dels);
+
+    //bb takes the rest of the frame, a new one goes on when it is full
+    bargs.errs = errs;
+    bargs.src = src;
+    bargs.cur = s_sources;
+    bargs.i = 0;
+    JB_Add(&cmds, "bb\n", 3);
+    for (i = 0; i < s_nsource && rc == 0; ++i) {
+        int l = strlen(s_sources[i].file);
+        int j;
+        for (j = 0; j < s_sources[i].nline && rc == 0; ++j) {
+            char line[32];
+            if (cmds.len + l + (int)sizeof(line) > DAP_BATCH) {
+                rc = flushCmds(ss, &cmds, ndb, &bargs);
+                ndb = 0;
+                JB_Add(&cmds, "bb\n", 3);
+            }
+            JB_Add(&cmds, s_sources[i].file, l);
+            JB_Add(&cmds, line, sprintf(line, " %d\n", s_sources[i].lines[j]));
+        }
+    }
+
+    if (rc == 0)
+        rc = flushCmds(ss, &cmds, ndb, &bargs);
+    JB_Free(&cmds);
+    if (rc < 0)
+        return -1;
+
+    t->bpgen = s_bpgen;
+    return 0;
+}
+
+static Thread * addThread(int pid)
+{
+    Thread * t = findThread(pid);
+    JsonBuf body;
+
+    if (t || s_nthread >= MAX_SESSION)
+        return t;
+    t = &s_threads[s_nthread++];
+    memset(t, 0, sizeof(Thread));
+    t->pid = pid;
+    t->reason = "breakpoint";
+
+    JB_Init(&body);
+    JB_Open(&body, NULL, '{');
+    JB_Str(&body, "reason", "started");
+    JB_Int(&body, "threadId", pid);
+    JB_Close(&body, '}');
+    sendEvent("thread", &body);
+    JB_Free(&body);
+    return t;
+}
+
+static void removeThread(int pid)
+{
+    Thread * t = findThread(pid);
+    JsonBuf body;
+
+    if (!t)
+        return;
+    freeFrames(t);
+    freeVars(&t->top[0]);
+    freeVars(&t->top[1]);
+    *t = s_threads[--s_nthread];
+
+    JB_Init(&body);
+    JB_Open(&body, NULL, '{');
+    JB_Str(&body, "reason", "exited");
+    JB_Int(&body, "threadId", pid);
+    JB_Close(&body, '}');
+    sendEvent("thread", &body);
+    JB_Free(&body);
+}
+
+/*
+** Run ss again by cmd(r, n, s or o).
+*/
+static int resume(Session * ss, Thread * t, const char * cmd)
+{
+    int i;
+
+    if (sendCmds(ss, cmd) < 0)
+        return -1;
+    ss->paused = 0;
+    t->stopped = 0;
+    t->held = 0;
+    t->reason = strcmp(cmd, "r") ? "step" : "breakpoint";
+    freeFrames(t);
+
+    //The refs are all stale when none stops
+    for (i = 0; i < s_nthread; ++i) {
+        if (s_threads[i].stopped)
+            return 0;
+    }
+    clearRefs();
+    return 0;
+}
+
+static void reportStop(Session * ss, Thread * t)
+{
+    JsonBuf body;
+
+    if (prefetch(ss, t) < 0)
+        return;
+
+    JB_Init(&body);
+    JB_Open(&body, NULL, '{');
+    JB_Str(&body, "reason", t->reason);
+    JB_Int(&body, "threadId", t->pid);
+    JB_Bool(&body, "allThreadsStopped", 0);
+    JB_Close(&body, '}');
+    sendEvent("stopped", &body);
+    JB_Free(&body);
+    t->reason = "breakpoint";
+}
+
+/*
+** A debuggee breaks.
+*/
+static void onBreak(Session * ss)
+{
+    Thread * t = addThread(ss->pid);
+
+    if (!t || prepareSession(ss) < 0) {
+        ss->gone = 1;
+        return;
+    }
+    if (t->bpgen != s_bpgen && syncBreakpoints(ss, t, NULL, NULL) < 0)
+        return;
+
+    t->stopped = 1;
+    t->stop++;
+
+    //The first break of a debuggee, as it starts
+    if (t->stop == 1) {
+        t->reason = "entry";
+        if (!s_configured) {
+            t->held = 1;
+            return;
+        }
+        if (!s_stop_on_entry) {
+            resume(ss, t, "r");
+            return;
+        }
+    }
+    reportStop(ss, t);
+}
+
+static void releaseHeld(void)
+{
+    int i;
+    for (i = 0; i < s_nthread; ++i) {
+        Thread * t = &s_threads[i];
+        Session * ss = findSession(t->pid);
+
+        if (!t->held || !ss)
+            continue;
+        t->held = 0;
+        if (s_stop_on_entry)
+            reportStop(ss, t);
+        else
+            resume(ss, t, "r");
+    }
+}
+
+static void sendInitialized(void)
+{
+    sendEvent("initialized", NULL);
+}
+
+static const char * onInitialize(Json * args, JsonBuf * body)
+{
+    JB_Open(body, NULL, '{');
+    JB_Bool(body, "supportsConfigurationDoneRequest", 1);
+    JB_Bool(body, "supportsEvaluateForHovers", 1);
+    JB_Bool(body, "supportsTerminateRequest", 1);
+    JB_Close(body, '}');
+    s_after = sendInitialized;
+    return NULL;
+}
+
+static const char * onLaunch(Json * args, JsonBuf * body)
+{
+    //The program is the one given to lldbg
+    s_stop_on_entry = Json_GetBool(args, "stopOnEntry", 0);
+    return NULL;
+}
+
+static const char * onConfigurationDone(Json * args, JsonBuf * body)
+{
+    s_configured = 1;
+    s_after = releaseHeld;
+    return NULL;
+}
+
+static const char * onSetBreakpoints(Json * args, JsonBuf * body)
+{
+    Json * bps = Json_Get(args, "breakpoints");
+    const char * path = Json_GetStr(Json_Get(args, "source"), "path", NULL);
+    const char * file;
+    Source * src;
+    char ** errs;
+    int synced = 0;
+    int n = 0;
+    int i;
+    Json * j;
+
+    if (!path)
+        return "No source path!";
+    file = strrchr(path, '/');
+    if (!file)
+        file = strrchr(path, '\\');
+    file = file ? file + 1 : path;
+
+    src = findSource_(file);
+    if (!src) {
+        Source * sources = realloc(s_sources, (s_nsource + 1) * sizeof(Source));
+        if (!sources)
+            return "Out of memory!";
+        s_sources = sources;
+        src = &s_sources[s_nsource++];
+        memset(src, 0, sizeof(Source));
+        snprintf(src->file, sizeof(src->file), "%s", file);
+    }
+
+    for (j = bps && bps->type == JSON_ARRAY ? bps->child : NULL; j; j = j->next)
+        n++;
+    free(src->lines);
+    src->lines = n ? malloc(n * sizeof(int)) : NULL;
+    src->nline = 0;
+    for (j = bps && bps->type == JSON_ARRAY ? bps->child : NULL; j && src->lines; j = j->next)
+        src->lines[src->nline++] = (int)Json_GetNum(j, "line", 0);
+    s_bpgen++;
+
+    //The stopped ones at once, the others at their next break
+    errs = calloc(src->nline + 1, sizeof(char *));
+    for (i = 0; i < s_nthread; ++i) {
+        Thread * t = &s_threads[i];
+        Session * ss = findSession(t->pid);
+        if (!ss || !t->stopped)
+            continue;
+        if (syncBreakpoints(ss, t, src, synced || !errs ? NULL : errs) == 0)
+            synced = 1;
+    }
+
+    JB_Open(body, NULL, '{');
+    JB_Open(body, "breakpoints", '[');
+    for (i = 0; i < src->nline; ++i) {
+        JB_Open(body, NULL, '{');
+        JB_Bool(body, "verified", !errs || !errs[i]);
+        JB_Int(body, "line", src->lines[i]);
+        if (errs && errs[i]) {
+            JB_Str(body, "message", errs[i]);
+            free(errs[i]);
+        }
+        JB_Close(body, '}');
+    }
+    JB_Close(body, ']');
+    JB_Close(body, '}');
+    free(errs);
+    return NULL;
+}
+
+static const char * onThreads(Json * args, JsonBuf * body)
+{
+    int i;
+
+    JB_Open(body, NULL, '{');
+    JB_Open(body, "threads", '[');
+    for (i = 0; i < s_nthread; ++i) {
+        Session * ss = findSession(s_threads[i].pid);
+        char name[96];
+
+        if (!ss)
+            continue;
+        snprintf(name, sizeof(name), "pid %d(%s)", ss->pid, ss->host);
+        JB_Open(body, NULL, '{');
+        JB_Int(body, "id", ss->pid);
+        JB_Str(body, "name", name);
+        JB_Close(body, '}');
+    }
+    JB_Close(body, ']');
+    JB_Close(body, '}');
+    return NULL;
+}
+
+/*
+** Where the source of frame at level is: the full path of the break for the
+** top one, or the file found in the source dirs or the working dir.
+*/
+static void sourcePath(Session * ss, Frame * f, int level, char * path)
+{
+    char found[PATH_MAX];
+
+    if (level == 1 && ss->fullpath[0] == '/')
+        snprintf(found, sizeof(found), "%s", ss->fullpath);
+    else if (f->file[0] == '/' || !findSource(f->file, found, sizeof(found)))
+        snprintf(found, sizeof(found), "%s", f->file);
+    if (!realpath(found, path))
+        snprintf(path, PATH_MAX, "%s", found);
+}
+
+static const char * onStackTrace(Json * args, JsonBuf * body)
+{
+    Thread * t;
+    Session * ss = stoppedSession((int)Json_GetNum(args, "threadId", 0), &t);
+    int start = (int)Json_GetNum(args, "startFrame", 0);
+    int levels = (int)Json_GetNum(args, "levels", 0);
+    int i;
+
+    if (!ss)
+        return "The process is not stopped!";
+    if (!t->frames && prefetch(ss, t) < 0)
+        return "Socket or protocol error!";
+    if (start < 0)
+        start = 0;
+    if (levels <= 0 || levels > t->nframe - start)
+        levels = t->nframe - start;
+
+    JB_Open(body, NULL, '{');
+    JB_Open(body, "stackFrames", '[');
+    for (i = start; i < start + levels; ++i) {
+        Frame * f = &t->frames[i];
+
+        JB_Open(body, NULL, '{');
+        JB_Int(body, "id", getRef(REF_FRAME, t, i + 1, 0, 0));
+        JB_Str(body, "name", strcmp(f->name, "[N/A]") ? f->name : f->what);
+        if (strcmp(f->what, "C")) {
+            char path[PATH_MAX];
+            sourcePath(ss, f, i + 1, path);
+            JB_Open(body, "source", '{');
+            JB_Str(body, "name", f->file);
+            JB_Str(body, "path", path);
+            JB_Close(body, '}');
+        }
+        JB_Int(body, "line", f->line > 0 ? f->line : 0);
+        JB_Int(body, "column", 1);
+        JB_Close(body, '}');
+    }
+    JB_Close(body, ']');
+    JB_Int(body, "totalFrames", t->nframe);
+    JB_Close(body, '}');
+    return NULL;
+}
+
+static const char * onScopes(Json * args, JsonBuf * body)
+{
+    static const char * names[] = { "Locals", "Upvalues", "Globals" };
+    Thread * t;
+    Session * ss;
+    Ref * r = findRef((int)Json_GetNum(args, "frameId", 0), &t, &ss);
+    int level;
+    int i;
+
+    if (!r || r->kind != REF_FRAME)
+        return "Invalid frame!";
+    level = r->level;
+
+    JB_Open(body, NULL, '{');
+    JB_Open(body, "scopes", '[');
+    for (i = 0; i < 3; ++i) {
+        JB_Open(body, NULL, '{');
+        JB_Str(body, "name", names[i]);
+        JB_Int(body, "variablesReference", getRef(REF_LOCALS + i, t, level, 0, 0));
+        JB_Bool(body, "expensive", i == 2);
+        JB_Close(body, '}');
+    }
+    JB_Close(body, ']');
+    JB_Close(body, '}');
+    return NULL;
+}
+
+static const char * onVariables(Json * args, JsonBuf * body)
+{
+    static char err[256];
+    int id = (int)Json_GetNum(args, "variablesReference", 0);
+    Thread * t;
+    Session * ss;
+    Ref * r = findRef(id, &t, &ss);
+
+    if (!r || r->kind == REF_FRAME)
+        return "Invalid variables reference!";
+    if (!r->vars) {
+        err[0] = 0;
+        if (fetchVars(ss, t, r, id, err, sizeof(err)) < 0)
+            return err[0] ? err : "Socket or protocol error!";
+        r = &s_refs[id - 1];
+    }
+
+    JB_Open(body, NULL, '{');
+    JB_Raw(body, "variables", r->vars, strlen(r->vars));
+    JB_Close(body, '}');
+    return NULL;
+}
+
+static int isName(const char * s)
+{
+    if (!*s || (*s >= '0' && *s <= '9'))
+        return 0;
+    for (; *s; ++s) {
+        if (!((*s >= 'a' && *s <= 'z') || (*s >= 'A' && *s <= 'Z') || (*s >= '0' && *s <= '9') || *s == '_'))
+            return 0;
+    }
+    return 1;
+}
+
+/*
+** A variable in scope of the frame, local, upvalue or global as lua finds it.
+*/
+static const char * onEvaluate(Json * args, JsonBuf * body)
+{
+    static char err[256];
+    static const char scopes[] = "lug";
+    const char * expr = Json_GetStr(args, "expression", "");
+    Thread * t;
+    Session * ss;
+    Ref * r = findRef((int)Json_GetNum(args, "frameId", 0), &t, &ss);
+    char cmds[3 * 160];
+    int len = 0;
+    int found = 0;
+    int i;
+
+    if (!r || r->kind != REF_FRAME)
+        return "Invalid frame!";
+    if (!isName(expr) || strlen(expr) > 128)
+        return "Only variable names can be evaluated!";
+
+    //All three in one round trip, the first found wins
+    for (i = 0; i < 3; ++i)
+        len += sprintf(cmds + len, "%sw %d %c %s 0 0", i ? "\n" : "", r->level, scopes[i], expr);
+    if (sendCmds(ss, cmds) < 0)
+        return "Socket or protocol error!";
+
+    for (i = 0; i < 3; ++i) {
+        Arg_tw args;
+        int rc;
+
+        memset(&args, 0, sizeof(args));
+        args.next = -1;
+        rc = readReply(ss, (UserParser)tw, &args, err, sizeof(err));
+        if (rc > 0 && !found) {
+            found = 1;
+            JB_Open(body, NULL, '{');
+            writeValueText(body, "result", &args.v, 0);
+            JB_Str(body, "type", typeName(args.v.type));
+            JB_Int(body, "variablesReference", args.v.type == 't' && args.v.handle > 0
+                ? getRef(REF_TABLE, t, 0, args.v.handle, 0) : 0);
+            JB_Close(body, '}');
+        }
+        free(args.key.text);
+        free(args.v.text);
+        if (rc < 0)
+            return "Socket or protocol error!";
+    }
+    return found ? NULL : err;
+}
+
+static const char * onResume(Json * args, const char * cmd)
+{
+    Thread * t;
+    Session * ss = stoppedSession((int)Json_GetNum(args, "threadId", 0), &t);
+
+    if (!ss)
+        return "The process is not stopped!";
+    if (resume(ss, t, cmd) < 0)
+        return "Socket error!";
+    return NULL;
+}
+
+static const char * onContinue(Json * args, JsonBuf * body)
+{
+    const char * err = onResume(args, "r");
+    if (!err) {
+        JB_Open(body, NULL, '{');
+        JB_Bool(body, "allThreadsContinued", 0);
+        JB_Close(body, '}');
+    }
+    return err;
+}
+
+static const char * onNext(Json * args, JsonBuf * body)
+{
+    return onResume(args, "n");
+}
+
+static const char * onStepIn(Json * args, JsonBuf * body)
+{
+    return onResume(args, "s");
+}
+
+static const char * onStepOut(Json * args, JsonBuf * body)
+{
+    return onResume(args, "o");
+}
+
+static const char * onPause(Json * args, JsonBuf * body)
+{
+    int pid = (int)Json_GetNum(args, "threadId", 0);
+    Session * ss = findSession(pid);
+    Thread * t = findThread(pid);
+
+    if (!ss || !t)
+        return "No such process!";
+    if (t->stopped)
+        return NULL;
+    if (!ss->local || notifyRemote(pid, 0))
+        return "Failed to interrupt the process!";
+    t->reason = "pause";
+    return NULL;
+}
+
+static const char * onDisconnect(Json * args, JsonBuf * body)
+{
+    s_quit = 1;
+    return NULL;
+}
+
+static const char * onNothing(Json * args, JsonBuf * body)
+{
+    return NULL;
+}
+
+typedef struct
+{
+    const char * command;
+    const char * (* handler)(Json * args, JsonBuf * body);
+} Handler;
+
+static const Handler s_handlers[] =
+{
+    { "initialize", onInitialize },
+    { "launch", onLaunch },
+    { "attach", onLaunch },
+    { "configurationDone", onConfigurationDone },
+    { "setBreakpoints", onSetBreakpoints },
+    { "setExceptionBreakpoints", onNothing },
+    { "threads", onThreads },
+    { "stackTrace", onStackTrace },
+    { "scopes", onScopes },
+    { "variables", onVariables },
+    { "evaluate", onEvaluate },
+    { "continue", onContinue },
+    { "next", onNext },
+    { "stepIn", onStepIn },
+    { "stepOut", onStepOut },
+    { "pause", onPause },
+    { "disconnect", onDisconnect },
+    { "terminate", onDisconnect },
+    { NULL, NULL },
+};
+
+static void handleMessage(const char * text, int len)
+{
+    Json * req = Json_Parse(text, len);
+    const char * command = Json_GetStr(req, "command", NULL);
+    const char * err = "Unsupported request!";
+    const Handler * h;
+    JsonBuf body;
+
+    if (!command || strcmp(Json_GetStr(req, "type", ""), "request")) {
+        Json_Free(req);
+        return;
+    }
+
+    JB_Init(&body);
+    s_after = NULL;
+    for (h = s_handlers; h->command; ++h) {
+        if (!strcmp(h->command, command)) {
+            err = h->handler(Json_Get(req, "arguments"), &body);
+            break;
+        }
+    }
+    sendResponse(req, err, &body);
+    JB_Free(&body);
+    Json_Free(req);
+
+    if (s_after)
+        s_after();
+}
+
+/*
+** Serve the messages read, "Content-Length: <n>" headers and n bytes of JSON.
+** Return -1 when one is invalid.
+*/
+static int handleInput(void)
+{
+    while (1) {
+        char * end = NULL;
+        char * p;
+        int len = -1;
+        int i;
+
+        for (i = 0; i + 3 < s_nin; ++i) {
+            if (!memcmp(s_in + i, "\r\n\r\n", 4)) {
+                end = s_in + i + 4;
+                break;
+            }
+        }
+        if (!end)
+            return s_nin > 4096 ? -1 : 0;
+
+        for (p = s_in; p < end; ) {
+            if (!strncasecmp(p, "Content-Length:", 15))
+                len = atoi(p + 15);
+            p = memchr(p, '\n', end - p);
+            if (!p)
+                break;
+            ++p;
+        }
+        if (len < 0)
+            return -1;
+        if (s_in + s_nin - end < len)
+            return 0;
+
+        handleMessage(end, len);
+        s_nin -= end + len - s_in;
+        memmove(s_in, end + len, s_nin);
+    }
+}
+
+static int readInput(void)
+{
+    int n;
+
+    if (s_capin - s_nin < 4096) {
+        int cap = s_capin ? s_capin * 2 : 65536;
+        char * in = realloc(s_in, cap);
+        if (!in)
+            return -1;
+        s_in = in;
+        s_capin = cap;
+    }
+    n = read(0, s_in + s_nin, s_capin - s_nin);
+    if (n < 0 && errno == EINTR)
+        return 0;
+    if (n <= 0)
+        return -1;
+    s_nin += n;
+    return handleInput();
+}
+
+void DapLoop(SOCKET l, FILE * out)
+{
+    s_out = out;
+
+    while (!s_quit) {
+        fd_set rfds;
+        SOCKET maxfd = l;
+        struct timeval tv = { 0, 0 };
+        int pending = 0;
+        int i;
+
+        for (i = g_nsession - 1; i >= 0; --i) {
+            Session * ss = &g_sessions[i];
+            if (!ss->gone)
+                continue;
+            removeThread(ss->pid);
+            dropSession(ss);
+        }
+        //Then wait for disconnect
+        if (s_accepted && g_nsession == 0 && !s_terminated) {
+            sendEvent("terminated", NULL);
+            s_terminated = 1;
+        }
+
+        FD_ZERO(&rfds);
+        FD_SET(0, &rfds);
+        FD_SET(l, &rfds);
+        maxfd = watchSessions(&rfds, maxfd, NULL, &pending);
+
+        //Don't block when a message is received already
+        if (select((int)maxfd + 1, &rfds, NULL, NULL, pending ? &tv : NULL) == SOCKET_ERROR) {
+            if (errno == EINTR)
+                continue;
+            break;
+        }
+
+        if (FD_ISSET(0, &rfds) && readInput() < 0)
+            break;
+        if (FD_ISSET(l, &rfds)) {
+            acceptSession(l);
+            s_accepted++;
+        }
+
+        serveSessions(&rfds, NULL, 0);
+        for (i = 0; i < g_nsession; ++i) {
+            Session * ss = &g_sessions[i];
+            Thread * t = findThread(ss->pid);
+            if (ss->paused && !ss->gone && (!t || !t->stopped))
+                onBreak(ss);
+        }
+    }
+}
@@ -0,0 +1,514 @@
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include "Json.h"
+
+//Nesting deeper than this is refused by the reader
+#define MAX_NESTING 64
+
+typedef struct
+{
+    const char * p;
+    const char * end;
+} Reader;
+
+static Json * parseValue(Reader * r, int depth);
+
+static void skipSpace(Reader * r)
+{
+    while (r->p < r->end && (*r->p == ' ' || *r->p == '\t' || *r->p == '\n' || *r->p == '\r'))
+        ++r->p;
+}
+
+static int hex4(const char * p)
+{
+    int n = 0;
+    int i;
+    for (i = 0; i < 4; ++i) {
+        char c = p[i];
+        n <<= 4;
+        if (c >= '0' && c <= '9')
+            n |= c - '0';
+        else if (c >= 'a' && c <= 'f')
+            n |= c - 'a' + 10;
+        else if (c >= 'A' && c <= 'F')
+            n |= c - 'A' + 10;
+        else
+            return -1;
+    }
+    return n;
+}
+
+static char * putUtf8(char * out, unsigned int c)
+{
+    if (c < 0x80) {
+        *out++ = (char)c;
+    }
+    else if (c < 0x800) {
+        *out++ = (char)(0xc0 | (c >> 6));
+        *out++ = (char)(0x80 | (c & 0x3f));
+    }
+    else if (c < 0x10000) {
+        *out++ = (char)(0xe0 | (c >> 12));
+        *out++ = (char)(0x80 | ((c >> 6) & 0x3f));
+        *out++ = (char)(0x80 | (c & 0x3f));
+    }
+    else {
+        *out++ = (char)(0xf0 | (c >> 18));
+        *out++ = (char)(0x80 | ((c >> 12) & 0x3f));
+        *out++ = (char)(0x80 | ((c >> 6) & 0x3f));
+        *out++ = (char)(0x80 | (c & 0x3f));
+    }
+    return out;
+}
+
+/*
+** Read a string at the quote, return it unescaped(malloced), and its length in
+** *len. Return NULL when it's invalid.
+*/
+static char * parseString(Reader * r, int * len)
+{
+    const char * p = r->p + 1;
+    char * str;
+    char * out;
+
+    //The escaped text is never shorter
+    while (p < r->end && *p != '"') {
+        if (*p == '\\')
+            ++p;
+        ++p;
+    }
+    if (p >= r->end)
+        return NULL;
+
+    str = malloc(p - r->p);
+    if (!str)
+        return NULL;
+    out = str;
+    p = r->p + 1;
+    while (*p != '"') {
+        if (*p != '\\') {
+            *out++ = *p++;
+            continue;
+        }
+
+        ++p;
+        switch (*p++) {
+            case '"': *out++ = '"'; break;
+            case '\\': *out++ = '\\'; break;
+            case '/': *out++ = '/'; break;
+            case 'b': *out++ = '\b'; break;
+            case 'f': *out++ = '\f'; break;
+            case 'n': *out++ = '\n'; break;
+            case 'r': *out++ = '\r'; break;
+            case 't': *out++ = '\t'; break;
+            case 'u': {
+                int c = r->end - p >= 4 ? hex4(p) : -1;
+                if (c < 0)
+                    goto fail;
+                p += 4;
+                //A surrogate pair
+                if (c >= 0xd800 && c < 0xdc00 && r->end - p >= 6 && p[0] == '\\' && p[1] == 'u') {
+                    int lo = hex4(p + 2);
+                    if (lo >= 0xdc00 && lo < 0xe000) {
+                        c = 0x10000 + ((c - 0xd800) << 10) + (lo - 0xdc00);
+                        p += 6;
+                    }
+                }
+                out = putUtf8(out, c);
+                break;
+            }
+            default:
+                goto fail;
+        }
+    }
+
+    r->p = p + 1;
+    *out = 0;
+    *len = out - str;
+    return str;
+
+fail:
+    free(str);
+    return NULL;
+}
+
+static Json * newJson(JsonType type)
+{
+    Json * j = calloc(1, sizeof(Json));
+    if (j)
+        j->type = type;
+    return j;
+}
+
+static int literal(Reader * r, const char * word)
+{
+    int l = strlen(word);
+    if (r->end - r->p < l || memcmp(r->p, word, l))
+        return 0;
+    r->p += l;
+    return 1;
+}
+
+/*
+** Read the elements of an array, or the members of an object, into j.
+*/
+static int parseChildren(Reader * r, Json * j, char close, int depth)
+{
+    Json ** tail = &j->child;
+
+    ++r->p;
+    skipSpace(r);
+    if (r->p < r->end && *r->p == close) {
+        ++r->p;
+        return 0;
+    }
+
+    while (1) {
+        char * key = NULL;
+        Json * child;
+        int len;
+
+        if (j->type == JSON_OBJECT) {
+            if (r->p >= r->end || *r->p != '"')
+                return -1;
+            key = parseString(r, &len);
+            if (!key)
+                return -1;
+            skipSpace(r);
+            if (r->p >= r->end || *r->p != ':') {
+                free(key);
+                return -1;
+            }
+            ++r->p;
+        }
+
+        child = parseValue(r, depth + 1);
+        if (!child) {
+            free(key);
+            return -1;
+        }
+        child->key = key;
+        *tail = child;
+        tail = &child->next;
+
+        skipSpace(r);
+        if (r->p >= r->end)
+            return -1;
+        if (*r->p == close) {
+            ++r->p;
+            return 0;
+        }
+        if (*r->p != ',')
+            return -1;
+        ++r->p;
+        skipSpace(r);
+    }
+}
+
+static Json * parseValue(Reader * r, int depth)
+{
+    Json * j = NULL;
+
+    skipSpace(r);
+    if (r->p >= r->end || depth > MAX_NESTING)
+        return NULL;
+
+    switch (*r->p) {
+        case '{':
+        case '[': {
+            j = newJson(*r->p == '{' ? JSON_OBJECT : JSON_ARRAY);
+            if (j && parseChildren(r, j, *r->p == '{' ? '}' : ']', depth) < 0) {
+                Json_Free(j);
+                return NULL;
+            }
+            break;
+        }
+        case '"': {
+            j = newJson(JSON_STRING);
+            if (j && !(j->str = parseString(r, &j->len))) {
+                Json_Free(j);
+                return NULL;
+            }
+            break;
+        }
+        case 't':
+            if (literal(r, "true"))
+                j = newJson(JSON_TRUE);
+            break;
+        case 'f':
+            if (literal(r, "false"))
+                j = newJson(JSON_FALSE);
+            break;
+        case 'n':
+            if (literal(r, "null"))
+                j = newJson(JSON_NULL);
+            break;
+        default: {
+            char buf[64];
+            char * end;
+            int l = r->end - r->p < (int)sizeof(buf) - 1 ? (int)(r->end - r->p) : (int)sizeof(buf) - 1;
+            double d;
+
+            //strtod needs a terminating zero
+            memcpy(buf, r->p, l);
+            buf[l] = 0;
+            d = strtod(buf, &end);
+            if (end == buf)
+                return NULL;
+            r->p += end - buf;
+            j = newJson(JSON_NUMBER);
+            if (j)
+                j->num = d;
+        }
+    }
+    return j;
+}
+
+Json * Json_Parse(const char * text, int len)
+{
+    Reader r;
+    Json * j;
+
+    r.p = text;
+    r.end = text + len;
+    j = parseValue(&r, 0);
+    if (!j)
+        return NULL;
+    skipSpace(&r);
+    if (r.p != r.end) {
+        Json_Free(j);
+        return NULL;
+    }
+    return j;
+}
+
+void Json_Free(Json * j)
+{
+    while (j) {
+        Json * next = j->next;
+        Json_Free(j->child);
+        free(j->key);
+        free(j->str);
+        free(j);
+        j = next;
+    }
+}
+
+Json * Json_Get(Json * j, const char * key)
+{
+    if (!j || j->type != JSON_OBJECT)
+        return NULL;
+    for (j = j->child; j; j = j->next) {
+        if (!strcmp(j->key, key))
+            return j;
+    }
+    return NULL;
+}
+
+const char * Json_GetStr(Json * j, const char * key, const char * def)
+{
+    j = Json_Get(j, key);
+    return j && j->type == JSON_STRING ? j->str : def;
+}
+
+double Json_GetNum(Json * j, const char * key, double def)
+{
+    j = Json_Get(j, key);
+    return j && j->type == JSON_NUMBER ? j->num : def;
+}
+
+int Json_GetBool(Json * j, const char * key, int def)
+{
+    j = Json_Get(j, key);
+    if (j && j->type == JSON_TRUE)
+        return 1;
+    if (j && j->type == JSON_FALSE)
+        return 0;
+    return def;
+}
+
+void JB_Init(JsonBuf * jb)
+{
+    memset(jb, 0, sizeof(JsonBuf));
+}
+
+void JB_Free(JsonBuf * jb)
+{
+    free(jb->buf);
+    JB_Init(jb);
+}
+
+void JB_Add(JsonBuf * jb, const char * s, int len)
+{
+    if (jb->err)
+        return;
+    if (jb->len + len + 1 > jb->cap) {
+        int cap = jb->cap ? jb->cap : 256;
+        char * buf;
+        while (cap < jb->len + len + 1)
+            cap *= 2;
+        buf = realloc(jb->buf, cap);
+        if (!buf) {
+            jb->err = 1;
+            return;
+        }
+        jb->buf = buf;
+        jb->cap = cap;
+    }
+    memcpy(jb->buf + jb->len, s, len);
+    jb->len += len;
+    jb->buf[jb->len] = 0;
+}
+
+/*
+** Length of the UTF-8 sequence at s(len bytes left), 0 when it's not one.
+*/
+static int utf8Len(const unsigned char * s, int len)
+{
+    int n;
+    int i;
+
+    if (s[0] < 0xc2 || s[0] > 0xf4)
+        return 0;
+    n = s[0] < 0xe0 ? 2 : s[0] < 0xf0 ? 3 : 4;
+    if (n > len)
+        return 0;
+    for (i = 1; i < n; ++i) {
+        if ((s[i] & 0xc0) != 0x80)
+            return 0;
+    }
+    //Overlong forms and surrogates
+    if ((s[0] == 0xe0 && s[1] < 0xa0) || (s[0] == 0xed && s[1] >= 0xa0)
+        || (s[0] == 0xf0 && s[1] < 0x90) || (s[0] == 0xf4 && s[1] >= 0x90))
+        return 0;
+    return n;
+}
+
+void JB_Escape(JsonBuf * jb, const char * s, int len)
+{
+    const unsigned char * p = (const unsigned char *)s;
+    const unsigned char * end = p + len;
+
+    while (p < end) {
+        const unsigned char * start = p;
+        char esc[8];
+
+        //Runs of plain ASCII go in one copy
+        while (p < end && *p >= 0x20 && *p < 0x80 && *p != '"' && *p != '\\')
+            ++p;
+        if (p > start)
+            JB_Add(jb, (const char *)start, p - start);
+        if (p == end)
+            break;
+
+        if (*p >= 0x80) {
+            int n = utf8Len(p, end - p);
+            if (n) {
+                JB_Add(jb, (const char *)p, n);
+                p += n;
+                continue;
+            }
+        }
+
+        switch (*p) {
+            case '"': JB_Add(jb, "\\\"", 2); break;
+            case '\\': JB_Add(jb, "\\\\", 2); break;
+            case '\n': JB_Add(jb, "\\n", 2); break;
+            case '\r': JB_Add(jb, "\\r", 2); break;
+            case '\t': JB_Add(jb, "\\t", 2); break;
+            default:
+                sprintf(esc, "\\u%04x", *p);
+                JB_Add(jb, esc, 6);
+        }
+        ++p;
+    }
+}
+
+void JB_Key(JsonBuf * jb, const char * key)
+{
+    if (jb->more[jb->depth])
+        JB_Add(jb, ",", 1);
+    jb->more[jb->depth] = 1;
+    if (key) {
+        JB_Add(jb, "\"", 1);
+        JB_Escape(jb, key, strlen(key));
+        JB_Add(jb, "\":", 2);
+    }
+}
+
+void JB_Open(JsonBuf * jb, const char * key, char c)
+{
+    JB_Key(jb, key);
+    JB_Add(jb, &c, 1);
+    if (jb->depth + 1 >= JB_MAX_DEPTH) {
+        jb->err = 1;
+        return;
+    }
+    jb->more[++jb->depth] = 0;
+}
+
+void JB_Close(JsonBuf * jb, char c)
+{
+    if (jb->depth > 0)
+        jb->depth--;
+    JB_Add(jb, &c, 1);
+}
+
+void JB_Str(JsonBuf * jb, const char * key, const char * s)
+{
+    JB_StrN(jb, key, s, strlen(s));
+}
+
+void JB_StrN(JsonBuf * jb, const char * key, const char * s, int len)
+{
+    JB_Key(jb, key);
+    JB_Add(jb, "\"", 1);
+    JB_Escape(jb, s, len);
+    JB_Add(jb, "\"", 1);
+}
+
+void JB_Int(JsonBuf * jb, const char * key, long long n)
+{
+    char buf[32];
+    JB_Key(jb, key);
+    JB_Add(jb, buf, sprintf(buf, "%lld", n));
+}
+
+void JB_Bool(JsonBuf * jb, const char * key, int b)
+{
+    JB_Key(jb, key);
+    if (b)
+        JB_Add(jb, "true", 4);
+    else
+        JB_Add(jb, "false", 5);
+}
+
+void JB_Raw(JsonBuf * jb, const char * key, const char * json, int len)
+{
+    JB_Key(jb, key);
+    JB_Add(jb, json, len);
+}
@@ -0,0 +1,124 @@
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#ifndef __JSON_H__
+#define __JSON_H__
+
+/*
+** A small JSON reader and writer, for the debug adapter protocol(lldbg --dap).
+*/
+
+typedef enum
+{
+    JSON_NULL,
+    JSON_FALSE,
+    JSON_TRUE,
+    JSON_NUMBER,
+    JSON_STRING,
+    JSON_ARRAY,
+    JSON_OBJECT
+} JsonType;
+
+typedef struct Json
+{
+    JsonType type;
+    char * key;             //Name of a member of an object, NULL otherwise
+    char * str;             //String, unescaped and zero terminated
+    int len;
+    double num;
+    struct Json * child;    //First element or member
+    struct Json * next;
+} Json;
+
+/*
+** Parse text of len bytes. Return NULL when it's invalid or out of memory.
+*/
+Json * Json_Parse(const char * text, int len);
+
+void Json_Free(Json * j);
+
+/*
+** The member key of object j, NULL when there's none or j is not an object.
+*/
+Json * Json_Get(Json * j, const char * key);
+
+/*
+** Values of member key of object j, def when it's missing or of another type.
+*/
+const char * Json_GetStr(Json * j, const char * key, const char * def);
+double Json_GetNum(Json * j, const char * key, double def);
+int Json_GetBool(Json * j, const char * key, int def);
+
+#define JB_MAX_DEPTH 32
+
+/*
+** Text written to a growing buffer, commas between values are added. Out of
+** memory sets err and drops what comes after.
+*/
+typedef struct
+{
+    char * buf;
+    int len;
+    int cap;
+    int err;
+    int depth;
+    char more[JB_MAX_DEPTH];    //A value is written at the depth already
+} JsonBuf;
+
+void JB_Init(JsonBuf * jb);
+void JB_Free(JsonBuf * jb);
+
+/*
+** Add bytes as they are.
+*/
+void JB_Add(JsonBuf * jb, const char * s, int len);
+
+/*
+** Add the escaped bytes of a string, without quotes. Bytes that are not UTF-8
+** are taken as Latin-1.
+*/
+void JB_Escape(JsonBuf * jb, const char * s, int len);
+
+/*
+** Start a value: the comma before it, and "key": in an object(key is NULL in
+** an array).
+*/
+void JB_Key(JsonBuf * jb, const char * key);
+
+/*
+** Open an object('{') or array('['), closed by JB_Close with '}' or ']'.
+*/
+void JB_Open(JsonBuf * jb, const char * key, char c);
+void JB_Close(JsonBuf * jb, char c);
+
+void JB_Str(JsonBuf * jb, const char * key, const char * s);
+void JB_StrN(JsonBuf * jb, const char * key, const char * s, int len);
+void JB_Int(JsonBuf * jb, const char * key, long long n);
+void JB_Bool(JsonBuf * jb, const char * key, int b);
+
+/*
+** A value written already, json of len bytes.
+*/
+void JB_Raw(JsonBuf * jb, const char * key, const char * json, int len);
+
+#endif
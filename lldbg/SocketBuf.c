@@ -1,322 +1,707 @@
-/******************************************************************************
-* Copyright (C) 2009 Zhang Lei.  All rights reserved.
-*
-* Permission is hereby granted, free of charge, to any person obtaining
-* a copy of this software and associated documentation files (the
-* "Software"), to deal in the Software without restriction, including
-* without limitation the rights to use, copy, modify, merge, publish,
-* distribute, sublicense, and/or sell copies of the Software, and to
-* permit persons to whom the Software is furnished to do so, subject to
-* the following conditions:
-*
-* The above copyright notice and this permission notice shall be
-* included in all copies or substantial portions of the Software.
-*
-* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
-* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
-* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
-* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
-* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
-* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
-* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-******************************************************************************/
-
-#include <assert.h>
-#include <string.h>
-#include <ctype.h>
-#include "SocketBuf.h"
-
-void SB_Init(SocketBuf * sb, SOCKET s)
-{
-    sb->s = s;
-    sb->eobL = 0;
-    sb->eobR = 0;
-//    sb->tempLen = 0;
-    sb->end = 0;
-    sb->err = 0;
-}
-
-static void SB_Reset(SocketBuf * sb)
-{
-//    sb->tempLen = 0;
-    sb->end = 0;
-    sb->err = 0;
-}
-
-static int RecvData(SOCKET s, char * buf, int len)
-{
-    char * p = buf;
-    int avail = len;
-    int received = 0;
-
-    while (avail > 0) {
-        int l = recv(s, p, avail, 0);
-        if (l == SOCKET_ERROR)
-            return -1;
-
-        received += l;
-        if (p[l - 1] == 0)
-            return received - 1;    //Return payload length, excluding the EOF character.
-
-        p += l;
-        avail -= l;
-    }
-
-    return len; //Buffer is full, but EOF is not reached.
-}
-
-int SB_Read(SocketBuf * sb, int bytes)
-{
-    int rc;
-    SB_Reset(sb);
-
-    if (bytes == SB_R_LEFT) {
-        rc = RecvData(sb->s, sb->lbuf, SOCKET_BUF_CAP);
-    }
-    else if (bytes == SB_R_RIGHT) {
-        rc = RecvData(sb->s, sb->rbuf, SOCKET_BUF_CAP);
-    }
-    else {
-        rc = RecvData(sb->s, sb->lbuf, bytes < SOCKET_BUF_CAP ? bytes : SOCKET_BUF_CAP);
-    }
-
-    if (rc < 0) {
-        sb->err = 1;
-        return -1;
-    }
-
-    if (bytes < 0 && rc < SOCKET_BUF_CAP)
-        sb->end = 1;
-
-    return rc;
-}
-
-typedef enum
-{
-    ERR = -1,
-    INIT = 0,
-    EOB,
-    EOF,
-    SEPARATERS,
-    TEXT
-} ParserState;
-
-int SB_ReadAndParse(SocketBuf * sb, const char * separaters, UserParser parser, void * userdata)
-{
-    char * p = (char *)&sb->eobR;
-    char * start = p;   //Start position of a word or a block of space
-    int inLeft = 0;     //whether p is in left buffer
-    ParserState st = EOB;
-    int rc = 0;
-    char temp[SOCKET_BUF_TMP];
-    int tempLen = 0;    //length of available str in temp
-
-    SB_Reset(sb);
-    while (st != EOF && st != ERR) {
-        switch (st) {
-            case EOB: {
-                if (SB_Read(sb, inLeft ? SB_R_RIGHT : SB_R_LEFT) < 0) {
-                    rc = -1;
-                    st = ERR;
-                    break;
-                }
-                p = inLeft ? sb->rbuf : sb->lbuf;
-                inLeft = inLeft ? 0 : 1;
-                start = p;
-
-                //if (isspace(*p))
-                if (*p && strchr(separaters, *p))
-                    st = SEPARATERS;
-                else if (*p)
-                    st = TEXT;
-                else {
-                    if (tempLen > 0)
-                        rc = parser(userdata, temp, tempLen);
-
-                    if (rc < 0) {
-                        st = ERR;
-                    }
-                    else {
-                        rc = 0;
-                        st = EOF;
-                    }
-                }
-                break;
-            }
-
-            case SEPARATERS: {
-                if (tempLen > 0) {
-                    rc = parser(userdata, temp, tempLen);
-                    if (rc < 0) {
-                        st = ERR;
-                        break;
-                    }
-                    else {
-                        rc = 0;
-                    }
-                    tempLen = 0;
-                }
-
-                //while (isspace(*p))
-                while (*p && strchr(separaters, *p))
-                    ++p;
-
-                if (*p) {
-                    st = TEXT;
-                    start = p;
-                }
-                else if (sb->end)
-                    st = EOF;
-                else
-                    st = EOB;
-
-                break;
-            }
-
-            case TEXT: {
-                //while (!isspace(*p) && *p)
-                while (*p && !strchr(separaters, *p))
-                    ++p;
-
-                if (*p)
-                    st = SEPARATERS;
-                else if (sb->end)
-                    st = EOF;
-                else
-                    st = EOB;
-
-                if (tempLen > 0) {
-                    if (p - start + tempLen > SOCKET_BUF_TMP) {
-                        st = ERR;
-                        rc = -2;
-                        break;
-                    }
-                    memcpy(temp + tempLen, start, p - start);
-                    tempLen += p - start;
-                    rc = parser(userdata, temp, tempLen);
-                    tempLen = 0;
-                }
-                else if (st != EOB) {
-                    rc = parser(userdata, start, p - start);
-                }
-                else {
-                    if (p - start > SOCKET_BUF_TMP) {
-                        st = ERR;
-                        rc = -1;
-                        break;
-                    }
-                    memcpy(temp, start, p - start);
-                    tempLen = p - start;
-                }
-
-                if (rc < 0) {
-                    st = ERR;
-                }
-                else {
-                    rc = 0;
-                    start = p;
-                }
-
-                break;
-            }
-
-            default: {
-                assert(0 && "Impossibility!");
-            }
-        }
-    }
-    return rc;
-}
-
-#if 0
-static int SB_Parse(SocketBuf * sb, int bufId, UserParser parser, void * userdata);
-
-int SB_ReadAndParse(SocketBuf * sb, UserParser parser, void * userdata)
-{
-    int rc = 0;
-    SB_Reset(sb);
-    while (1) {
-        rc = SB_Read(sb, SB_R_LEFT);
-        if (rc < 0)
-            break;
-
-        rc = SB_Parse(sb, 0, parser, userdata);
-        if (rc <= 0)
-            break;  //0 on End, while negative on error
-
-        rc = SB_Read(sb, SB_R_RIGHT);
-        if (rc < 0)
-            break;
-
-        rc = SB_Parse(sb, 1, parser, userdata);
-        if (rc <= 0)
-            break;  //0 on End, while negative on error
-    }
-    return rc;
-}
-
-/*
-** Success return:
-** 0 when the end of flow is reached, or 1 when not.
-** Failure return:
-** -2 when a word is too long to be held, or a negative(should be neither -1
-** nor -2) when a user parser fails.
-*/
-int SB_Parse(SocketBuf * sb, int bufId, UserParser parser, void * userdata)
-{
-    char * buf = bufId ? sb->rbuf : sb->lbuf;
-    char * p = buf;
-    int rc;
-
-    if (sb->tempLen > 0) {
-        int len;
-        if (isspace(*p)) {
-            len = sb->tempLen;
-        }
-        else {
-            while (!isspace(*p) && *p)
-                ++p;
-            len = sb->tempLen + (p - buf);
-            if (len >= SOCKET_BUF_TMP)
-                return -2; //Too long
-            memcpy(sb->temp + sb->tempLen, buf, p - buf);
-        }
-        rc = parser(userdata, sb->temp, len);
-        if (rc < 0)
-            return rc;  //Parser error
-        sb->tempLen = 0;
-    }
-
-    while (1) {
-        char * end;
-        int eof;    //End of flow?
-        int eob;    //End of buffer?
-
-        while (isspace(*p))
-            ++p;
-
-        if (!*p) {
-            return sb->end ? 0 : 1;
-        }
-
-        end = p;
-        while (!isspace(*end) && *end)
-            ++end;
-
-        eof = !*end && sb->end ? 1 : 0;
-        eob = !eof && !*end ? 1 : 0;
-
-        if (!eob) {
-            rc = parser(userdata, sb->p, end - p);
-            if (rc < 0)
-                return rc;
-        }
-        if (eof)
-            return 0;
-        if (eob)
-            return 1;
-        p = ++end;
-    }
-    return 0;
-}
-#endif
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include "SocketBuf.h"
+
+#ifndef OS_WIN
+#include <stddef.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+//Polls of an empty ring before sleeping, a stream keeps coming meanwhile
+#define RING_SPIN 20000
+#endif
+
+static SB_Waiter s_waiter;
+
+void SB_SetWaiter(SB_Waiter waiter)
+{
+    s_waiter = waiter;
+}
+
+void SB_Init(SocketBuf * sb, SOCKET s)
+{
+    sb->s = s;
+    sb->ring = NULL;
+    sb->rec = NULL;
+    sb->replay = NULL;
+    sb->ip = 0;
+    sb->iend = 0;
+    sb->type = 0;
+    sb->left = 0;
+    sb->fin = 1;
+    sb->lz = 0;
+    sb->end = 0;
+    sb->err = 0;
+}
+
+static void SB_Reset(SocketBuf * sb)
+{
+    sb->end = 0;
+    sb->err = 0;
+}
+
+void SB_Record(SocketBuf * sb, SB_Rec * rec)
+{
+    sb->rec = rec;
+}
+
+void SB_Replay(SocketBuf * sb, int type, const char * data, int len)
+{
+    SB_Init(sb, INVALID_SOCKET);
+    sb->replay = data;
+    sb->type = type;
+    sb->left = len;
+}
+
+static void SB_Keep(SB_Rec * rec, const char * data, int len)
+{
+    if (rec->len + len > rec->cap) {
+        int cap = rec->cap ? rec->cap : 4096;
+        char * buf;
+
+        while (cap < rec->len + len)
+            cap *= 2;
+        buf = realloc(rec->buf, cap);
+        if (!buf) {
+            rec->err = 1;
+            return;
+        }
+        rec->buf = buf;
+        rec->cap = cap;
+    }
+    memcpy(rec->buf + rec->len, data, len);
+    rec->len += len;
+}
+
+#ifndef OS_WIN
+SB_Ring * SB_CreateRing(const char * path, unsigned int size)
+{
+    size_t len = offsetof(SB_Ring, data) + size;
+    SB_Ring * r;
+    int fd = open(path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+
+    if (fd < 0)
+        return NULL;
+    if (ftruncate(fd, len) < 0) {
+        close(fd);
+        unlink(path);
+        return NULL;
+    }
+
+    r = (SB_Ring *)mmap(NULL, len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (r == MAP_FAILED) {
+        unlink(path);
+        return NULL;
+    }
+    r->size = size;
+    return r;
+}
+
+void SB_FreeRing(SB_Ring * ring)
+{
+    munmap(ring, offsetof(SB_Ring, data) + ring->size);
+}
+
+/*
+** Read the SB_WAKE frame sent by lldb.
+*/
+static int SB_RecvWake(SOCKET s)
+{
+    unsigned char h[SB_HEAD_LEN];
+    int got = 0;
+
+    while (got < SB_HEAD_LEN) {
+        int l;
+        if (s_waiter && s_waiter(s) < 0)
+            return -1;
+        l = recv(s, (char *)h + got, SB_HEAD_LEN - got, 0);
+        if (l == SOCKET_ERROR || l == 0)
+            return -1;
+        got += l;
+    }
+    return h[0] == SB_VERSION && h[1] == SB_WAKE ? 0 : -1;
+}
+
+/*
+** Copy out what's in the ring, up to len bytes. When it's empty, spin a while
+** and then sleep until lldb sends a SB_WAKE frame.
+*/
+static int SB_RingRead(SocketBuf * sb, char * buf, int len)
+{
+    SB_Ring * r = sb->ring;
+    unsigned int mask = r->size - 1;
+    int spin = 0;
+
+    while (1) {
+        unsigned int tail = r->tail;
+        unsigned int head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        unsigned int off = tail & mask;
+        unsigned int n = head - tail;
+
+        if (n) {
+            if (n > (unsigned int)len)
+                n = len;
+            if (n > r->size - off)
+                n = r->size - off;
+            memcpy(buf, r->data + off, n);
+            __atomic_store_n(&r->tail, tail + n, __ATOMIC_SEQ_CST);
+            if (__atomic_exchange_n(&r->waiting, 0, __ATOMIC_SEQ_CST))
+                syscall(SYS_futex, &r->tail, FUTEX_WAKE, 1, NULL, NULL, 0);
+            return n;
+        }
+
+        if (spin++ < RING_SPIN)
+            continue;
+
+        //Data written after this is sure to come with a SB_WAKE frame
+        __atomic_store_n(&r->sleeping, 1, __ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&r->head, __ATOMIC_SEQ_CST) != tail)
+            __atomic_store_n(&r->sleeping, 0, __ATOMIC_SEQ_CST);
+        else if (SB_RecvWake(sb->s) < 0
+            && __atomic_load_n(&r->head, __ATOMIC_SEQ_CST) == tail)
+            return -1;
+        spin = 0;
+    }
+}
+#endif
+
+int SB_Pending(SocketBuf * sb)
+{
+#ifndef OS_WIN
+    if (sb->ring && __atomic_load_n(&sb->ring->head, __ATOMIC_ACQUIRE) != sb->ring->tail)
+        return 1;
+#endif
+    return sb->ip < sb->iend;
+}
+
+int SB_Arm(SocketBuf * sb)
+{
+#ifndef OS_WIN
+    if (sb->ring)
+        __atomic_store_n(&sb->ring->sleeping, 1, __ATOMIC_SEQ_CST);
+#endif
+    return SB_Pending(sb);
+}
+
+int SB_Poll(SocketBuf * sb)
+{
+#ifndef OS_WIN
+    if (sb->ring) {
+        //lldb may close right after its last write, drain the ring first
+        if (SB_RecvWake(sb->s) < 0 && !SB_Pending(sb)) {
+            sb->err = 1;
+            return -1;
+        }
+        return SB_Pending(sb);
+    }
+#endif
+    return 1;
+}
+
+/*
+** Make at least len bytes available in sb->in.
+** Return 0 on success, -1 on error or when the peer is closed.
+*/
+static int SB_Fill(SocketBuf * sb, int len)
+{
+    if (sb->iend - sb->ip >= len)
+        return 0;
+
+    if (sb->ip > 0) {
+        memmove(sb->in, sb->in + sb->ip, sb->iend - sb->ip);
+        sb->iend -= sb->ip;
+        sb->ip = 0;
+    }
+
+    while (sb->iend < len) {
+        int l;
+#ifndef OS_WIN
+        if (sb->ring)
+            l = SB_RingRead(sb, sb->in + sb->iend, SOCKET_BUF_IN - sb->iend);
+        else
+#endif
+        if (s_waiter && s_waiter(sb->s) < 0)
+            l = SOCKET_ERROR;
+        else
+            l = recv(sb->s, sb->in + sb->iend, SOCKET_BUF_IN - sb->iend, 0);
+        if (l == SOCKET_ERROR || l == 0) {
+            sb->err = 1;
+            return -1;
+        }
+        sb->iend += l;
+    }
+    return 0;
+}
+
+/*
+** Decompress src of len bytes, LZ4 style sequences, to dst of cap bytes.
+** Return the length of data, or -1 when it's corrupt.
+*/
+static int lzDecompress(const unsigned char * src, int len, unsigned char * dst, int cap)
+{
+    const unsigned char * ip = src;
+    const unsigned char * iend = src + len;
+    unsigned char * op = dst;
+    unsigned char * oend = dst + cap;
+
+    while (ip < iend) {
+        unsigned int token = *ip++;
+        int lit = token >> 4;
+        int mlen = token & 15;
+        int off;
+        const unsigned char * ref;
+
+        if (lit == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                lit += *ip;
+            } while (*ip++ == 255);
+        }
+        if (lit > iend - ip || lit > oend - op)
+            return -1;
+        memcpy(op, ip, lit);
+        op += lit;
+        ip += lit;
+
+        //The last sequence has no match
+        if (ip == iend)
+            break;
+
+        if (iend - ip < 2)
+            return -1;
+        off = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (!off || off > op - dst)
+            return -1;
+
+        if (mlen == 15) {
+            do {
+                if (ip >= iend)
+                    return -1;
+                mlen += *ip;
+            } while (*ip++ == 255);
+        }
+        mlen += 4;
+        if (mlen > oend - op)
+            return -1;
+
+        //Byte by byte when the match overlaps what it produces
+        ref = op - off;
+        if (off >= mlen) {
+            memcpy(op, ref, mlen);
+            op += mlen;
+        }
+        else {
+            for (; mlen > 0; --mlen)
+                *op++ = *ref++;
+        }
+    }
+    return (int)(op - dst);
+}
+
+/*
+** Decompress the payload of a SB_LZ frame into sb->z.
+*/
+static int SB_Inflate(SocketBuf * sb)
+{
+    const unsigned char * p;
+    int len = (int)sb->left;
+    unsigned int raw;
+
+    if (len < 4 || len > SOCKET_BUF_IN || SB_Fill(sb, len) < 0) {
+        sb->err = 1;
+        return -1;
+    }
+
+    p = (const unsigned char *)sb->in + sb->ip;
+    raw = ((unsigned int)p[0] << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    if (raw > sizeof(sb->z)
+        || lzDecompress(p + 4, len - 4, (unsigned char *)sb->z, raw) != (int)raw) {
+        sb->err = 1;
+        return -1;
+    }
+
+    sb->ip += len;
+    sb->left = raw;
+    sb->zp = 0;
+    return 0;
+}
+
+/*
+** Read a frame header of the type, any type when type is 0.
+*/
+static int SB_ReadHead(SocketBuf * sb, int type)
+{
+    const unsigned char * h;
+
+    if (SB_Fill(sb, SB_HEAD_LEN) < 0)
+        return -1;
+
+    h = (const unsigned char *)sb->in + sb->ip;
+    if (h[0] != SB_VERSION || (type && h[1] != type)) {
+        sb->err = 1;
+        return -1;
+    }
+
+    sb->type = h[1];
+    sb->fin = h[2] & SB_FIN;
+    sb->lz = h[2] & SB_LZ;
+    sb->left = ((unsigned int)h[4] << 24) | (h[5] << 16) | (h[6] << 8) | h[7];
+    sb->ip += SB_HEAD_LEN;
+    return sb->lz ? SB_Inflate(sb) : 0;
+}
+
+/*
+** Get the next chunk of payload in current message, in place.
+** Return the length of chunk, 0 at the end of message, or -1 on error.
+*/
+static int SB_Chunk(SocketBuf * sb, const char ** chunk)
+{
+    int len;
+
+    while (!sb->left) {
+        if (sb->fin)
+            return 0;
+        if (SB_ReadHead(sb, sb->type) < 0)
+            return -1;
+    }
+
+    if (sb->replay) {
+        len = (int)sb->left;
+        *chunk = sb->replay;
+        sb->replay += len;
+        sb->left = 0;
+        return len;
+    }
+
+    if (sb->lz) {
+        len = (int)sb->left;
+        *chunk = sb->z + sb->zp;
+        sb->zp += len;
+        sb->left = 0;
+        return len;
+    }
+
+    if (SB_Fill(sb, 1) < 0)
+        return -1;
+
+    len = sb->iend - sb->ip;
+    if ((unsigned int)len > sb->left)
+        len = (int)sb->left;
+
+    *chunk = sb->in + sb->ip;
+    sb->ip += len;
+    sb->left -= len;
+    return len;
+}
+
+/*
+** SB_Chunk, and keep the chunk when recording.
+*/
+static int SB_Take(SocketBuf * sb, const char ** chunk)
+{
+    int len = SB_Chunk(sb, chunk);
+
+    if (len > 0 && sb->rec)
+        SB_Keep(sb->rec, *chunk, len);
+    return len;
+}
+
+int SB_Next(SocketBuf * sb)
+{
+    const char * chunk;
+    int rc;
+
+    while ((rc = SB_Chunk(sb, &chunk)) > 0);
+    if (rc < 0 || SB_ReadHead(sb, 0) < 0)
+        return -1;
+
+    SB_Reset(sb);
+    return sb->type;
+}
+
+int SB_Read(SocketBuf * sb, int bytes)
+{
+    char * buf = bytes == SB_R_RIGHT ? sb->rbuf : sb->lbuf;
+    int len = bytes < 0 || bytes > SOCKET_BUF_CAP ? SOCKET_BUF_CAP : bytes;
+    int rc = 0;
+
+    SB_Reset(sb);
+    while (rc < len) {
+        const char * chunk;
+        int l;
+
+        //Peek so as not to take more than wanted from the frame.
+        if (!sb->left && sb->fin)
+            break;
+        l = SB_Take(sb, &chunk);
+        if (l < 0)
+            return -1;
+        if (l > len - rc) {
+            if (sb->replay)
+                sb->replay -= l - (len - rc);
+            else if (sb->lz)
+                sb->zp -= l - (len - rc);
+            else
+                sb->ip -= l - (len - rc);
+            if (sb->rec && !sb->rec->err)
+                sb->rec->len -= l - (len - rc);
+            sb->left += l - (len - rc);
+            l = len - rc;
+        }
+        memcpy(buf + rc, chunk, l);
+        rc += l;
+    }
+
+    buf[rc] = 0;
+    if (!sb->left && sb->fin)
+        sb->end = 1;
+    return rc;
+}
+
+int SB_ReadAndParse(SocketBuf * sb, const char * separaters, UserParser parser, void * userdata)
+{
+    char isSep[256];
+    int sep = separaters[0] && !separaters[1] ? (unsigned char)separaters[0] : -1;
+    char temp[SOCKET_BUF_TMP];
+    int tempLen = 0;    //length of a word split by chunks, kept in temp
+    int raw = 0;        //Bytes to pass as they are, asked by the parser
+    int rc = 0;
+
+    memset(isSep, 0, sizeof(isSep));
+    while (*separaters)
+        isSep[(unsigned char)*separaters++] = 1;
+
+    SB_Reset(sb);
+    while (1) {
+        const char * p;
+        const char * end;
+        int len = SB_Take(sb, &p);
+
+        if (len < 0)
+            return -1;
+        if (len == 0)
+            break;
+
+        end = p + len;
+        while (p < end) {
+            const char * start = p;
+
+            if (raw > 0) {
+                int l = end - p < raw ? (int)(end - p) : raw;
+                rc = parser(userdata, p, l);
+                if (rc < 0)
+                    return rc;
+                raw -= l;
+                p += l;
+                continue;
+            }
+
+            if (isSep[(unsigned char)*p]) {
+                if (tempLen > 0) {
+                    rc = parser(userdata, temp, tempLen);
+                    if (rc < 0)
+                        return rc;
+                    raw = rc;
+                    tempLen = 0;
+                }
+                ++p;
+                continue;
+            }
+
+            //memchr is much faster with the only separator, which is the usual case
+            if (sep >= 0) {
+                p = memchr(p, sep, end - p);
+                if (!p)
+                    p = end;
+            }
+            else {
+                while (p < end && !isSep[(unsigned char)*p])
+                    ++p;
+            }
+
+            //The word may go on in the next chunk
+            if (p == end || tempLen > 0) {
+                if (p - start + tempLen > SOCKET_BUF_TMP)
+                    return -2;
+                memcpy(temp + tempLen, start, p - start);
+                tempLen += p - start;
+                continue;
+            }
+
+            rc = parser(userdata, start, p - start);
+            if (rc < 0)
+                return rc;
+            raw = rc;
+            if (raw > 0)
+                ++p;    //The separator
+        }
+    }
+
+    if (raw > 0)
+        return -1;
+    if (tempLen > 0) {
+        rc = parser(userdata, temp, tempLen);
+        if (rc < 0)
+            return rc;
+    }
+    sb->end = 1;
+    return 0;
+}
+
+static int SendData(SOCKET s, const char * buf, int len)
+{
+    while (len > 0) {
+        int sent = send(s, buf, len, 0);
+        if (sent == SOCKET_ERROR)
+            return -1;
+        len -= sent;
+        buf += sent;
+    }
+    return 0;
+}
+
+int SendFrame(SOCKET s, int type, const char * data, int len)
+{
+    char buf[SOCKET_BUF_CAP];
+    unsigned char * h = (unsigned char *)buf;
+    int l = len < SOCKET_BUF_CAP - SB_HEAD_LEN ? len : SOCKET_BUF_CAP - SB_HEAD_LEN;
+
+    h[0] = SB_VERSION;
+    h[1] = (unsigned char)type;
+    h[2] = SB_FIN;
+    h[3] = 0;
+    h[4] = (unsigned char)((unsigned int)len >> 24);
+    h[5] = (unsigned char)((unsigned int)len >> 16);
+    h[6] = (unsigned char)((unsigned int)len >> 8);
+    h[7] = (unsigned char)len;
+
+    //Header and the leading data in one send
+    memcpy(buf + SB_HEAD_LEN, data, l);
+    if (SendData(s, buf, SB_HEAD_LEN + l) < 0)
+        return -1;
+    return SendData(s, data + l, len - l);
+}
+
+#if 0
+static int SB_Parse(SocketBuf * sb, int bufId, UserParser parser, void * userdata);
+
+int SB_ReadAndParse(SocketBuf * sb, UserParser parser, void * userdata)
+{
+    int rc = 0;
+    SB_Reset(sb);
+    while (1) {
+        rc = SB_Read(sb, SB_R_LEFT);
+        if (rc < 0)
+            break;
+
+        rc = SB_Parse(sb, 0, parser, userdata);
+        if (rc <= 0)
+            break;  //0 on End, while negative on error
+
+        rc = SB_Read(sb, SB_R_RIGHT);
+        if (rc < 0)
+            break;
+
+        rc = SB_Parse(sb, 1, parser, userdata);
+        if (rc <= 0)
+            break;  //0 on End, while negative on error
+    }
+    return rc;
+}
+
+/*
+** Success return:
+** 0 when the end of flow is reached, or 1 when not.
+** Failure return:
+** -2 when a word is too long to be held, or a negative(should be neither -1
+** nor -2) when a user parser fails.
+*/
+int SB_Parse(SocketBuf * sb, int bufId, UserParser parser, void * userdata)
+{
+    char * buf = bufId ? sb->rbuf : sb->lbuf;
+    char * p = buf;
+    int rc;
+
+    if (sb->tempLen > 0) {
+        int len;
+        if (isspace(*p)) {
+            len = sb->tempLen;
+        }
+        else {
+            while (!isspace(*p) && *p)
+                ++p;
+            len = sb->tempLen + (p - buf);
+            if (len >= SOCKET_BUF_TMP)
+                return -2; //Too long
+            memcpy(sb->temp + sb->tempLen, buf, p - buf);
+        }
+        rc = parser(userdata, sb->temp, len);
+        if (rc < 0)
+            return rc;  //Parser error
+        sb->tempLen = 0;
+    }
+
+    while (1) {
+        char * end;
+        int eof;    //End of flow?
+        int eob;    //End of buffer?
+
+        while (isspace(*p))
+            ++p;
+
+        if (!*p) {
+            return sb->end ? 0 : 1;
+        }
+
+        end = p;
+        while (!isspace(*end) && *end)
+            ++end;
+
+        eof = !*end && sb->end ? 1 : 0;
+        eob = !eof && !*end ? 1 : 0;
+
+        if (!eob) {
+            rc = parser(userdata, sb->p, end - p);
+            if (rc < 0)
+                return rc;
+        }
+        if (eof)
+            return 0;
+        if (eob)
+            return 1;
+        p = ++end;
+    }
+    return 0;
+}
+#endif
@@ -1,78 +1,210 @@
-/******************************************************************************
-* Copyright (C) 2009 Zhang Lei.  All rights reserved.
-*
-* Permission is hereby granted, free of charge, to any person obtaining
-* a copy of this software and associated documentation files (the
-* "Software"), to deal in the Software without restriction, including
-* without limitation the rights to use, copy, modify, merge, publish,
-* distribute, sublicense, and/or sell copies of the Software, and to
-* permit persons to whom the Software is furnished to do so, subject to
-* the following conditions:
-*
-* The above copyright notice and this permission notice shall be
-* included in all copies or substantial portions of the Software.
-*
-* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
-* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
-* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
-* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
-* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
-* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
-* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
-******************************************************************************/
-
-#ifndef __SOCKETBUF_H__
-#define __SOCKETBUF_H__
-
-#include "Socket.h"
-
-#ifndef SOCKET_BUF_CAP
-#define SOCKET_BUF_CAP 1024
-#endif
-
-#ifndef SOCKET_BUF_TMP
-#define SOCKET_BUF_TMP 1024
-#endif
-
-#if SOCKET_BUF_TMP > SOCKET_BUF_CAP
-#error "Socket temp buf can not be greater than a single socket buf."
-#endif
-
-typedef struct {
-    SOCKET s;
-    char lbuf[SOCKET_BUF_CAP];
-    int eobL;
-    char rbuf[SOCKET_BUF_CAP];
-    int eobR;
-//    char temp[SOCKET_BUF_TMP];
-//    int tempLen;
-    int end;
-    int err;
-} SocketBuf;
-
-void SB_Init(SocketBuf * sb, SOCKET s);
-
-#define SB_R_LEFT -2
-#define SB_R_RIGHT -3
-/*
-** Read specified bytes into sb('s left buffer). When bytes is -2/-3, read until
-** the left/right buffer is full or the EOF is reached.
-** Return the bytes read. When a socket IO error happens, -1 is returned.
-*/
-int SB_Read(SocketBuf * sb, int bytes);
-
-/*
-** Should return 0 on success and a negative on error.
-*/
-typedef int (* UserParser)(void * userdata, const char * word, int length);
-
-/*
-** Read a flow into sb while parsing it. Call the parser when a word is found,
-** which is separated by specified separaters.
-** Return 0 when success, -1 when a socket error happens, or -2 when a word is
-** too long(greater than SOCKET_BUF_TMP), or a negative returned by a user parser.
-** A user parser should not return -1 nor -2 in order to be distinguished.
-*/
-int SB_ReadAndParse(SocketBuf * sb, const char * separaters, UserParser parser, void * userdata);
-
-#endif
+/******************************************************************************
+* Copyright (C) 2009 Zhang Lei.  All rights reserved.
+*
+* Permission is hereby granted, free of charge, to any person obtaining
+* a copy of this software and associated documentation files (the
+* "Software"), to deal in the Software without restriction, including
+* without limitation the rights to use, copy, modify, merge, publish,
+* distribute, sublicense, and/or sell copies of the Software, and to
+* permit persons to whom the Software is furnished to do so, subject to
+* the following conditions:
+*
+* The above copyright notice and this permission notice shall be
+* included in all copies or substantial portions of the Software.
+*
+* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+* EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+* MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+* IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+* CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+* TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+* SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+******************************************************************************/
+
+#ifndef __SOCKETBUF_H__
+#define __SOCKETBUF_H__
+
+#include "Socket.h"
+
+#ifndef SOCKET_BUF_CAP
+#define SOCKET_BUF_CAP 1024
+#endif
+
+#ifndef SOCKET_BUF_TMP
+#define SOCKET_BUF_TMP 1024
+#endif
+
+#ifndef SOCKET_BUF_IN
+#define SOCKET_BUF_IN 16384
+#endif
+
+#if SOCKET_BUF_TMP > SOCKET_BUF_CAP
+#error "Socket temp buf can not be greater than a single socket buf."
+#endif
+
+/*
+** Frames, same as SocketBuf.h of lldb: a header followed by the payload.
+** byte 0       version, SB_VERSION
+** byte 1       message type
+** byte 2       flags, SB_FIN set in the last frame of a message, SB_LZ when the
+**              payload is compressed(data length and LZ4 style sequences)
+** byte 3       reserved, 0
+** byte 4-7     payload length, in network byte order
+*/
+#define SB_VERSION 1
+#define SB_FIN 0x01
+#define SB_LZ 0x02
+#define SB_HEAD_LEN 8
+
+/*
+** Message types, same as Protocol.h of lldb.
+*/
+#define PROT_CMD 'C'
+#define PROT_BREAK 'B'
+#define PROT_QUIT 'Q'
+#define PROT_OK 'O'
+#define PROT_ERR 'E'
+
+#ifndef OS_WIN
+/*
+** Shared memory ring(same host only), same as SocketBuf.h of lldb: once
+** attached, lldb writes its frames to the ring instead of the socket, and sends
+** a SB_WAKE frame when lldbg sleeps on an empty ring.
+*/
+#define SB_WAKE 'W'
+
+#ifndef SB_RING_SIZE
+#define SB_RING_SIZE (4 << 20)
+#endif
+
+typedef struct {
+    unsigned int head;          //Written by the producer
+    char pad1[60];
+    unsigned int tail;          //Written by the consumer, futex of the producer
+    char pad2[60];
+    int sleeping;               //The consumer waits for a SB_WAKE frame
+    int waiting;                //The producer waits for room on the tail futex
+    unsigned int size;
+    char pad3[52];
+    char data[1];
+} SB_Ring;
+
+/*
+** Create a ring of size(a power of 2) in file path, to be mapped by lldb.
+** Return NULL on failure.
+*/
+SB_Ring * SB_CreateRing(const char * path, unsigned int size);
+
+void SB_FreeRing(SB_Ring * ring);
+#else
+typedef struct SB_Ring SB_Ring;
+#endif
+
+//Payload of the messages read, kept by SB_Record
+typedef struct {
+    char * buf;
+    int len;
+    int cap;
+    int err;                    //Out of memory, buf misses some
+} SB_Rec;
+
+typedef struct {
+    SOCKET s;
+    SB_Ring * ring;             //Frames come from the ring when not NULL
+    SB_Rec * rec;               //The payload read is copied here when not NULL
+    const char * replay;        //The payload comes from here when not NULL, see SB_Replay
+    char in[SOCKET_BUF_IN];     //Bytes received but not read yet, in[ip, iend)
+    int ip;
+    int iend;
+    int type;                   //Type of the message being read
+    unsigned int left;          //Payload bytes left in the current frame
+    int fin;                    //Whether the current frame is the last one
+    int lz;                     //The current frame is decompressed, in z[zp, zp + left)
+    int zp;
+    char z[SOCKET_BUF_IN];
+    char lbuf[SOCKET_BUF_CAP + 1];
+    char rbuf[SOCKET_BUF_CAP + 1];
+    int end;
+    int err;
+} SocketBuf;
+
+void SB_Init(SocketBuf * sb, SOCKET s);
+
+/*
+** Called before each receive with the socket, should return 0 once it's
+** readable, or -1 to give up(the read fails as by a socket error). Receives
+** just block when there's none.
+*/
+typedef int (* SB_Waiter)(SOCKET s);
+
+void SB_SetWaiter(SB_Waiter waiter);
+
+/*
+** Copy the payload read from sb to rec from now on, till rec is NULL.
+*/
+void SB_Record(SocketBuf * sb, SB_Rec * rec);
+
+/*
+** Set sb to read a message of type again, with the payload recorded. Only what
+** reads the current message works then, SB_Next doesn't.
+*/
+void SB_Replay(SocketBuf * sb, int type, const char * data, int len);
+
+/*
+** Skip the rest of current message, and start reading the next one.
+** Return the type of the message, or -1 on socket or protocol error.
+*/
+int SB_Next(SocketBuf * sb);
+
+/*
+** Whether there are bytes received but not read yet, which select() won't tell.
+*/
+int SB_Pending(SocketBuf * sb);
+
+/*
+** Call before waiting for the socket with select(): a ring asks for a SB_WAKE
+** frame when data comes. Return SB_Pending(sb).
+*/
+int SB_Arm(SocketBuf * sb);
+
+/*
+** Call when select() finds the socket readable, before reading a message.
+** Return 1 when a message can be read, 0 when not(a stale SB_WAKE frame of a
+** ring), or -1 on socket error.
+*/
+int SB_Poll(SocketBuf * sb);
+
+#define SB_R_LEFT -2
+#define SB_R_RIGHT -3
+/*
+** Read specified bytes of current message into sb('s left buffer). When bytes
+** is -2/-3, read until the left/right buffer is full or the end of message is
+** reached. A terminating zero is added, and sb->end is set at the end of message.
+** Return the bytes read. When a socket IO error happens, -1 is returned.
+*/
+int SB_Read(SocketBuf * sb, int bytes);
+
+/*
+** Should return 0 on success and a negative on error. A positive n asks for the
+** n bytes after the separator of the word as they are: they come in one or more
+** calls whatever they hold, and what those calls return is only checked for
+** errors.
+*/
+typedef int (* UserParser)(void * userdata, const char * word, int length);
+
+/*
+** Read the rest of current message while parsing it. Call the parser when a
+** word is found, which is separated by specified separaters.
+** Return 0 when success, -1 when a socket error happens, or -2 when a word is
+** too long(greater than SOCKET_BUF_TMP), or a negative returned by a user parser.
+** A user parser should not return -1 nor -2 in order to be distinguished.
+*/
+int SB_ReadAndParse(SocketBuf * sb, const char * separaters, UserParser parser, void * userdata);
+
+/*
+** Send data as a single frame message of the type.
+** Return 0 when success, or -1 when a socket error happens.
+*/
+int SendFrame(SOCKET s, int type, const char * data, int len);
+
+#endif